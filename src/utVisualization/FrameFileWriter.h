@@ -0,0 +1,104 @@
+/*
+ * Ubitrack - Library for Ubiquitous Tracking
+ * Copyright 2006, Technische Universitaet Muenchen, and individual
+ * contributors as indicated by the @authors tag. See the
+ * copyright.txt in the distribution for a full listing of individual
+ * contributors.
+ *
+ * This is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this software; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA, or see the FSF site: http://www.fsf.org.
+ */
+
+/**
+ * @file
+ * Writing of recorded frames, shared by the recording HighguiWindow and the VideoRecorder render component.
+ * Lives outside the component directories, which include it as <utVisualization/FrameFileWriter.h>.
+ */
+
+#ifndef __FrameFileWriter_h_INCLUDED__
+#define __FrameFileWriter_h_INCLUDED__
+
+#include <string>
+#include <boost/format.hpp>
+#include <opencv2/highgui/highgui.hpp>
+#include <utUtil/Exception.h>
+
+namespace Ubitrack { namespace Drivers {
+
+/**
+ * Writes frames to a video file or, if the path contains a format specifier like "frame_%06d.png",
+ * to an image sequence numbered by the frame index.
+ *
+ * Video files are MJPG encoded 8 bit BGR images. The file is opened with the first frame, whose
+ * size is kept for the whole recording. Image sequences take any size and any type cv::imwrite() can store.
+ *
+ * Errors are thrown as Util::Exception, after which the caller is expected to stop the recording.
+ * Images of a sequence may be written from several threads at once, video files only from one.
+ */
+class FrameFileWriter
+{
+public:
+	/**
+	 * @param path video file or image sequence
+	 * @param fps frame rate of video files
+	 */
+	FrameFileWriter( const std::string& path, double fps )
+		: m_path( path )
+		, m_bSequence( path.find( '%' ) != std::string::npos )
+		, m_fps( fps )
+	{}
+
+	/** whether the frames are written to separate image files */
+	bool sequence() const
+	{ return m_bSequence; }
+
+	const std::string& path() const
+	{ return m_path; }
+
+	/** writes a frame, the index numbers the files of an image sequence */
+	void write( const cv::Mat& frame, unsigned long index )
+	{
+		if ( m_bSequence )
+		{
+			if ( !cv::imwrite( ( boost::format( m_path ) % index ).str(), frame ) )
+				UBITRACK_THROW( "cannot write image " + ( boost::format( m_path ) % index ).str() );
+			return;
+		}
+
+		if ( !m_writer.isOpened() )
+		{
+			m_writer.open( m_path, CV_FOURCC( 'M', 'J', 'P', 'G' ), m_fps, frame.size(), true );
+			if ( !m_writer.isOpened() )
+				UBITRACK_THROW( "cannot open video file " + m_path );
+			m_frameSize = frame.size();
+		}
+		if ( frame.size() != m_frameSize )
+			UBITRACK_THROW( "image size changed during recording" );
+		m_writer.write( frame );
+	}
+
+protected:
+	std::string m_path;
+	bool m_bSequence;
+	double m_fps;
+
+	// only used for video files
+	cv::VideoWriter m_writer;
+	cv::Size m_frameSize;
+};
+
+} } // namespace Ubitrack::Drivers
+
+#endif
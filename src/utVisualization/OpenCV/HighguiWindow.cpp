@@ -34,14 +34,22 @@
 
 #include <string>
 #include <iostream>
+#include <sstream>
 #include <deque>
+#include <map>
+#include <set>
+#include <vector>
+#include <algorithm>
+#include <cmath>
 
 #include <boost/version.hpp>
 #include <boost/thread.hpp>
-#include <boost/thread/xtime.hpp>
-#include <boost/function.hpp>
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+#include <boost/atomic.hpp>
 #include <boost/bind.hpp>
 #include <boost/scoped_ptr.hpp>
+#include <boost/scoped_array.hpp>
+#include <boost/format.hpp>
 #include <log4cpp/Category.hh>
 
 #include <utDataflow/PushConsumer.h>
@@ -54,6 +62,17 @@
 #include <utVision/Image.h>
 
 #include <opencv/highgui.h>
+#include <opencv2/highgui/highgui.hpp>
+#include <opencv2/imgproc/imgproc.hpp>
+#if CV_MAJOR_VERSION == 2
+	#include <opencv2/contrib/contrib.hpp>
+#endif
+#if CV_MAJOR_VERSION > 2
+	#include <opencv2/core/opengl.hpp>
+#endif
+
+#include <utVisualization/FrameFileWriter.h>
+#include "WindowCommandQueue.h"
 
 static log4cpp::Category& logger( log4cpp::Category::getInstance( "Ubitrack.Vision.HighguiWindow" ) );
 
@@ -85,23 +104,464 @@ public:
 class HighguiWindow;
 class HighguiWindowModule;
 
+
+/**
+ * Maps single-channel 16 bit and float images (depth, thermal, ...) to displayable 8 bit images.
+ * Multi-channel images are only scaled.
+ */
+struct DisplayTransform
+{
+	enum Range { rangeAuto, rangePercentile, rangeFixed };
+
+	DisplayTransform()
+		: range( rangeAuto )
+		, fixedMin( 0.0 )
+		, fixedMax( 1.0 )
+		, percentile( 1.0 )
+		, colormap( -1 )
+	{}
+
+	/** reads the display* attributes of a window */
+	void configure( const Graph::UTQLSubgraph& subgraph );
+
+	/** whether images of this OpenCV type need the transform */
+	bool applies( int type ) const
+	{ return CV_MAT_DEPTH( type ) != CV_8U || ( colormap >= 0 && CV_MAT_CN( type ) == 1 ); }
+
+	/** computes the value range that is mapped to 0..255 */
+	void valueRange( const cv::Mat& image, double& minValue, double& maxValue ) const;
+
+	/** creates the lookup table (256 BGR entries) of the colormap, empty for grey */
+	cv::Mat createColormapLut() const;
+
+	/** maps an image to 8 bit grey or the colormap given by lut */
+	void apply( const cv::Mat& image, const cv::Mat& lut, cv::Mat& result ) const;
+
+	Range range;
+	double fixedMin;
+	double fixedMax;
+
+	/** percentage of pixels clipped at either end for rangePercentile */
+	double percentile;
+
+	/** OpenCV colormap, -1 for grey */
+	int colormap;
+};
+
+
+void DisplayTransform::configure( const Graph::UTQLSubgraph& subgraph )
+{
+	std::string sRange( "auto" );
+	if ( subgraph.m_DataflowAttributes.hasAttribute( "displayRange" ) )
+		sRange = subgraph.m_DataflowAttributes.getAttributeString( "displayRange" );
+	if ( sRange == "auto" )
+		range = rangeAuto;
+	else if ( sRange == "percentile" )
+		range = rangePercentile;
+	else if ( sRange == "fixed" )
+		range = rangeFixed;
+	else
+		UBITRACK_THROW( "HighguiWindow: unknown displayRange " + sRange );
+
+	subgraph.m_DataflowAttributes.getAttributeData( "displayMin", fixedMin );
+	subgraph.m_DataflowAttributes.getAttributeData( "displayMax", fixedMax );
+	subgraph.m_DataflowAttributes.getAttributeData( "displayPercentile", percentile );
+
+	std::string sColormap( "grey" );
+	if ( subgraph.m_DataflowAttributes.hasAttribute( "displayColormap" ) )
+		sColormap = subgraph.m_DataflowAttributes.getAttributeString( "displayColormap" );
+	if ( sColormap == "grey" )
+		colormap = -1;
+	else if ( sColormap == "jet" )
+		colormap = cv::COLORMAP_JET;
+	else if ( sColormap == "hot" )
+		colormap = cv::COLORMAP_HOT;
+	else if ( sColormap == "bone" )
+		colormap = cv::COLORMAP_BONE;
+	else if ( sColormap == "rainbow" )
+		colormap = cv::COLORMAP_RAINBOW;
+	else
+		UBITRACK_THROW( "HighguiWindow: unknown displayColormap " + sColormap );
+}
+
+
+void DisplayTransform::valueRange( const cv::Mat& image, double& minValue, double& maxValue ) const
+{
+	if ( range == rangeFixed )
+	{
+		minValue = fixedMin;
+		maxValue = fixedMax;
+		return;
+	}
+
+	cv::Mat values( image.reshape( 1 ) );
+	cv::minMaxLoc( values, &minValue, &maxValue );
+	if ( range != rangePercentile || maxValue <= minValue )
+		return;
+
+	// histogram of every fourth row is accurate enough for display
+	const int bins = 1024;
+	std::vector< unsigned > histogram( bins, 0 );
+	double binScale = bins / ( maxValue - minValue );
+	unsigned long total = 0;
+	cv::Mat values32;
+	for ( int y = 0; y < values.rows; y += 4 )
+	{
+		values.row( y ).convertTo( values32, CV_32F );
+		const float* p = values32.ptr< float >();
+		for ( int x = 0; x < values32.cols; x++ )
+		{
+			if ( p[ x ] != p[ x ] )
+				continue; // NaN
+			int bin = std::min( int( ( p[ x ] - minValue ) * binScale ), bins - 1 );
+			histogram[ bin ]++;
+			total++;
+		}
+	}
+
+	unsigned long clip = static_cast< unsigned long >( total * percentile / 100.0 );
+	unsigned long sum = 0;
+	int low = 0;
+	while ( low < bins - 1 && sum + histogram[ low ] <= clip )
+		sum += histogram[ low++ ];
+	sum = 0;
+	int high = bins - 1;
+	while ( high > low && sum + histogram[ high ] <= clip )
+		sum += histogram[ high-- ];
+
+	double newMin = minValue + low / binScale;
+	maxValue = minValue + ( high + 1 ) / binScale;
+	minValue = newMin;
+}
+
+
+/** placement of a window as a tile in a shared mosaic window */
+struct MosaicConfig
+{
+	MosaicConfig()
+		: columns( 0 )
+		, tileWidth( 320 )
+		, tileHeight( 240 )
+	{}
+
+	/** reads the mosaic* attributes of a window */
+	void configure( const Graph::UTQLSubgraph& subgraph );
+
+	/** title of the mosaic window, empty for a window of its own */
+	std::string name;
+
+	/** number of tile columns, 0 for a square layout */
+	int columns;
+
+	int tileWidth;
+	int tileHeight;
+};
+
+
+void MosaicConfig::configure( const Graph::UTQLSubgraph& subgraph )
+{
+	if ( subgraph.m_DataflowAttributes.hasAttribute( "mosaic" ) )
+		name = subgraph.m_DataflowAttributes.getAttributeString( "mosaic" );
+	subgraph.m_DataflowAttributes.getAttributeData( "mosaicColumns", columns );
+	subgraph.m_DataflowAttributes.getAttributeData( "mosaicTileWidth", tileWidth );
+	subgraph.m_DataflowAttributes.getAttributeData( "mosaicTileHeight", tileHeight );
+	if ( columns < 0 || tileWidth <= 0 || tileHeight <= 0 )
+		UBITRACK_THROW( "HighguiWindow: invalid mosaic layout" );
+}
+
+
+/**
+ * Scales rows to 8 bit and looks up the colormap while each row is still in the cache.
+ * convertTo() is vectorized by OpenCV, the lookup is a plain gather.
+ */
+class DisplayTransformBody
+	: public cv::ParallelLoopBody
+{
+public:
+	DisplayTransformBody( const cv::Mat& src, cv::Mat& dst, double alpha, double beta, const cv::Mat& lut )
+		: m_src( src )
+		, m_dst( dst )
+		, m_alpha( alpha )
+		, m_beta( beta )
+		, m_lut( lut )
+	{}
+
+	virtual void operator()( const cv::Range& rows ) const
+	{
+		cv::Mat row8;
+		for ( int y = rows.start; y < rows.end; y++ )
+		{
+			if ( m_lut.empty() )
+			{
+				cv::Mat dstRow( m_dst.row( y ) );
+				m_src.row( y ).convertTo( dstRow, dstRow.type(), m_alpha, m_beta );
+				continue;
+			}
+
+			m_src.row( y ).convertTo( row8, CV_8U, m_alpha, m_beta );
+			const unsigned char* s = row8.ptr< unsigned char >();
+			const cv::Vec3b* lut = m_lut.ptr< cv::Vec3b >();
+			cv::Vec3b* d = m_dst.ptr< cv::Vec3b >( y );
+			for ( int x = 0; x < row8.cols; x++ )
+				d[ x ] = lut[ s[ x ] ];
+		}
+	}
+
+protected:
+	const cv::Mat& m_src;
+	cv::Mat& m_dst;
+	double m_alpha;
+	double m_beta;
+	const cv::Mat& m_lut;
+};
+
+cv::Mat DisplayTransform::createColormapLut() const
+{
+	cv::Mat lut;
+	if ( colormap >= 0 )
+	{
+		cv::Mat ramp( 1, 256, CV_8UC1 );
+		for ( int i = 0; i < 256; i++ )
+			ramp.at< unsigned char >( 0, i ) = static_cast< unsigned char >( i );
+		cv::applyColorMap( ramp, lut, colormap );
+	}
+	return lut;
+}
+
+
+void DisplayTransform::apply( const cv::Mat& image, const cv::Mat& lut, cv::Mat& result ) const
+{
+	double minValue, maxValue;
+	valueRange( image, minValue, maxValue );
+	double alpha = maxValue > minValue ? 255.0 / ( maxValue - minValue ) : 0.0;
+	double beta = -minValue * alpha;
+
+	bool bColormap = !lut.empty() && image.channels() == 1;
+	result.create( image.size(), bColormap ? CV_8UC3 : CV_MAKETYPE( CV_8U, image.channels() ) );
+
+	static const cv::Mat noLut;
+	cv::parallel_for_( cv::Range( 0, image.rows ), 
+		DisplayTransformBody( image, result, alpha, beta, bColormap ? lut : noLut ) );
+}
+
+
+/** how the images of a window are presented */
+enum DisplayMode
+{
+	/** highgui window */
+	displayNormal,
+
+	/** highgui window with OpenGL support, images are shown as textures */
+	displayOpenGL,
+
+	/** no window, only statistics are collected */
+	displayNull,
+
+	/** no window, images are written to files */
+	displayRecord
+};
+
+
+/**
+ * Writes images to a video file or an image sequence in a thread of its own.
+ * The queue is bounded, images that do not fit are rejected instead of delaying the caller.
+ */
+class FrameRecorder
+{
+public:
+	/**
+	 * starts the writer thread
+	 * @param path video file, or an image sequence if it contains a format specifier, e.g. "frame_%06d.png"
+	 * @param fps frame rate of video files
+	 * @param queueSize maximum number of images waiting to be written
+	 * @param transform mapping of images that the file format cannot store
+	 */
+	FrameRecorder( const std::string& path, double fps, unsigned queueSize, const DisplayTransform& transform )
+		: m_file( path, fps )
+		, m_queueSize( std::max( queueSize, 1u ) )
+		, m_transform( transform )
+		, m_colormapLut( transform.createColormapLut() )
+		, m_bStop( false )
+		, m_bFailed( false )
+		, m_nWritten( 0 )
+	{
+		m_pThread.reset( new boost::thread( boost::bind( &FrameRecorder::threadProc, this ) ) );
+	}
+
+	/** writes the remaining images and stops the thread */
+	~FrameRecorder()
+	{
+		{
+			boost::mutex::scoped_lock l( m_mutex );
+			m_bStop = true;
+			m_condition.notify_all();
+		}
+		m_pThread->join();
+	}
+
+	/** queues an image, returns false if the queue is full */
+	bool push( boost::shared_ptr< Image > pImage )
+	{
+		boost::mutex::scoped_lock l( m_mutex );
+		if ( m_queue.size() >= m_queueSize || m_bFailed )
+			return false;
+		m_queue.push_back( pImage );
+		m_condition.notify_all();
+		return true;
+	}
+
+protected:
+	void threadProc()
+	{
+		while ( true )
+		{
+			boost::shared_ptr< Image > pImage;
+			{
+				boost::mutex::scoped_lock l( m_mutex );
+				while ( m_queue.empty() && !m_bStop )
+					m_condition.wait( l );
+				if ( m_queue.empty() )
+					break;
+				pImage = m_queue.front();
+				m_queue.pop_front();
+			}
+
+			try
+			{
+				write( pImage );
+				m_nWritten++;
+			}
+			catch ( const std::exception& e )
+			{
+				LOG4CPP_ERROR( logger, "Recording to " << m_file.path() << " failed: " << e.what() );
+				boost::mutex::scoped_lock l( m_mutex );
+				m_bFailed = true;
+				m_queue.clear();
+			}
+		}
+
+		LOG4CPP_INFO( logger, "Recorded " << m_nWritten << " images to " << m_file.path() );
+	}
+
+	void write( boost::shared_ptr< Image > pImage )
+	{
+		cv::Mat frame( pImage->Mat() );
+		if ( pImage->origin() )
+		{
+			cv::flip( frame, m_flipped, 0 );
+			frame = m_flipped;
+		}
+
+		if ( m_file.sequence() )
+		{
+			// image files can store 8 and 16 bit, everything else is mapped like the display
+			if ( frame.depth() != CV_8U && frame.depth() != CV_16U )
+			{
+				m_transform.apply( frame, m_colormapLut, m_converted );
+				frame = m_converted;
+			}
+		}
+		else
+		{
+			// video files take 8 bit BGR images
+			if ( m_transform.applies( frame.type() ) )
+			{
+				m_transform.apply( frame, m_colormapLut, m_converted );
+				frame = m_converted;
+			}
+			if ( frame.channels() != 3 )
+			{
+				cv::cvtColor( frame, m_bgr, frame.channels() == 1 ? cv::COLOR_GRAY2BGR : cv::COLOR_BGRA2BGR );
+				frame = m_bgr;
+			}
+		}
+
+		m_file.write( frame, m_nWritten );
+	}
+
+	FrameFileWriter m_file;
+	std::size_t m_queueSize;
+	DisplayTransform m_transform;
+	cv::Mat m_colormapLut;
+
+	boost::scoped_ptr< boost::thread > m_pThread;
+	boost::mutex m_mutex;
+	boost::condition m_condition;
+	std::deque< boost::shared_ptr< Image > > m_queue;
+	bool m_bStop;
+
+	// set after a write error, further images are rejected
+	bool m_bFailed;
+
+	// the following are only used by the writer thread
+	unsigned long m_nWritten;
+	cv::Mat m_flipped;
+	cv::Mat m_converted;
+	cv::Mat m_bgr;
+};
+
+
+/** configuration of a recording window */
+struct RecordConfig
+{
+	RecordConfig()
+		: fps( 30.0 )
+		, queueSize( 8 )
+	{}
+
+	/** reads the record* attributes of a window */
+	void configure( const Graph::UTQLSubgraph& subgraph )
+	{
+		if ( subgraph.m_DataflowAttributes.hasAttribute( "recordPath" ) )
+			path = subgraph.m_DataflowAttributes.getAttributeString( "recordPath" );
+		subgraph.m_DataflowAttributes.getAttributeData( "recordFps", fps );
+		subgraph.m_DataflowAttributes.getAttributeData( "recordQueue", queueSize );
+		queueSize = std::max( queueSize, 1 );
+		if ( path.empty() )
+			UBITRACK_THROW( "HighguiWindow: displayMode record requires a recordPath" );
+	}
+
+	std::string path;
+	double fps;
+	int queueSize;
+};
+
+
 typedef Module< SingleModuleKey, HWCKey, HighguiWindowModule, HighguiWindow > ModuleBase;
 
 
 
 /**
- * The module -- only responsible for a thread that calls cvGetKey every 100ms
+ * The module -- only responsible for a thread that shows the images and dispatches the window events.
+ * The thread is woken up by new images and processes window events at least every uiInterval ms.
+ *
+ * All highgui calls are made by this thread, because in Win32 all calls that modify a window
+ * have to come from the same thread. Other threads send commands through a lock-free ring and
+ * leave images in a slot per window.
  */
 class HighguiWindowModule
 	: public ModuleBase
 {
 public:
+	/** maximum number of windows of a module, their slots are preallocated */
+	enum { maxWindows = 256 };
+
 	/** constructor, creates thread */
-	HighguiWindowModule( const SingleModuleKey& key, boost::shared_ptr< Graph::UTQLSubgraph >, FactoryHelper* pFactory )
+	HighguiWindowModule( const SingleModuleKey& key, boost::shared_ptr< Graph::UTQLSubgraph > subgraph, FactoryHelper* pFactory )
 		: ModuleBase( key, pFactory )
 		, m_bStop( false )
 		, m_nWindows( 0 )
-	{}
+		, m_uiInterval( 20 )
+		, m_windows( new Window[ maxWindows ] )
+		, m_nRegistered( 0 )
+		, m_lastDropReport( 0 )
+		, m_lastStatisticsReport( 0 )
+	{
+		// all windows share the thread, so the first window configures it
+		if ( subgraph )
+			subgraph->m_DataflowAttributes.getAttributeData( "uiInterval", m_uiInterval );
+		m_uiInterval = std::max( m_uiInterval, 1 );
+	}
 
 	/** destructor, stops thread */
 	~HighguiWindowModule()
@@ -109,7 +569,7 @@ public:
 
 	virtual void stopModule()
 	{
-		m_bStop = true;
+		m_commands.signal( m_bStop );
 		if ( m_pThread )
 		{
 			m_pThread->join();
@@ -118,63 +578,622 @@ public:
 
 	virtual void startModule()
 	{
-		m_pThread.reset( new boost::thread( boost::bind( &HighguiWindowModule::threadProc, this ) ) );
 		m_bStop = false;
+		m_pThread.reset( new boost::thread( boost::bind( &HighguiWindowModule::threadProc, this ) ) );
 	}
 
-	/** creates a new window */
-	void createWindow( const std::string& name )
+	/** 
+	 * registers a new window and lets the thread create it
+	 * @param mode presentation of the images, displayNull and displayRecord do not open a window
+	 * @param transform mapping of 16 bit and float images for display
+	 * @param mosaic the mosaic window the images are shown in as a tile, if any
+	 * @param record output of displayRecord
+	 * @return id of the window for the other calls
+	 */
+	int createWindow( const std::string& name, DisplayMode mode, const DisplayTransform& transform, 
+		const MosaicConfig& mosaic, const RecordConfig& record )
 	{
-		boost::mutex::scoped_lock l( m_queueMutex );
-		m_queue.push_back( boost::bind( &HighguiWindowModule::myCreateWindow, this, name ) );
-		m_queueCondition.notify_all();
+		int id;
+		{
+			boost::mutex::scoped_lock l( m_registerMutex );
+			id = m_nRegistered.load( boost::memory_order_relaxed );
+			if ( id >= maxWindows )
+				UBITRACK_THROW( "HighguiWindow: too many windows" );
+
+			// the configuration is constant once the command has been pushed
+			Window& window = m_windows[ id ];
+			window.name = name;
+			window.mode = mode;
+			window.transform = transform;
+			window.mosaic = mosaic;
+			window.record = record;
+			m_nRegistered.store( id + 1, boost::memory_order_release );
+		}
+
+		m_commands.push( WindowCommand( WindowCommand::createWindow, id ) );
+		return id;
 	}
 	
-	void addMouseCallback( const std::string& name, HighguiWindow* p )
+	void addMouseCallback( int window, HighguiWindow* p )
 	{
-		// getComponent( HWCKey( name ) ) ;
-		boost::mutex::scoped_lock l( m_queueMutex );
-		m_queue.push_back( boost::bind( cvSetMouseCallback, name.c_str(), on_mouse, p ) );
-		m_queueCondition.notify_all();
+		m_commands.push( WindowCommand( WindowCommand::addMouseCallback, window, p ) );
 	}
 	
-	void addTrackbar( int & initVal, unsigned maxVal, const std::string& winName, const std::string &trackBarName, HighguiWindow* p  )
+	void addTrackbar( int window, int& initVal, unsigned maxVal, const std::string& trackBarName, HighguiWindow* p )
 	{
-#if CV_MAJOR_VERSION > 1
-		boost::mutex::scoped_lock l( m_queueMutex );
-		m_queue.push_back( boost::bind( cvCreateTrackbar2, trackBarName.c_str(), winName.c_str(), &initVal, maxVal, on_trackbar, p ) );
-		m_queueCondition.notify_all();
-#endif
+		WindowCommand command( WindowCommand::addTrackbar, window, p );
+		command.pValue = &initVal;
+		command.maxValue = maxVal;
+		command.pTrackbarName = &trackBarName;
+		m_commands.push( command );
 	}
 
-	/** shows an image */
-	void showImage( const std::string& name, const boost::shared_ptr< Image > pImage )
+	/** 
+	 * shows an image. Only the newest image per window is kept, an image that has not
+	 * been shown yet is replaced and counted as dropped.
+	 * Pushing threads only contend on the slot of their window and do not allocate.
+	 */
+	void showImage( int window, const Measurement::ImageMeasurement& image )
 	{
-		boost::mutex::scoped_lock l( m_queueMutex );
-		m_queue.push_back( boost::bind( &HighguiWindowModule::myShowImage, this, name, pImage ) );
-		m_queueCondition.notify_all();
+		// a full slot has already been announced, the thread takes the newest image from it
+		if ( m_windows[ window ].slot.put( image, image.time() ) )
+			m_commands.push( WindowCommand( WindowCommand::imageReady, window ) );
 	}
 
 
 protected:
+	/** counters of a window for the statistics report */
+	struct WindowStatistics
+	{
+		WindowStatistics()
+			: nShown( 0 )
+			, nRecordDropped( 0 )
+			, nLatencies( 0 )
+			, latencySum( 0.0 )
+			, latencyMax( 0.0 )
+			, nReceivedReported( 0 )
+			, nDroppedReported( 0 )
+			, nShownReported( 0 )
+			, nRecordDroppedReported( 0 )
+		{}
+
+		/** images shown, or discarded in displayNull, or queued for recording */
+		unsigned long nShown;
+
+		/** images rejected by the full recording queue */
+		unsigned long nRecordDropped;
+
+		/** latency from image timestamp to display in ms since the last report */
+		unsigned long nLatencies;
+		double latencySum;
+		double latencyMax;
+
+		/** counters at the last report */
+		unsigned long nReceivedReported;
+		unsigned long nDroppedReported;
+		unsigned long nShownReported;
+		unsigned long nRecordDroppedReported;
+	};
+
+	/** an image taken from its slot by the window thread */
+	struct PendingImage
+	{
+		int window;
+		boost::shared_ptr< Image > pImage;
+		Measurement::Timestamp time;
+	};
+
+	struct Mosaic;
+
+	/** display state of a window */
+	struct WindowState
+	{
+		WindowState()
+			: mode( displayNormal )
+			, bOpenGL( false )
+			, bInteropFailed( false )
+			, pMosaic( 0 )
+			, pComponent( 0 )
+		{}
+
+		DisplayMode mode;
+
+		/** output and writer thread of displayRecord, created with the first image */
+		RecordConfig record;
+		boost::shared_ptr< FrameRecorder > pRecorder;
+
+		WindowStatistics statistics;
+
+		bool bOpenGL;
+		bool bInteropFailed;
+
+		DisplayTransform transform;
+
+		/** colormap lookup table (256 BGR entries), empty for grey */
+		cv::Mat colormapLut;
+
+		/** result of the display transform */
+		cv::Mat display;
+
+#if CV_MAJOR_VERSION > 2
+		cv::ogl::Texture2D texture;
+		cv::UMat converted;
+		cv::UMat flippedGpu;
+#endif
+		cv::Mat flipped;
+
+		/** mosaic of a tile, 0 for windows of their own */
+		Mosaic* pMosaic;
+
+		/** component receiving mouse events of a tile */
+		HighguiWindow* pComponent;
+
+		/** cell of a tile in the mosaic canvas and the part covered by the scaled image */
+		cv::Rect tileRect;
+		cv::Rect imageRect;
+
+		/** size of the last image shown in a tile */
+		cv::Size imageSize;
+
+		/** scaled image of a tile before color conversion */
+		cv::Mat scaled;
+	};
+
+	/** a window showing the images of several components as tiles */
+	struct Mosaic
+	{
+		MosaicConfig config;
+
+		/** tiles in the order the windows were created */
+		std::vector< WindowState* > tiles;
+
+		/** preallocated 8 bit BGR image holding all tiles */
+		cv::Mat canvas;
+
+		/** display state of the mosaic window */
+		WindowState window;
+	};
+
+	/** an image that is drawn into its cell of a mosaic canvas */
+	struct MosaicTile
+	{
+		WindowState* pState;
+		cv::Mat image;
+		int origin;
+		cv::Mat canvas;
+	};
+
+	/** scales and converts the new images of all tiles in parallel */
+	class MosaicBody
+		: public cv::ParallelLoopBody
+	{
+	public:
+		MosaicBody( const std::vector< MosaicTile >& tiles )
+			: m_tiles( tiles )
+		{}
+
+		virtual void operator()( const cv::Range& range ) const
+		{
+			for ( int i = range.start; i < range.end; i++ )
+				drawTile( m_tiles[ i ] );
+		}
+
+	protected:
+		const std::vector< MosaicTile >& m_tiles;
+	};
+
+	/** a registered window */
+	struct Window
+	{
+		Window()
+			: mode( displayNormal )
+			, nDropsLogged( 0 )
+			, bReady( false )
+		{}
+
+		// configuration, written by createWindow() before the window is announced to the thread
+		std::string name;
+		DisplayMode mode;
+		DisplayTransform transform;
+		MosaicConfig mosaic;
+		RecordConfig record;
+
+		/** newest image, shared by the pushing threads and the window thread */
+		LatestSlot< Image > slot;
+
+		/** only used by the window thread */
+		WindowState state;
+
+		/** dropped images already logged by the window thread */
+		unsigned long nDropsLogged;
+
+		/** set by the window thread while the window is announced in the current batch of commands */
+		bool bReady;
+	};
+
 	// thread main loop
 	void threadProc();
 
-	void myCreateWindow( const std::string& name )
+	void myCreateWindow( int id )
+	{
+		const Window& window = m_windows[ id ];
+		WindowState& state = m_windows[ id ].state;
+		state.mode = window.mode;
+		state.record = window.record;
+		state.transform = window.transform;
+		state.colormapLut = window.transform.createColormapLut();
+
+		if ( window.mode == displayNull || window.mode == displayRecord )
+			LOG4CPP_INFO( logger, "Window \"" << window.name << "\" is not displayed" 
+				<< ( window.mode == displayRecord ? ", recording to " + window.record.path : "" ) );
+		else if ( window.mosaic.name.empty() )
+			openWindow( window.name, state, window.mode == displayOpenGL );
+		else
+			addTile( state, window.mode == displayOpenGL, window.mosaic );
+	}
+
+	/** opens a highgui window */
+	void openWindow( const std::string& name, WindowState& state, bool bOpenGL )
 	{
-		cvNamedWindow( name.c_str(), 0 );//CV_WINDOW_AUTOSIZE );
+		if ( bOpenGL )
+		{
+#if CV_MAJOR_VERSION > 2
+			try
+			{
+				cv::namedWindow( name, cv::WINDOW_OPENGL | cv::WINDOW_NORMAL );
+				state.bOpenGL = true;
+			}
+			catch ( const cv::Exception& e )
+			{
+				LOG4CPP_WARN( logger, "Cannot create OpenGL window \"" << name << "\", using normal display: " << e.what() );
+			}
+#else
+			LOG4CPP_WARN( logger, "OpenGL display requires OpenCV 3, using normal display for window \"" << name << "\"" );
+#endif
+		}
+
+		if ( !state.bOpenGL )
+			cvNamedWindow( name.c_str(), 0 );//CV_WINDOW_AUTOSIZE );
 		m_nWindows++;
 	}
 
+	/** adds a window as tile to a mosaic, the first tile opens the mosaic window */
+	void addTile( WindowState& state, bool bOpenGL, const MosaicConfig& config )
+	{
+		std::pair< MosaicMap::iterator, bool > inserted = m_mosaics.insert( std::make_pair( config.name, Mosaic() ) );
+		Mosaic& mosaic = inserted.first->second;
+		state.pMosaic = &mosaic;
+		if ( inserted.second )
+		{
+			mosaic.config = config;
+			openWindow( config.name, mosaic.window, bOpenGL );
+			cvSetMouseCallback( config.name.c_str(), &HighguiWindowModule::onMosaicMouse, &mosaic );
+		}
+
+		mosaic.tiles.push_back( &state );
+		layoutMosaic( mosaic );
+	}
+
+	/** arranges the tiles in a grid and reallocates the canvas, tiles are redrawn with their next image */
+	void layoutMosaic( Mosaic& mosaic )
+	{
+		int nTiles = static_cast< int >( mosaic.tiles.size() );
+		int columns = mosaic.config.columns > 0 ? mosaic.config.columns : 
+			static_cast< int >( std::ceil( std::sqrt( static_cast< double >( nTiles ) ) ) );
+		int rows = ( nTiles + columns - 1 ) / columns;
+		int width = mosaic.config.tileWidth;
+		int height = mosaic.config.tileHeight;
+
+		mosaic.canvas = cv::Mat::zeros( rows * height, columns * width, CV_8UC3 );
+		for ( int i = 0; i < nTiles; i++ )
+		{
+			mosaic.tiles[ i ]->tileRect = cv::Rect( ( i % columns ) * width, ( i / columns ) * height, width, height );
+			mosaic.tiles[ i ]->imageRect = cv::Rect();
+		}
+	}
+
+	void myAddMouseCallback( int id, HighguiWindow* p )
+	{
+		WindowState& state = m_windows[ id ].state;
+		if ( state.mode == displayNull || state.mode == displayRecord )
+			return;
+		else if ( !state.pMosaic )
+			cvSetMouseCallback( m_windows[ id ].name.c_str(), on_mouse, p );
+		else
+			state.pComponent = p;
+	}
+
+	void myAddTrackbar( const WindowCommand& command )
+	{
+#if CV_MAJOR_VERSION > 1
+		cvCreateTrackbar2( command.pTrackbarName->c_str(), m_windows[ command.window ].name.c_str(), 
+			command.pValue, command.maxValue, on_trackbar, command.pComponent );
+#endif
+	}
+
+	/** takes the image of a window from its slot */
+	void takeImage( int id, std::vector< PendingImage >& images )
+	{
+		PendingImage image;
+		image.window = id;
+		unsigned long long time;
+		if ( m_windows[ id ].slot.take( image.pImage, time ) )
+		{
+			image.time = time;
+			images.push_back( image );
+		}
+	}
+
+	/** forwards mouse events of a mosaic window to the tile under the cursor, in image coordinates */
+	static void onMosaicMouse( int event, int x, int y, int flags, void* param )
+	{
+		const Mosaic* pMosaic = static_cast< const Mosaic* >( param );
+		for ( std::size_t i = 0; i < pMosaic->tiles.size(); i++ )
+		{
+			const WindowState& tile = *pMosaic->tiles[ i ];
+			if ( tile.pComponent && tile.imageRect.contains( cv::Point( x, y ) ) )
+			{
+				on_mouse( event, ( x - tile.imageRect.x ) * tile.imageSize.width / tile.imageRect.width, 
+					( y - tile.imageRect.y ) * tile.imageSize.height / tile.imageRect.height, flags, tile.pComponent );
+				return;
+			}
+		}
+	}
+
+	/** 
+	 * shows the new images, all tiles of a mosaic are drawn into the canvas before it is shown once.
+	 * Windows without display only count the images or pass them to their recorder.
+	 */
+	void showImages( const std::vector< PendingImage >& images )
+	{
+		std::vector< MosaicTile > tiles;
+		std::set< Mosaic* > mosaics;
+		std::vector< std::pair< WindowState*, Measurement::Timestamp > > shown;
+		for ( std::size_t i = 0; i < images.size(); i++ )
+		{
+			const std::string& name = m_windows[ images[ i ].window ].name;
+			WindowState& state = m_windows[ images[ i ].window ].state;
+			const boost::shared_ptr< Image >& pImage = images[ i ].pImage;
+			if ( state.mode == displayRecord )
+			{
+				if ( !state.pRecorder )
+					state.pRecorder.reset( new FrameRecorder( state.record.path, state.record.fps, state.record.queueSize, state.transform ) );
+				if ( !state.pRecorder->push( pImage ) )
+				{
+					state.statistics.nRecordDropped++;
+					continue;
+				}
+			}
+			shown.push_back( std::make_pair( &state, images[ i ].time ) );
+			if ( state.mode == displayNull || state.mode == displayRecord )
+				continue;
+
+			if ( !state.pMosaic )
+			{
+				myShowImage( name, state, pImage );
+				continue;
+			}
+
+			MosaicTile tile;
+			tile.pState = &state;
+			tile.origin = pImage->origin();
+			tile.canvas = state.pMosaic->canvas;
+			if ( state.transform.applies( pImage->isOnGPU() ? pImage->uMat().type() : pImage->Mat().type() ) )
+			{
+				applyDisplayTransform( state, pImage->Mat() );
+				tile.image = state.display;
+			}
+			else
+				tile.image = pImage->Mat();
+			tiles.push_back( tile );
+			mosaics.insert( state.pMosaic );
+		}
+
+		if ( !tiles.empty() )
+		{
+			cv::parallel_for_( cv::Range( 0, static_cast< int >( tiles.size() ) ), MosaicBody( tiles ) );
+
+			for ( std::set< Mosaic* >::iterator it = mosaics.begin(); it != mosaics.end(); it++ )
+				showMat( ( *it )->config.name, ( *it )->window, ( *it )->canvas, 0 );
+		}
+
+		Measurement::Timestamp now = Measurement::now();
+		for ( std::size_t i = 0; i < shown.size(); i++ )
+		{
+			WindowStatistics& statistics = shown[ i ].first->statistics;
+			statistics.nShown++;
+
+			// images from other clocks or without timestamp have no meaningful latency
+			if ( shown[ i ].second == 0 || shown[ i ].second > now )
+				continue;
+			double latency = ( now - shown[ i ].second ) * 1e-6;
+			statistics.nLatencies++;
+			statistics.latencySum += latency;
+			statistics.latencyMax = std::max( statistics.latencyMax, latency );
+		}
+	}
+
+	/** logs rates and latency of every window since the last report, for windows without display at info level */
+	void reportStatistics( Measurement::Timestamp now )
+	{
+		double seconds = ( now - m_lastStatisticsReport ) * 1e-9;
+		int nWindows = m_nRegistered.load( boost::memory_order_acquire );
+		for ( int id = 0; id < nWindows; id++ )
+		{
+			unsigned long nReceived, nDropped;
+			m_windows[ id ].slot.counts( nReceived, nDropped );
+
+			WindowState& state = m_windows[ id ].state;
+			WindowStatistics& statistics = state.statistics;
+			log4cpp::Priority::Value priority = state.mode == displayNull || state.mode == displayRecord ? 
+				log4cpp::Priority::INFO : log4cpp::Priority::DEBUG;
+
+			if ( logger.isPriorityEnabled( priority ) )
+			{
+				std::ostringstream message;
+				message.precision( 3 );
+				message << "Window \"" << m_windows[ id ].name << "\": received " 
+					<< ( nReceived - statistics.nReceivedReported ) / seconds << " fps, shown "
+					<< ( statistics.nShown - statistics.nShownReported ) / seconds << " fps, dropped "
+					<< ( nDropped - statistics.nDroppedReported ) / seconds << " fps";
+				if ( state.mode == displayRecord )
+					message << ", rejected by recorder " << ( statistics.nRecordDropped - statistics.nRecordDroppedReported ) / seconds << " fps";
+				if ( statistics.nLatencies )
+					message << ", latency avg " << statistics.latencySum / statistics.nLatencies 
+						<< " ms max " << statistics.latencyMax << " ms";
+				logger.log( priority, message.str() );
+			}
+
+			statistics.nReceivedReported = nReceived;
+			statistics.nDroppedReported = nDropped;
+			statistics.nShownReported = statistics.nShown;
+			statistics.nRecordDroppedReported = statistics.nRecordDropped;
+			statistics.nLatencies = 0;
+			statistics.latencySum = 0.0;
+			statistics.latencyMax = 0.0;
+		}
+		m_lastStatisticsReport = now;
+	}
+
+	/** scales an 8 bit image into its tile, keeping the aspect ratio */
+	static void drawTile( const MosaicTile& tile )
+	{
+		WindowState& state = *tile.pState;
+		const cv::Mat& image = tile.image;
+		if ( image.empty() || image.channels() == 2 )
+			return;
+
+		cv::Mat cell( tile.canvas, state.tileRect );
+		double scale = std::min( double( cell.cols ) / image.cols, double( cell.rows ) / image.rows );
+		cv::Size size( std::max( 1, cvRound( image.cols * scale ) ), std::max( 1, cvRound( image.rows * scale ) ) );
+		cv::Rect imageRect( state.tileRect.x + ( cell.cols - size.width ) / 2, 
+			state.tileRect.y + ( cell.rows - size.height ) / 2, size.width, size.height );
+
+		// clear the borders only when the image size changes
+		if ( imageRect != state.imageRect )
+		{
+			cell.setTo( cv::Scalar::all( 0 ) );
+			state.imageRect = imageRect;
+		}
+		state.imageSize = image.size();
+
+		// the target is a view into the canvas of matching size and type, so nothing is reallocated
+		cv::Mat target( tile.canvas, imageRect );
+		int interpolation = scale < 1.0 ? cv::INTER_AREA : cv::INTER_LINEAR;
+		if ( image.channels() == 3 )
+			cv::resize( image, target, size, 0, 0, interpolation );
+		else
+		{
+			cv::resize( image, state.scaled, size, 0, 0, interpolation );
+			cv::cvtColor( state.scaled, target, image.channels() == 1 ? cv::COLOR_GRAY2BGR : cv::COLOR_BGRA2BGR );
+		}
+
+		if ( tile.origin )
+			cv::flip( target, target, 0 );
+	}
+
 	// @todo ->Mat() member function of image should be read-only, and ->WriteableMat() should be non-const
 //	void myShowImage( const std::string& name, const boost::shared_ptr< Image > pImage )
-	void myShowImage( const std::string& name, boost::shared_ptr< Image > pImage )
+	void myShowImage( const std::string& name, WindowState& state, boost::shared_ptr< Image > pImage )
+	{
+		// only images that are actually shown are transformed
+		int type = pImage->isOnGPU() ? pImage->uMat().type() : pImage->Mat().type();
+		if ( state.transform.applies( type ) )
+		{
+			applyDisplayTransform( state, pImage->Mat() );
+			showMat( name, state, state.display, pImage->origin() );
+		}
+		else if ( !( state.bOpenGL && pImage->isOnGPU() && showGpuTexture( name, state, pImage ) ) )
+			showMat( name, state, pImage->Mat(), pImage->origin() );
+	}
+
+	/** maps a 16 bit or float image to 8 bit grey or a colormap in state.display */
+	void applyDisplayTransform( WindowState& state, const cv::Mat& image )
+	{
+		state.transform.apply( image, state.colormapLut, state.display );
+	}
+
+	/** shows an image from main memory, as texture in OpenGL windows */
+	void showMat( const std::string& name, WindowState& state, const cv::Mat& image, int origin )
 	{
-		IplImage cvimg = pImage->Mat();				
-		cvimg.origin = pImage->origin();		
+#if CV_MAJOR_VERSION > 2
+		if ( state.bOpenGL )
+		{
+			try
+			{
+				cv::setOpenGlContext( name );
+
+				// texture upload understands BGR(A) directly, only flipping needs a copy
+				if ( origin )
+				{
+					cv::flip( image, state.flipped, 0 );
+					state.texture.copyFrom( state.flipped, true );
+				}
+				else
+					state.texture.copyFrom( image, true );
+
+				cv::imshow( name, state.texture );
+				return;
+			}
+			catch ( const cv::Exception& e )
+			{
+				LOG4CPP_ERROR( logger, "OpenGL display failed for window \"" << name << "\", using normal display: " << e.what() );
+				state.bOpenGL = false;
+			}
+		}
+#endif
+
+		IplImage cvimg = image;
+		cvimg.origin = origin;
 		cvShowImage( name.c_str(), &cvimg );
 	}
 
+	/** 
+	 * shows an image on the GPU in an OpenGL window via OpenCL/OpenGL sharing, 
+	 * if OpenCV's OpenCL context allows it.
+	 * @return false if the image has to be downloaded and shown by showMat()
+	 */
+	bool showGpuTexture( const std::string& name, WindowState& state, boost::shared_ptr< Image > pImage )
+	{
+#if CV_MAJOR_VERSION > 2
+		if ( state.bInteropFailed )
+			return false;
+
+		try
+		{
+			cv::setOpenGlContext( name );
+
+			// the shared texture is RGBA
+			int code = pImage->pixelFormat() == Image::BGR ? cv::COLOR_BGR2RGBA :
+				pImage->pixelFormat() == Image::BGRA ? cv::COLOR_BGRA2RGBA :
+				pImage->pixelFormat() == Image::RGB ? cv::COLOR_RGB2RGBA :
+				pImage->pixelFormat() == Image::LUMINANCE ? cv::COLOR_GRAY2RGBA : -1;
+			if ( code != -1 )
+				cv::cvtColor( pImage->uMat(), state.converted, code );
+			else
+				pImage->uMat().copyTo( state.converted );
+			cv::UMat* pSource = &state.converted;
+			if ( pImage->origin() )
+			{
+				cv::flip( state.converted, state.flippedGpu, 0 );
+				pSource = &state.flippedGpu;
+			}
+
+			cv::ogl::convertToGLTexture2D( *pSource, state.texture );
+			cv::imshow( name, state.texture );
+			return true;
+		}
+		catch ( const cv::Exception& e )
+		{
+			// usually because OpenCV's OpenCL context was not created from an OpenGL context
+			LOG4CPP_INFO( logger, "OpenCL/OpenGL sharing not available for window \"" << name 
+				<< "\", downloading GPU images: " << e.what() );
+			state.bInteropFailed = true;
+		}
+#endif
+		return false;
+	}
+
 	// the thread
 	boost::scoped_ptr< boost::thread > m_pThread;
 
@@ -184,17 +1203,28 @@ protected:
 	// number of windows open
 	int m_nWindows;
 
-	// a mutex object to synchronize highgui calls
-	boost::mutex m_queueMutex;
+	// maximum time between two window event dispatches in ms
+	int m_uiInterval;
+
+	// commands to the thread, wakes it when it sleeps
+	CommandQueue m_commands;
+
+	// serializes createWindow()
+	boost::mutex m_registerMutex;
 
-	// notification when the queue has changed
-	boost::condition m_queueCondition;
+	// window slots by id, preallocated so that pushing threads never see them move
+	boost::scoped_array< Window > m_windows;
+	boost::atomic< int > m_nRegistered;
 
-	// A queue to store procedure calls. Why? Because in Win32, all procedure calls that
-	// modify a window should come from the same thread. Big debugging otherwise. So we
-	// store the calls that the window thread should make in a single event queue.
-	typedef std::deque< boost::function< void() > > QueueType;
-	QueueType m_queue;
+	// time of the last report of dropped images
+	Measurement::Timestamp m_lastDropReport;
+
+	// time of the last statistics report
+	Measurement::Timestamp m_lastStatisticsReport;
+
+	// mosaic windows by name, only used by the window thread
+	typedef std::map< std::string, Mosaic > MosaicMap;
+	MosaicMap m_mosaics;
 };
 
 
@@ -227,11 +1257,44 @@ public:
 		, m_trackbarDistancePort( "TrackBarRatio", *this )
 		, m_inPort( "Input", *this, boost::bind( &HighguiWindow::pushImage, this, _1 ) )
 		, m_buttonPort( "Button", *this )
+		, m_window( -1 )
 	{
-		getModule().createWindow( getKey() );
-		getModule().addMouseCallback( getKey(), this );
+		std::string sDisplayMode( "normal" );
+		if ( subgraph->m_DataflowAttributes.hasAttribute( "displayMode" ) )
+			sDisplayMode = subgraph->m_DataflowAttributes.getAttributeString( "displayMode" );
+		DisplayMode mode;
+		if ( sDisplayMode == "normal" )
+			mode = displayNormal;
+		else if ( sDisplayMode == "opengl" )
+			mode = displayOpenGL;
+		else if ( sDisplayMode == "null" )
+			mode = displayNull;
+		else if ( sDisplayMode == "record" )
+			mode = displayRecord;
+		else
+			UBITRACK_THROW( "HighguiWindow: unknown displayMode " + sDisplayMode );
+		bool bHeadless = mode == displayNull || mode == displayRecord;
+
+		DisplayTransform transform;
+		transform.configure( *subgraph );
+
+		MosaicConfig mosaic;
+		if ( !bHeadless )
+			mosaic.configure( *subgraph );
+		if ( mosaic.name == getKey() )
+			UBITRACK_THROW( "HighguiWindow: mosaic must differ from windowTitle " + getKey() );
+
+		RecordConfig record;
+		if ( mode == displayRecord )
+			record.configure( *subgraph );
+
+		m_window = getModule().createWindow( getKey(), mode, transform, mosaic, record );
+		getModule().addMouseCallback( m_window, this );
 		
-		if( subgraph->m_DataflowAttributes.hasAttribute( "maxValue" ) )
+		// trackbars need a window of their own
+		if ( ( bHeadless || !mosaic.name.empty() ) && subgraph->m_DataflowAttributes.hasAttribute( "maxValue" ) )
+			LOG4CPP_WARN( logger, "HighguiWindow \"" << getKey() << "\": trackbars are only supported in windows of their own" );
+		else if( subgraph->m_DataflowAttributes.hasAttribute( "maxValue" ) )
 		{
 			subgraph->m_DataflowAttributes.getAttributeData( "maxValue", uiMaxValue );
 			subgraph->m_DataflowAttributes.getAttributeData( "initValue", iValue );
@@ -240,7 +1303,7 @@ public:
 			// for( unsigned i = 0; i < numBars, ++i )
 			m_trackBarValues.resize( numBars );
 			m_trackbarNames.push_back( "Value" );
-			getModule().addTrackbar( iValue, uiMaxValue, getKey(), m_trackbarNames[0], this );
+			getModule().addTrackbar( m_window, iValue, uiMaxValue, m_trackbarNames[0], this );
 		}
 	}
 	
@@ -272,7 +1335,7 @@ protected:
 	/** method that receives events and displays the image */
 	void pushImage( const Measurement::ImageMeasurement& m )
 	{
-		getModule().showImage( getKey(), m );
+		getModule().showImage( m_window, m );
 	}
 	
 	std::vector< int* > m_trackBarValues;
@@ -281,61 +1344,111 @@ protected:
 	Dataflow::PushConsumer< Measurement::ImageMeasurement > m_inPort;
 	/// Button input port
 	Dataflow::PushSupplier< Measurement::Button > m_buttonPort;
+
+	/// id of the window in the module
+	int m_window;
 };
 
 
 
 void HighguiWindowModule::threadProc()
 {
+	// highgui only repaints the windows and delivers events while waiting for a key.
+	// ATTENTION: has to be at least 2 on Linux, otherwise highgui does not process any events (Pete, 2010-08-17)
+#ifdef _WIN32
+	const int dispatchDelay = 1;
+#else
+	const int dispatchDelay = 2;
+#endif
+
+	Measurement::Timestamp nextDispatch = Measurement::now();
 	while ( !m_bStop )
 	{
-		// get next event from queue
-		boost::function< void() > nextCall;
 		{
-			boost::mutex::scoped_lock l( m_queueMutex );
-			if ( m_queue.empty() )
+			// sleep until woken by new commands or until the window events are due
+			Measurement::Timestamp now = Measurement::now();
+			m_commands.wait( m_bStop, now < nextDispatch ? ( nextDispatch - now ) / 1000 + 1 : 0 );
+		}
+
+		// comment of this change (CW@2013-05-24):
+		// previously there was one highgui function executed
+		// with cvWaitKey(10) after each call. -> lead to a huge
+		// delay when dealing with multiple images/windows at the same time. 
+		// therefore I changed to many calls (until pileline is empty) 
+		// and calling then cvWaitkey, hope that helps and works in common
+		// cases with one camera as well.
+		std::vector< int > readyWindows;
+		WindowCommand command;
+		while ( m_commands.pop( command ) )
+		{
+			switch ( command.type )
 			{
-				// wait for event or message dispatching timeout
-				boost::xtime xt;
-#if BOOST_VERSION >= 105000
-				boost::xtime_get( &xt, boost::TIME_UTC_ );
-#else
-				boost::xtime_get( &xt, boost::TIME_UTC );
-#endif
-				xt.nsec += 100000000;
-				xt.sec += xt.nsec / 1000000000;
-				xt.nsec %= 1000000000;
-				m_queueCondition.timed_wait( l, xt );
+			case WindowCommand::createWindow:
+				myCreateWindow( command.window );
+				break;
+			case WindowCommand::addMouseCallback:
+				myAddMouseCallback( command.window, command.pComponent );
+				break;
+			case WindowCommand::addTrackbar:
+				myAddTrackbar( command );
+				break;
+			case WindowCommand::imageReady:
+				// a window emptied by takeImage() can be announced again while the ring is drained
+				if ( !m_windows[ command.window ].bReady )
+				{
+					m_windows[ command.window ].bReady = true;
+					readyWindows.push_back( command.window );
+				}
+				break;
 			}
+		}
+
+		// take the newest image of every announced window once, so a window is shown at most once per batch
+		std::vector< PendingImage > images;
+		for ( std::size_t i = 0; i < readyWindows.size(); i++ )
+		{
+			takeImage( readyWindows[ i ], images );
+			m_windows[ readyWindows[ i ] ].bReady = false;
+		}
 
-			// comment of this change (CW@2013-05-24):
-			// previously there was one highgui function executed
-			// with cvWaitKey(10) after each call. -> lead to a huge
-			// delay when dealing with multiple images/windows at the same time. 
-			// therefore I changed to many calls (until pileline is empty) 
-			// and calling then cvWaitkey, hope that helps and works in common
-			// cases with one camera as well.
-			while ( !m_queue.empty() )
+		// report dropped images at most once per second
+		Measurement::Timestamp now = Measurement::now();
+		if ( now > m_lastDropReport + 1000000000LL )
+		{
+			m_lastDropReport = now;
+			int nWindows = m_nRegistered.load( boost::memory_order_acquire );
+			for ( int id = 0; id < nWindows; id++ )
 			{
-				nextCall = m_queue.front();
-				m_queue.pop_front();
-				if ( nextCall ) 
-					nextCall();
+				Window& window = m_windows[ id ];
+				unsigned long nReceived, nDropped;
+				window.slot.counts( nReceived, nDropped );
+				if ( nDropped != window.nDropsLogged )
+				{
+					LOG4CPP_INFO( logger, "Window \"" << window.name << "\" dropped " << nDropped - window.nDropsLogged 
+						<< " images (" << nDropped << " total), the display cannot keep up" );
+					window.nDropsLogged = nDropped;
+				}
 			}
 		}
-		
-		int nKey = cvWaitKey( 5 );
 
-		// let the opencv message dispatching do something		
-#ifndef _WIN32 // added from CW@2013-05-24: since this necessary on linux only, we dont do it on windows
-		if ( m_nWindows ) 
+		if ( m_lastStatisticsReport == 0 )
+			m_lastStatisticsReport = now;
+		else if ( now > m_lastStatisticsReport + 5000000000LL )
+			reportStatistics( now );
+
+		showImages( images );
+		
+		// dispatch window events after showing images, or when the interval has elapsed
+		int nKey = -1;
+		now = Measurement::now();
+		if ( m_nWindows && ( !images.empty() || now >= nextDispatch ) )
 		{
-			// ATTENTION: has to be at least 2, otherwise highgui does not process any events on Linux. This
-			// has to do with the timed_wait() call above (Pete, 2010-08-17)
-			nKey = cvWaitKey( 2 );
+			nKey = cvWaitKey( dispatchDelay );
+			nextDispatch = now + m_uiInterval * 1000000LL;
 		}
-#endif
-		
+		else if ( now >= nextDispatch )
+			nextDispatch = now + m_uiInterval * 1000000LL;
+
 		// when a button is pushed, signal a button event
 		if ( nKey != -1 )
 		{
@@ -346,9 +1459,17 @@ void HighguiWindowModule::threadProc()
 		}
 	}
 
-	cvWaitKey( 2 );
-	cvDestroyAllWindows();
-	cvWaitKey( 2 );
+	// finish the recordings, a restart opens new ones
+	for ( int id = 0; id < m_nRegistered.load( boost::memory_order_acquire ); id++ )
+		m_windows[ id ].state.pRecorder.reset();
+
+	// headless nodes may not have a display that highgui could talk to
+	if ( m_nWindows )
+	{
+		cvWaitKey( 2 );
+		cvDestroyAllWindows();
+		cvWaitKey( 2 );
+	}
 }
 
 
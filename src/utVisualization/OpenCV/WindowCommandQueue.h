@@ -0,0 +1,308 @@
+/*
+ * Ubitrack - Library for Ubiquitous Tracking
+ * Copyright 2006, Technische Universitaet Muenchen, and individual
+ * contributors as indicated by the @authors tag. See the
+ * copyright.txt in the distribution for a full listing of individual
+ * contributors.
+ *
+ * This is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this software; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA, or see the FSF site: http://www.fsf.org.
+ */
+
+/**
+ * @file
+ * Hand-off between the threads pushing images into HighguiWindow components and the window thread.
+ * Only depends on boost, so that tools can benchmark it without a display.
+ */
+
+#ifndef __WindowCommandQueue_h_INCLUDED__
+#define __WindowCommandQueue_h_INCLUDED__
+
+#include <string>
+#include <cstddef>
+#include <boost/atomic.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/locks.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/thread_time.hpp>
+
+namespace Ubitrack { namespace Drivers {
+
+class HighguiWindow;
+
+
+/** a request to the window thread, windows are referred to by the id from HighguiWindowModule::createWindow() */
+struct WindowCommand
+{
+	enum Type { createWindow, addMouseCallback, addTrackbar, imageReady };
+
+	WindowCommand( Type _type = imageReady, int _window = -1, HighguiWindow* _pComponent = 0 )
+		: type( _type )
+		, window( _window )
+		, pComponent( _pComponent )
+		, pValue( 0 )
+		, maxValue( 0 )
+		, pTrackbarName( 0 )
+	{}
+
+	Type type;
+	int window;
+	HighguiWindow* pComponent;
+
+	/** trackbar parameters, owned by the component */
+	int* pValue;
+	unsigned maxValue;
+	const std::string* pTrackbarName;
+};
+
+
+/**
+ * Preallocated ring of commands for many producers and a single consumer.
+ * Every cell carries a sequence number that tells producers and the consumer whose turn it is,
+ * so pushing costs one compare-and-swap and nothing is allocated.
+ */
+class CommandRing
+{
+public:
+	enum { capacity = 1024 };
+
+	CommandRing()
+		: m_enqueuePos( 0 )
+		, m_dequeuePos( 0 )
+	{
+		for ( std::size_t i = 0; i < capacity; i++ )
+			m_cells[ i ].sequence.store( i, boost::memory_order_relaxed );
+	}
+
+	/** adds a command, returns false if the ring is full */
+	bool push( const WindowCommand& command )
+	{
+		std::size_t pos = m_enqueuePos.load( boost::memory_order_relaxed );
+		Cell* pCell;
+		while ( true )
+		{
+			pCell = &m_cells[ pos % capacity ];
+			std::ptrdiff_t diff = static_cast< std::ptrdiff_t >( pCell->sequence.load( boost::memory_order_acquire ) )
+				- static_cast< std::ptrdiff_t >( pos );
+			if ( diff == 0 )
+			{
+				if ( m_enqueuePos.compare_exchange_weak( pos, pos + 1, boost::memory_order_relaxed ) )
+					break;
+			}
+			else if ( diff < 0 )
+				return false;
+			else
+				pos = m_enqueuePos.load( boost::memory_order_relaxed );
+		}
+
+		pCell->command = command;
+		pCell->sequence.store( pos + 1, boost::memory_order_release );
+		return true;
+	}
+
+	/** takes the oldest command, only called by the consumer */
+	bool pop( WindowCommand& command )
+	{
+		Cell& cell = m_cells[ m_dequeuePos % capacity ];
+		if ( cell.sequence.load( boost::memory_order_acquire ) != m_dequeuePos + 1 )
+			return false;
+
+		command = cell.command;
+		cell.sequence.store( m_dequeuePos + capacity, boost::memory_order_release );
+		m_dequeuePos++;
+		return true;
+	}
+
+	/** only called by the consumer */
+	bool empty() const
+	{ return m_cells[ m_dequeuePos % capacity ].sequence.load( boost::memory_order_acquire ) != m_dequeuePos + 1; }
+
+protected:
+	struct Cell
+	{
+		boost::atomic< std::size_t > sequence;
+		WindowCommand command;
+	};
+
+	Cell m_cells[ capacity ];
+
+	// producers and consumer positions on separate cache lines
+	char m_padding1[ 64 ];
+	boost::atomic< std::size_t > m_enqueuePos;
+	char m_padding2[ 64 ];
+	std::size_t m_dequeuePos;
+};
+
+
+/**
+ * Commands to a single consumer thread that sleeps while there are none.
+ * Producers only take the mutex to wake a sleeping consumer.
+ */
+class CommandQueue
+{
+public:
+	CommandQueue()
+		: m_bSleeping( false )
+	{}
+
+	/** queues a command and wakes the consumer if it sleeps */
+	void push( const WindowCommand& command )
+	{
+		// the ring has room for all commands the windows can have pending at the same time
+		while ( !m_ring.push( command ) )
+			boost::this_thread::yield();
+
+		// together with the fence in wait() either this thread sees the sleeper or the sleeper sees the command
+		boost::atomic_thread_fence( boost::memory_order_seq_cst );
+		if ( m_bSleeping.load( boost::memory_order_relaxed ) )
+		{
+			boost::mutex::scoped_lock l( m_mutex );
+			m_condition.notify_all();
+		}
+	}
+
+	/** takes the oldest command, only called by the consumer */
+	bool pop( WindowCommand& command )
+	{ return m_ring.pop( command ); }
+
+	/**
+	 * sleeps until a command arrives, the flag is signalled or the timeout has elapsed, only called by the consumer
+	 * @param bFlag e.g. the stop flag of the consumer, set through signal()
+	 * @param timeout in microseconds
+	 */
+	void wait( const bool& bFlag, long long timeout )
+	{
+		boost::system_time deadline = boost::get_system_time() + boost::posix_time::microseconds( timeout );
+		boost::mutex::scoped_lock l( m_mutex );
+		m_bSleeping.store( true, boost::memory_order_relaxed );
+		boost::atomic_thread_fence( boost::memory_order_seq_cst );
+		while ( m_ring.empty() && !bFlag )
+			if ( !m_condition.timed_wait( l, deadline ) )
+				break;
+		m_bSleeping.store( false, boost::memory_order_relaxed );
+	}
+
+	/** sets a flag the consumer checks in wait() and wakes it */
+	void signal( bool& bFlag )
+	{
+		boost::mutex::scoped_lock l( m_mutex );
+		bFlag = true;
+		m_condition.notify_all();
+	}
+
+protected:
+	CommandRing m_ring;
+
+	// protects the sleep of the consumer, so that push() cannot miss it
+	boost::mutex m_mutex;
+	boost::condition_variable m_condition;
+
+	// set while the consumer sleeps or is about to
+	boost::atomic< bool > m_bSleeping;
+};
+
+
+/** lock for very short critical sections, yields instead of sleeping */
+class SpinLock
+{
+public:
+	SpinLock()
+		: m_bLocked( false )
+	{}
+
+	void lock()
+	{
+		while ( m_bLocked.exchange( true, boost::memory_order_acquire ) )
+			boost::this_thread::yield();
+	}
+
+	void unlock()
+	{ m_bLocked.store( false, boost::memory_order_release ); }
+
+protected:
+	boost::atomic< bool > m_bLocked;
+};
+
+
+/**
+ * Latest image of a window. Images are not queued, so a slow display cannot lag behind.
+ * Pushing threads only contend with other threads pushing into the same slot.
+ */
+template< class T >
+class LatestSlot
+{
+public:
+	LatestSlot()
+		: m_time( 0 )
+		, m_nReceived( 0 )
+		, m_nDropped( 0 )
+	{}
+
+	/**
+	 * stores a new value, a value that has not been taken yet is replaced and counted as dropped
+	 * @param time timestamp of the value (Measurement::Timestamp)
+	 * @return true if the slot was empty, then the consumer has to be told about the value
+	 */
+	bool put( const boost::shared_ptr< T >& pValue, unsigned long long time )
+	{
+		// the replaced value is released after unlocking
+		boost::shared_ptr< T > pReplaced( pValue );
+		bool bEmpty;
+		{
+			boost::lock_guard< SpinLock > l( m_lock );
+			bEmpty = !m_pValue;
+			if ( !bEmpty )
+				m_nDropped++;
+			m_nReceived++;
+			pReplaced.swap( m_pValue );
+			m_time = time;
+		}
+		return bEmpty;
+	}
+
+	/** takes the value out of the slot, returns false if it is empty */
+	bool take( boost::shared_ptr< T >& pValue, unsigned long long& time )
+	{
+		boost::shared_ptr< T > pTaken;
+		{
+			boost::lock_guard< SpinLock > l( m_lock );
+			pTaken.swap( m_pValue );
+			time = m_time;
+		}
+		pValue.swap( pTaken );
+		return pValue.get() != 0;
+	}
+
+	/** number of values received and dropped so far */
+	void counts( unsigned long& nReceived, unsigned long& nDropped )
+	{
+		boost::lock_guard< SpinLock > l( m_lock );
+		nReceived = m_nReceived;
+		nDropped = m_nDropped;
+	}
+
+protected:
+	SpinLock m_lock;
+	boost::shared_ptr< T > m_pValue;
+	unsigned long long m_time;
+	unsigned long m_nReceived;
+	unsigned long m_nDropped;
+};
+
+} } // namespace Ubitrack::Drivers
+
+#endif
@@ -21,7 +21,12 @@
  * 02110-1301 USA, or see the FSF site: http://www.fsf.org.
  */
 
+#ifdef HAVE_GLEW
+	#include "GL/glew.h"
+#endif
+
 #include "BackgroundImage.h"
+#include "Shader.h"
 #include <utVision/OpenCLManager.h>
 #include <utUtil/TracingProvider.h>
 
@@ -34,22 +39,189 @@
 #endif
 #endif
 
+#include <opencv2/imgproc/imgproc.hpp>
 #include <GL/glut.h>
+#include <string.h>
+
+#ifndef GL_CLAMP_TO_EDGE
+	#define GL_CLAMP_TO_EDGE 0x812F
+#endif
+#ifndef GL_LUMINANCE32F_ARB
+	#define GL_LUMINANCE32F_ARB 0x8818
+#endif
 
 namespace Ubitrack { namespace Drivers {
 
+namespace {
+
+/**
+ * Fragment shader decoding raw camera formats that are uploaded byte-wise into a luminance texture.
+ * Texture coordinates are given in texture space, like for the other image formats.
+ */
+const char* g_rawFormatShader =
+	"uniform sampler2D image;\n"
+	"uniform vec2 texSize;\n"    // allocated texture size in texels (bytes)
+	"uniform vec2 dataSize;\n"   // size of the uploaded data in texels (bytes)
+	"uniform vec2 imageSize;\n"  // size of the decoded image in pixels
+	"uniform int rawFormat;\n"   // 0 = YUYV, 1 = UYVY, 2 = NV12, 3 = Bayer
+	"uniform vec2 redPos;\n"     // position of the red pixel in the 2x2 Bayer cell
+	"\n"
+	"float fetch( float x, float y )\n"
+	"{\n"
+	"	vec2 p = clamp( vec2( x, y ), vec2( 0.0 ), dataSize - 1.0 );\n"
+	"	return texture2D( image, ( p + 0.5 ) / texSize ).r;\n"
+	"}\n"
+	"\n"
+	"vec3 yuv2rgb( float y, float u, float v )\n"
+	"{\n"
+	"	u -= 0.5;\n"
+	"	v -= 0.5;\n"
+	"	return clamp( vec3( y + 1.402 * v, y - 0.344 * u - 0.714 * v, y + 1.772 * u ), 0.0, 1.0 );\n"
+	"}\n"
+	"\n"
+	"void main()\n"
+	"{\n"
+	"	vec2 p = min( floor( gl_TexCoord[0].xy * texSize * imageSize / dataSize ), imageSize - 1.0 );\n"
+	"	vec3 rgb;\n"
+	"	if ( rawFormat <= 1 )\n"
+	"	{\n"
+	"		// packed 4:2:2, two pixels share one macropixel of four bytes\n"
+	"		float yOff = rawFormat == 0 ? 0.0 : 1.0;\n"
+	"		float macro = floor( p.x * 0.5 ) * 4.0 + 1.0 - yOff;\n"
+	"		rgb = yuv2rgb( fetch( 2.0 * p.x + yOff, p.y ), fetch( macro, p.y ), fetch( macro + 2.0, p.y ) );\n"
+	"	}\n"
+	"	else if ( rawFormat == 2 )\n"
+	"	{\n"
+	"		// luminance plane followed by an interleaved UV plane of half resolution\n"
+	"		float cx = floor( p.x * 0.5 ) * 2.0;\n"
+	"		float cy = imageSize.y + floor( p.y * 0.5 );\n"
+	"		rgb = yuv2rgb( fetch( p.x, p.y ), fetch( cx, cy ), fetch( cx + 1.0, cy ) );\n"
+	"	}\n"
+	"	else\n"
+	"	{\n"
+	"		// bilinear demosaicing\n"
+	"		vec2 cell = mod( p, 2.0 );\n"
+	"		float c = fetch( p.x, p.y );\n"
+	"		float crossAvg = 0.25 * ( fetch( p.x - 1.0, p.y ) + fetch( p.x + 1.0, p.y ) + fetch( p.x, p.y - 1.0 ) + fetch( p.x, p.y + 1.0 ) );\n"
+	"		float diagAvg = 0.25 * ( fetch( p.x - 1.0, p.y - 1.0 ) + fetch( p.x + 1.0, p.y - 1.0 ) + fetch( p.x - 1.0, p.y + 1.0 ) + fetch( p.x + 1.0, p.y + 1.0 ) );\n"
+	"		float horzAvg = 0.5 * ( fetch( p.x - 1.0, p.y ) + fetch( p.x + 1.0, p.y ) );\n"
+	"		float vertAvg = 0.5 * ( fetch( p.x, p.y - 1.0 ) + fetch( p.x, p.y + 1.0 ) );\n"
+	"		if ( cell == redPos )\n"
+	"			rgb = vec3( c, crossAvg, diagAvg );\n"
+	"		else if ( cell == 1.0 - redPos )\n"
+	"			rgb = vec3( diagAvg, crossAvg, c );\n"
+	"		else if ( cell.y == redPos.y )\n"
+	"			rgb = vec3( horzAvg, c, vertAvg );\n"
+	"		else\n"
+	"			rgb = vec3( vertAvg, c, horzAvg );\n"
+	"	}\n"
+	"	gl_FragColor = vec4( rgb, 1.0 );\n"
+	"}\n";
+
+/**
+ * Fragment shader mapping float depth values to grey levels or the jet colormap.
+ * Invalid measurements (NaN) are shown black.
+ */
+const char* g_depthShader =
+	"uniform sampler2D image;\n"
+	"uniform vec2 depthRange;\n" // near, far
+	"uniform int colormap;\n"    // 0 = grey, 1 = jet
+	"void main()\n"
+	"{\n"
+	"	float z = texture2D( image, gl_TexCoord[0].xy ).r;\n"
+	"	if ( !( z == z ) )\n"
+	"	{\n"
+	"		gl_FragColor = vec4( 0.0, 0.0, 0.0, 1.0 );\n"
+	"		return;\n"
+	"	}\n"
+	"	float d = clamp( ( z - depthRange.x ) / ( depthRange.y - depthRange.x ), 0.0, 1.0 );\n"
+	"	vec3 rgb = vec3( d );\n"
+	"	if ( colormap == 1 )\n"
+	"		rgb = clamp( vec3( 1.5 ) - abs( vec3( 4.0 * d ) - vec3( 3.0, 2.0, 1.0 ) ), 0.0, 1.0 );\n"
+	"	gl_FragColor = vec4( rgb, 1.0 );\n"
+	"}\n";
+
+/** resolution of the undistortion mesh */
+const int g_meshColumns = 32;
+const int g_meshRows = 24;
+
+} // anonymous namespace
+
+
 BackgroundImage::BackgroundImage( const std::string& name, boost::shared_ptr< Graph::UTQLSubgraph > subgraph, 
 	const VirtualObjectKey& componentKey, VirtualCamera* pModule )
 	: VirtualObject( name, subgraph, componentKey, pModule )
+	, m_skippedUploads( 0 )
 	, m_bUseTexture( true )
-	, m_bTextureInitialized( false )
+	, m_rawFormat( rawNone )
+	, m_rawProgram( 0 )
+	, m_bRawProgramFailed( false )
+	, m_depthNear( 0.0 )
+	, m_depthFar( 1.0 )
+	, m_depthColormap( depthGrey )
+	, m_depthProgram( 0 )
+	, m_bDepthProgramFailed( false )
+#ifdef HAVE_OPENCL
+	, m_interopSync( syncUnknown )
+	, m_createEventFromGLsync( 0 )
+	, m_acquireFence( 0 )
+	, m_acquireEvent( 0 )
+#endif
+	, m_undistortVersion( 1 )
 	, m_image0( "Image1", *this, boost::bind( &BackgroundImage::imageIn, this, _1, 0 ))
 	, m_image1( "Image2", *this, boost::bind( &BackgroundImage::imageIn, this, _1, 1 ))
+	, m_intrinsicsPort( "Intrinsics", *this )
+	, m_distortionPort( "Distortion", *this )
 {
 	if ( subgraph->m_DataflowAttributes.getAttributeString( "useTexture" ) == "false" ) 
 	{
 		m_bUseTexture = false;
 	}
+
+	// raw camera formats decoded on the GPU
+	std::string sRawFormat = subgraph->m_DataflowAttributes.getAttributeString( "rawFormat" );
+	if ( sRawFormat == "yuyv" )
+		m_rawFormat = rawYUYV;
+	else if ( sRawFormat == "uyvy" )
+		m_rawFormat = rawUYVY;
+	else if ( sRawFormat == "nv12" )
+		m_rawFormat = rawNV12;
+	else if ( sRawFormat == "bayerRGGB" )
+		m_rawFormat = rawBayerRGGB;
+	else if ( sRawFormat == "bayerGRBG" )
+		m_rawFormat = rawBayerGRBG;
+	else if ( sRawFormat == "bayerGBRG" )
+		m_rawFormat = rawBayerGBRG;
+	else if ( sRawFormat == "bayerBGGR" )
+		m_rawFormat = rawBayerBGGR;
+	else if ( !sRawFormat.empty() && sRawFormat != "none" )
+		UBITRACK_THROW( "Invalid rawFormat attribute: " + sRawFormat );
+
+	if ( m_rawFormat != rawNone && !m_bUseTexture )
+	{
+		LOG4CPP_WARN( logger, "rawFormat requires texture rendering, ignoring useTexture=false" );
+		m_bUseTexture = true;
+	}
+
+	// display range and colormap of float depth images
+	subgraph->m_DataflowAttributes.getAttributeData( "depthNear", m_depthNear );
+	subgraph->m_DataflowAttributes.getAttributeData( "depthFar", m_depthFar );
+	if ( m_depthNear == m_depthFar )
+		UBITRACK_THROW( "depthNear and depthFar must differ" );
+
+	std::string sColormap = subgraph->m_DataflowAttributes.getAttributeString( "depthColormap" );
+	if ( sColormap == "jet" )
+		m_depthColormap = depthJet;
+	else if ( !sColormap.empty() && sColormap != "grey" )
+		UBITRACK_THROW( "Invalid depthColormap attribute: " + sColormap );
+
+	m_imageSequence[0] = m_imageSequence[1] = 0;
+
+	for ( unsigned i = 0; i < 3; i++ )
+		for ( unsigned j = 0; j < 3; j++ )
+			m_undistortIntrinsics( i, j ) = 0;
+	for ( unsigned i = 0; i < 4; i++ )
+		m_undistortCoeffs( i ) = 0;
 }
 
 BackgroundImage::~BackgroundImage()
@@ -61,14 +233,478 @@ BackgroundImage::~BackgroundImage()
 void BackgroundImage::glCleanup()
 {
 	LOG4CPP_DEBUG( logger, "glCleanup() called" );
+	LOG4CPP_INFO( logger, getName() << ": skipped " << m_skippedUploads << " redundant background texture uploads" );
+
+	glBindTexture( GL_TEXTURE_2D, 0 );
+	glDisable( GL_TEXTURE_2D );
+
+#ifdef HAVE_OPENCL
+	releaseAcquireFence();
+#endif
+
+	for ( int i = 0; i < 2; i++ )
+	{
+		if ( !m_texture[ i ].bInitialized )
+			continue;
+
+#ifdef HAVE_OPENCL
+		if ( m_texture[ i ].clImage )
+			clReleaseMemObject( m_texture[ i ].clImage );
+		m_texture[ i ].clImage = 0;
+#endif
+		glDeleteTextures( 1, &m_texture[ i ].texture );
+		m_texture[ i ].bInitialized = false;
+	}
+
+	deleteShaderProgram( m_rawProgram );
+	deleteShaderProgram( m_depthProgram );
+}
+
+
+/** checks whether textures may have arbitrary sizes */
+bool BackgroundImage::nonPowerOfTwoSupported()
+{
+#ifdef HAVE_GLEW
+	return GLEW_VERSION_2_0 || GLEW_ARB_texture_non_power_of_two;
+#else
+	const char* extensions = reinterpret_cast< const char* >( glGetString( GL_EXTENSIONS ) );
+	const char* version = reinterpret_cast< const char* >( glGetString( GL_VERSION ) );
+	return ( version && version[ 0 ] >= '2' ) || ( extensions && strstr( extensions, "GL_ARB_texture_non_power_of_two" ) );
+#endif
+}
+
+
+/** checks whether float textures and shaders are available for displaying depth images */
+bool BackgroundImage::floatTexturesSupported()
+{
+#ifdef HAVE_GLEW
+	return shadersSupported() && ( GLEW_VERSION_3_0 || GLEW_ARB_texture_float );
+#else
+	return false;
+#endif
+}
+
+
+/** (re-)allocates the texture of one image slot */
+void BackgroundImage::initTexture( TextureSlot& slot, int width, int height, GLenum format, int channels, GLenum type )
+{
+	Vision::OpenCLManager& oclManager = Vision::OpenCLManager::singleton();
+
+	if ( !slot.bInitialized )
+	{
+		glGenTextures( 1, &slot.texture );
+		glBindTexture( GL_TEXTURE_2D, slot.texture );
+
+		// define texture parameters
+		glTexParameterf( GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR );
+		glTexParameterf( GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR );
+		glTexParameterf( GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE );
+		glTexParameterf( GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE );
+		glTexEnvf( GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_DECAL );
+		slot.bInitialized = true;
+	}
+	else
+	{
+		glBindTexture( GL_TEXTURE_2D, slot.texture );
+#ifdef HAVE_OPENCL
+		// the shared CL image refers to the old texture storage
+		if ( slot.clImage )
+			clReleaseMemObject( slot.clImage );
+		slot.clImage = 0;
+#endif
+	}
+
+	slot.width = width;
+	slot.height = height;
+	slot.format = format;
+	slot.channels = channels;
+	slot.type = type;
+	slot.uploadedSequence = 0;
+
+	if ( nonPowerOfTwoSupported() )
+	{
+		slot.texWidth = width;
+		slot.texHeight = height;
+	}
+	else
+	{
+		// generate power-of-two sizes
+		slot.texWidth = 1;
+		while ( slot.texWidth < (unsigned)width )
+			slot.texWidth <<= 1;
+
+		slot.texHeight = 1;
+		while ( slot.texHeight < (unsigned)height )
+			slot.texHeight <<= 1;
+	}
+
+	// load empty texture image (defines texture size)
+	glTexImage2D( GL_TEXTURE_2D, 0, channels, slot.texWidth, slot.texHeight, 0, format, type, 0 );
+	LOG4CPP_DEBUG( logger, "glTexImage2D( width=" << slot.texWidth << ", height=" << slot.texHeight << " ): " << glGetError() );
+
+	// float textures are never written by OpenCL
+	if ( oclManager.isInitialized() && type == GL_UNSIGNED_BYTE )
+	{
+#ifdef HAVE_OPENCL
+		//Get an image Object from the OpenGL texture
+		cl_int err;
+// windows specific or opencl version specific ??
+#ifdef WIN32
+		slot.clImage = clCreateFromGLTexture2D( oclManager.getContext(), CL_MEM_WRITE_ONLY, GL_TEXTURE_2D, 0, slot.texture, &err);
+#else
+		slot.clImage = clCreateFromGLTexture( oclManager.getContext(), CL_MEM_WRITE_ONLY, GL_TEXTURE_2D, 0, slot.texture, &err);
+#endif
+		if (err != CL_SUCCESS)
+		{
+			LOG4CPP_ERROR( logger, "error at  clCreateFromGLTexture2D:" << err );
+		}
+#endif
+	}
+}
+
+
+/** computes the size of the decoded image from the uploaded raw data */
+void BackgroundImage::rawImageSize( const TextureSlot& slot, int& width, int& height ) const
+{
+	width = slot.width;
+	height = slot.height;
+	if ( m_rawFormat == rawYUYV || m_rawFormat == rawUYVY )
+		width /= 2;
+	else if ( m_rawFormat == rawNV12 )
+		height = height * 2 / 3;
+}
+
+
+/** activates the raw format decoding shader for the given texture */
+void BackgroundImage::useRawProgram( const TextureSlot& slot )
+{
+#ifdef HAVE_GLEW
+	int imageWidth, imageHeight;
+	rawImageSize( slot, imageWidth, imageHeight );
+
+	int format = 3;
+	float redX = 0;
+	float redY = 0;
+
+	switch ( m_rawFormat )
+	{
+		case rawYUYV: format = 0; break;
+		case rawUYVY: format = 1; break;
+		case rawNV12: format = 2; break;
+		case rawBayerGRBG: redX = 1; break;
+		case rawBayerGBRG: redY = 1; break;
+		case rawBayerBGGR: redX = 1; redY = 1; break;
+		default: break;
+	}
+
+	glUseProgram( m_rawProgram );
+	glUniform1i( glGetUniformLocation( m_rawProgram, "image" ), 0 );
+	glUniform2f( glGetUniformLocation( m_rawProgram, "texSize" ), float( slot.texWidth ), float( slot.texHeight ) );
+	glUniform2f( glGetUniformLocation( m_rawProgram, "dataSize" ), float( slot.width ), float( slot.height ) );
+	glUniform2f( glGetUniformLocation( m_rawProgram, "imageSize" ), float( imageWidth ), float( imageHeight ) );
+	glUniform1i( glGetUniformLocation( m_rawProgram, "rawFormat" ), format );
+	glUniform2f( glGetUniformLocation( m_rawProgram, "redPos" ), redX, redY );
+#endif
+}
+
+
+#ifdef HAVE_OPENCL
+namespace {
+	/** clCreateEventFromGLsyncKHR, an extension function that has to be queried from the platform */
+	typedef cl_event ( CL_API_CALL *CreateEventFromGLsyncFunc )( cl_context, cl_GLsync, cl_int* );
+}
+
+/**
+ * chooses the synchronization supported by the OpenCL device and the GL context.
+ * Only cl_khr_gl_event orders an acquire after the GL commands flushed before it, GL_ARB_cl_event
+ * alone covers only the opposite direction and is therefore used together with it.
+ */
+BackgroundImage::InteropSync BackgroundImage::detectInteropSync( cl_command_queue queue, void*& createEventFromGLsync )
+{
+	cl_device_id device = 0;
+	cl_platform_id platform = 0;
+	size_t size = 0;
+	std::string extensions;
+	if ( clGetCommandQueueInfo( queue, CL_QUEUE_DEVICE, sizeof( device ), &device, 0 ) == CL_SUCCESS &&
+		clGetDeviceInfo( device, CL_DEVICE_EXTENSIONS, 0, 0, &size ) == CL_SUCCESS && size > 0 )
+	{
+		std::vector< char > buffer( size );
+		if ( clGetDeviceInfo( device, CL_DEVICE_EXTENSIONS, size, &buffer[ 0 ], 0 ) == CL_SUCCESS )
+			extensions.assign( &buffer[ 0 ] );
+		clGetDeviceInfo( device, CL_DEVICE_PLATFORM, sizeof( platform ), &platform, 0 );
+	}
+
+	if ( extensions.find( "cl_khr_gl_event" ) == std::string::npos )
+		return syncFinish;
+
+#ifdef HAVE_GLEW
+	if ( GLEW_ARB_cl_event && platform )
+	{
+		createEventFromGLsync = clGetExtensionFunctionAddressForPlatform( platform, "clCreateEventFromGLsyncKHR" );
+		if ( createEventFromGLsync )
+			return syncEvent;
+	}
+#endif
+	return syncImplicit;
+}
+
+
+void BackgroundImage::releaseAcquireFence()
+{
+	if ( m_acquireEvent )
+	{
+		// usually completed long ago, the fence must stay valid until then
+		clWaitForEvents( 1, &m_acquireEvent );
+		clReleaseEvent( m_acquireEvent );
+		m_acquireEvent = 0;
+	}
+#ifdef HAVE_GLEW
+	if ( m_acquireFence )
+		glDeleteSync( static_cast< GLsync >( m_acquireFence ) );
+#endif
+	m_acquireFence = 0;
+}
+
+
+/** copies the (converted) GPU image into the texture of a slot, using OpenCV's command queue only */
+void BackgroundImage::uploadFromOpenCL( TextureSlot& slot )
+{
+	// the color conversion was enqueued on OpenCV's default queue, so using the same in-order
+	// queue for the interop commands orders them without any cv::ocl::finish()
+	cl_command_queue queue = (cl_command_queue)cv::ocl::Queue::getDefault().ptr();
+	if ( m_interopSync == syncUnknown )
+	{
+		m_interopSync = detectInteropSync( queue, m_createEventFromGLsync );
+		LOG4CPP_INFO( logger, "OpenCL/OpenGL texture synchronization: " << ( m_interopSync == syncEvent ? "cl_khr_gl_event and GL_ARB_cl_event events" :
+			m_interopSync == syncImplicit ? "cl_khr_gl_event" : "glFinish/clFinish" ) );
+	}
+
+	// GL must be done with the texture before OpenCL acquires it
+	releaseAcquireFence();
+	if ( m_interopSync == syncFinish )
+		glFinish();
+#ifdef HAVE_GLEW
+	else if ( m_interopSync == syncEvent )
+	{
+		GLsync fence = glFenceSync( GL_SYNC_GPU_COMMANDS_COMPLETE, 0 );
+		glFlush();
+
+		cl_context context = 0;
+		cl_int fenceErr = CL_INVALID_VALUE;
+		clGetCommandQueueInfo( queue, CL_QUEUE_CONTEXT, sizeof( context ), &context, 0 );
+		if ( fence )
+			m_acquireEvent = reinterpret_cast< CreateEventFromGLsyncFunc >( m_createEventFromGLsync )( 
+				context, reinterpret_cast< cl_GLsync >( fence ), &fenceErr );
+		if ( fenceErr == CL_SUCCESS )
+			m_acquireFence = fence;
+		else
+		{
+			// the implicit synchronization of cl_khr_gl_event still applies after the flush
+			LOG4CPP_DEBUG( logger, "clCreateEventFromGLsyncKHR failed: " << fenceErr );
+			m_acquireEvent = 0;
+			if ( fence )
+				glDeleteSync( fence );
+		}
+	}
+#endif
+	else
+		glFlush();
+
+	cl_int err = clEnqueueAcquireGLObjects( queue, 1, &slot.clImage, m_acquireEvent ? 1 : 0, 
+		m_acquireEvent ? &m_acquireEvent : NULL, NULL );
+	if ( err != CL_SUCCESS )
+	{
+		LOG4CPP_ERROR( logger, "error at  clEnqueueAcquireGLObjects:" << err );
+	}
+
+	cl_mem clBuffer = (cl_mem) m_convertedImage.handle( cv::ACCESS_READ );
+	size_t offset = 0;
+	size_t dst_origin[3] = {0, 0, 0};
+	size_t region[3] = {static_cast<size_t>(m_convertedImage.cols), static_cast<size_t>(m_convertedImage.rows), 1};
+
+	err = clEnqueueCopyBufferToImage( queue, clBuffer, slot.clImage, offset, dst_origin, region, 0, NULL, NULL );
+	if ( err != CL_SUCCESS )
+	{
+		LOG4CPP_ERROR( logger, "error at  clEnqueueCopyBufferToImage:" << err );
+	}
+
+	cl_event released = 0;
+	err = clEnqueueReleaseGLObjects( queue, 1, &slot.clImage, 0, NULL, m_interopSync == syncEvent ? &released : NULL );
+	if ( err != CL_SUCCESS )
+	{
+		LOG4CPP_ERROR( logger, "error at  clEnqueueReleaseGLObjects:" << err );
+	}
+
+	if ( m_interopSync == syncFinish )
+		clFinish( queue );
+	else
+		clFlush( queue );
+
+	// make GL wait for the copy before sampling the texture
+	if ( released )
+	{
+#ifdef HAVE_GLEW
+		cl_context context = 0;
+		clGetCommandQueueInfo( queue, CL_QUEUE_CONTEXT, sizeof( context ), &context, 0 );
+		GLsync sync = glCreateSyncFromCLeventARB( context, released, 0 );
+		if ( sync )
+		{
+			glWaitSync( sync, 0, GL_TIMEOUT_IGNORED );
+			glDeleteSync( sync );
+		}
+		else
+		{
+			clWaitForEvents( 1, &released );
+		}
+#endif
+		clReleaseEvent( released );
+	}
+}
+#endif // HAVE_OPENCL
+
 
-	if ( m_bTextureInitialized ) {
- 		glBindTexture( GL_TEXTURE_2D, 0 );
- 		glDisable( GL_TEXTURE_2D );
- 		glDeleteTextures( 1, &m_texture );
- 	}
+/** activates the depth mapping shader */
+void BackgroundImage::useDepthProgram()
+{
+#ifdef HAVE_GLEW
+	glUseProgram( m_depthProgram );
+	glUniform1i( glGetUniformLocation( m_depthProgram, "image" ), 0 );
+	glUniform2f( glGetUniformLocation( m_depthProgram, "depthRange" ), float( m_depthNear ), float( m_depthFar ) );
+	glUniform1i( glGetUniformLocation( m_depthProgram, "colormap" ), m_depthColormap == depthJet ? 1 : 0 );
+#endif
 }
 
+
+/** maps float depth images to 8-bit on the CPU, if no float textures are available */
+const cv::Mat& BackgroundImage::convertDepthImage( int num )
+{
+	const cv::Mat& depth = m_background[ num ]->Mat();
+
+	// the buffers are only reallocated if the image size changes
+	double scale = 255.0 / ( m_depthFar - m_depthNear );
+	depth.convertTo( m_depthDisplay[ num ], CV_8U, scale, -m_depthNear * scale );
+	cv::compare( depth, depth, m_depthMask[ num ], cv::CMP_NE );
+
+	cv::Mat* pResult = &m_depthDisplay[ num ];
+	if ( m_depthColormap == depthJet )
+	{
+		cv::applyColorMap( m_depthDisplay[ num ], m_depthColor[ num ], cv::COLORMAP_JET );
+		cv::cvtColor( m_depthColor[ num ], m_depthColor[ num ], cv::COLOR_BGR2RGB );
+		pResult = &m_depthColor[ num ];
+	}
+
+	// invalid measurements (NaN) are shown black
+	pResult->setTo( cv::Scalar::all( 0 ), m_depthMask[ num ] );
+	return *pResult;
+}
+
+
+/** stores new undistortion parameters, invalidating the meshes if they have changed */
+void BackgroundImage::setUndistortion( const Math::Matrix< double, 3, 3 >& intrinsics, const Math::Vector< double, 4 >& distortion )
+{
+	bool bChanged = false;
+	for ( unsigned i = 0; i < 3; i++ )
+		for ( unsigned j = 0; j < 3; j++ )
+			bChanged |= m_undistortIntrinsics( i, j ) != intrinsics( i, j );
+	for ( unsigned i = 0; i < 4; i++ )
+		bChanged |= m_undistortCoeffs( i ) != distortion( i );
+
+	if ( bChanged )
+	{
+		m_undistortIntrinsics = intrinsics;
+		m_undistortCoeffs = distortion;
+		m_undistortVersion++;
+		LOG4CPP_DEBUG( logger, "New undistortion parameters: " << distortion );
+	}
+}
+
+
+/** returns the undistortion mesh of a slot, recomputing it if the parameters, the image size or origin have changed */
+const std::vector< float >& BackgroundImage::undistortionMesh( int num, int width, int height, int origin )
+{
+	UndistortionMesh& mesh = m_undistortMesh[ num ];
+	if ( mesh.version == m_undistortVersion && mesh.width == width && mesh.height == height && mesh.origin == origin )
+		return mesh.texCoords;
+
+	mesh.version = m_undistortVersion;
+	mesh.width = width;
+	mesh.height = height;
+	mesh.origin = origin;
+	mesh.texCoords.resize( 2 * ( g_meshColumns + 1 ) * ( g_meshRows + 1 ) );
+
+	// compensate for left-handed OpenCV coordinate frame, as in the Undistortion component
+	Math::Matrix< double, 3, 3 > k( m_undistortIntrinsics );
+	for ( unsigned i = 0; i < 3; i++ )
+		k( i, 2 ) *= -1;
+
+	// the mesh rows follow the image rows in memory, which start at the top for origin 0
+	if ( !origin )
+	{
+		k( 1, 2 ) = height - 1 - k( 1, 2 );
+		k( 0, 1 ) *= -1.0;
+	}
+
+	const double fx = k( 0, 0 );
+	const double fy = k( 1, 1 );
+	const double skew = k( 0, 1 );
+	const double cx = k( 0, 2 );
+	const double cy = k( 1, 2 );
+	const double k1 = m_undistortCoeffs( 0 );
+	const double k2 = m_undistortCoeffs( 1 );
+	const double p1 = m_undistortCoeffs( 2 );
+	const double p2 = m_undistortCoeffs( 3 );
+
+	// each vertex shows the undistorted pixel at its position, so look up where it is in the distorted image
+	for ( int j = 0; j <= g_meshRows; j++ )
+		for ( int i = 0; i <= g_meshColumns; i++ )
+		{
+			double v = double( j ) / g_meshRows * height;
+			double u = double( i ) / g_meshColumns * width;
+
+			double y = ( v - cy ) / fy;
+			double x = ( u - cx - skew * y ) / fx;
+			double r2 = x * x + y * y;
+			double radial = 1.0 + k1 * r2 + k2 * r2 * r2;
+			double xd = x * radial + 2.0 * p1 * x * y + p2 * ( r2 + 2.0 * x * x );
+			double yd = y * radial + p1 * ( r2 + 2.0 * y * y ) + 2.0 * p2 * x * y;
+
+			float* c = &mesh.texCoords[ 2 * ( j * ( g_meshColumns + 1 ) + i ) ];
+			c[ 0 ] = float( ( fx * xd + skew * yd + cx ) / width );
+			c[ 1 ] = float( ( fy * yd + cy ) / height );
+		}
+
+	LOG4CPP_DEBUG( logger, "Computed undistortion mesh for slot " << num << " (" << width << "x" << height << ")" );
+	return mesh.texCoords;
+}
+
+
+BackgroundImage::UndistortionMesh::UndistortionMesh()
+	: version( 0 )
+	, width( 0 )
+	, height( 0 )
+	, origin( 0 )
+{
+}
+
+
+BackgroundImage::TextureSlot::TextureSlot()
+	: bInitialized( false )
+	, texture( 0 )
+	, width( 0 )
+	, height( 0 )
+	, format( 0 )
+	, channels( 0 )
+	, type( GL_UNSIGNED_BYTE )
+	, texWidth( 0 )
+	, texHeight( 0 )
+	, uploadedSequence( 0 )
+#ifdef HAVE_OPENCL
+	, clImage( 0 )
+#endif
+{
+}
+
+
 /** render the object */
 void BackgroundImage::draw( Measurement::Timestamp& t, int num )
 {
@@ -102,6 +738,21 @@ void BackgroundImage::draw( Measurement::Timestamp& t, int num )
 	if ( m_background[num].get() == 0 ) return;
 	
 
+	// fetch the camera parameters for undistortion before touching any GL state
+	bool bUndistort = false;
+	if ( m_intrinsicsPort.isConnected() && m_distortionPort.isConnected() )
+	{
+		try
+		{
+			setUndistortion( *m_intrinsicsPort.get( t ), *m_distortionPort.get( t ) );
+			bUndistort = true;
+		}
+		catch ( const Util::Exception& e )
+		{
+			LOG4CPP_WARN( logger, "Cannot undistort background image: " << e );
+		}
+	}
+
 	int m_width  = m_pModule->m_width;
 	int m_height = m_pModule->m_height;
 
@@ -170,7 +821,90 @@ void BackgroundImage::draw( Measurement::Timestamp& t, int num )
 			break;
 	}
 
-	if ( !m_bUseTexture )
+	// float images (e.g. depth maps) are mapped to colors by a shader or converted on the CPU
+	bool bFloatImage = m_background[ num ]->depth() == IPL_DEPTH_32F;
+	bool bRawImage = m_rawFormat != rawNone && !bFloatImage;
+	bool bDepthShader = false;
+	bool bConvertDepth = false;
+	GLenum dataType = GL_UNSIGNED_BYTE;
+	const cv::Mat* pConverted = 0;
+
+	if ( bFloatImage )
+	{
+		// the OpenCL path only handles 8 bit images
+		image_isOnGPU = false;
+		umatConvertCode = -1;
+
+		if ( !m_depthProgram && !m_bDepthProgramFailed )
+		{
+			if ( floatTexturesSupported() )
+				m_depthProgram = compileShaderProgram( 0, g_depthShader );
+			m_bDepthProgramFailed = !m_depthProgram;
+			if ( m_bDepthProgramFailed )
+				LOG4CPP_INFO( logger, "No float texture support, converting depth images on the CPU" );
+		}
+
+		if ( m_depthProgram && ( m_bUseTexture || bUndistort ) )
+		{
+			bDepthShader = true;
+			imgFormat = GL_LUMINANCE;
+			numOfChannels = GL_LUMINANCE32F_ARB;
+			dataType = GL_FLOAT;
+		}
+		else
+		{
+			// converted by convertDepthImage() only when the image is actually drawn or uploaded
+			bConvertDepth = true;
+			numOfChannels = m_depthColormap == depthJet ? 3 : 1;
+			imgFormat = numOfChannels == 3 ? GL_RGB : GL_LUMINANCE;
+		}
+	}
+
+	// size of the data that is uploaded into the texture
+	int dataWidth = m_background[ num ]->width();
+	int dataHeight = m_background[ num ]->height();
+	int dataRowLength = 0;
+
+	if ( bDepthShader )
+	{
+		const cv::Mat& depth = m_background[ num ]->Mat();
+		if ( depth.step != depth.cols * depth.elemSize() )
+			dataRowLength = int( depth.step / depth.elemSize() );
+	}
+
+	if ( bRawImage )
+	{
+		// raw formats are uploaded byte by byte and converted by the fragment shader
+		if ( !m_rawProgram && !m_bRawProgramFailed )
+		{
+			m_rawProgram = compileShaderProgram( 0, g_rawFormatShader );
+			m_bRawProgramFailed = !m_rawProgram;
+		}
+		if ( !m_rawProgram )
+		{
+			glPopMatrix();
+			glMatrixMode( GL_MODELVIEW );
+			glEnable( GL_BLEND );
+			glEnable( GL_DEPTH_TEST );
+			if ( bLightingEnabled )
+				glEnable( GL_LIGHTING );
+			return;
+		}
+
+		// the OpenCL path cannot write to luminance textures
+		image_isOnGPU = false;
+		imgFormat = GL_LUMINANCE;
+		numOfChannels = 1;
+		umatConvertCode = -1;
+
+		const cv::Mat& raw = m_background[ num ]->Mat();
+		dataWidth = int( raw.cols * raw.elemSize() );
+		dataHeight = raw.rows;
+		if ( int( raw.step ) != dataWidth )
+			dataRowLength = int( raw.step );
+	}
+
+	if ( !m_bUseTexture && !bUndistort )
 	{
 		// glDrawPixels version
 		glDisable( GL_TEXTURE_2D );
@@ -188,65 +922,41 @@ void BackgroundImage::draw( Measurement::Timestamp& t, int num )
 				-((float)m_height/(float)m_background[num]->height())*1.0000001f
 			);
 		}
-		glDrawPixels( m_background[num]->width(), m_background[num]->height(), imgFormat, GL_UNSIGNED_BYTE, m_background[num]->Mat().data );
+		if ( bConvertDepth )
+			pConverted = &convertDepthImage( num );
+		glDrawPixels( m_background[num]->width(), m_background[num]->height(), imgFormat, GL_UNSIGNED_BYTE,
+			pConverted ? pConverted->data : m_background[num]->Mat().data );
 	}
 	else
 	{
 		glEnable(GL_TEXTURE_2D);
-		if ( !m_bTextureInitialized )
-		{
-			
-			m_bTextureInitialized = true;
-			
-			// generate power-of-two sizes
-			m_pow2Width = 1;
-			while ( m_pow2Width < (unsigned)m_background[ num ]->width() )
-				m_pow2Width <<= 1;
-
-			m_pow2Height = 1;
-			while ( m_pow2Height < (unsigned)m_background[ num ]->height() )
-				m_pow2Height <<= 1;
-
-			glGenTextures( 1, &m_texture );
-			glBindTexture( GL_TEXTURE_2D, m_texture );
-		
-			// define texture parameters
-			glTexParameterf( GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR );
-			glTexParameterf( GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR );
-			glTexEnvf( GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_DECAL );
-		
-			// load empty texture image (defines texture size)
-			glTexImage2D( GL_TEXTURE_2D, 0, numOfChannels, m_pow2Width, m_pow2Height, 0, imgFormat, GL_UNSIGNED_BYTE, 0 );
-			LOG4CPP_DEBUG( logger, "glTexImage2D( width=" << m_pow2Width << ", height=" << m_pow2Height << " ): " << glGetError() );
-		
-			LOG4CPP_INFO( logger, "initalized texture ( " << imgFormat << " ) GPU? " << image_isOnGPU);
-
-
-            if (oclManager.isInitialized()) {
-
-#ifdef HAVE_OPENCL
-                //Get an image Object from the OpenGL texture
-                cl_int err;
-// windows specific or opencl version specific ??
-#ifdef WIN32
-                m_clImage = clCreateFromGLTexture2D( oclManager.getContext(), CL_MEM_WRITE_ONLY, GL_TEXTURE_2D, 0, m_texture, &err);
-#else
-                m_clImage = clCreateFromGLTexture( oclManager.getContext(), CL_MEM_WRITE_ONLY, GL_TEXTURE_2D, 0, m_texture, &err);
-#endif
-                if (err != CL_SUCCESS)
-                {
-                    LOG4CPP_ERROR( logger, "error at  clCreateFromGLTexture2D:" << err );
-                }
-#endif
-            }
 
+		// (re-)allocate the texture of this slot if the image size or format has changed
+		TextureSlot& slot = m_texture[ num ];
+		if ( !slot.bInitialized || slot.width != dataWidth || slot.height != dataHeight ||
+			slot.format != imgFormat || slot.channels != numOfChannels || slot.type != dataType )
+		{
+			initTexture( slot, dataWidth, dataHeight, imgFormat, numOfChannels, dataType );
+			LOG4CPP_INFO( logger, "initalized texture for slot " << num << " ( " << imgFormat << " ) GPU? " << image_isOnGPU);
 
+			// raw data must not be interpolated before decoding, nor depth values with invalid measurements
+			GLint filter = bRawImage || bDepthShader ? GL_NEAREST : GL_LINEAR;
+			glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, filter );
+			glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, filter );
 		}
 
-        if (image_isOnGPU) {
+		// only upload if the texture does not already hold this frame, e.g. on pose-triggered
+		// redraws, the keep-alive redraw or the second pass of single-image stereo
+		bool bUploadNeeded = slot.uploadedSequence != m_imageSequence[ num ];
+		if ( !bUploadNeeded )
+		{
+			m_skippedUploads++;
+			LOG4CPP_TRACE( logger, "texture already holds frame " << m_imageSequence[ num ] << " of slot " << num << ", skipping upload" );
+		}
+        else if (image_isOnGPU) {
 #ifdef HAVE_OPENCL
 
-			glBindTexture( GL_TEXTURE_2D, m_texture );
+			glBindTexture( GL_TEXTURE_2D, slot.texture );
 
             if (umatConvertCode != -1) {
 				cv::cvtColor(m_background[num]->uMat(), m_convertedImage, umatConvertCode );
@@ -254,39 +964,7 @@ void BackgroundImage::draw( Measurement::Timestamp& t, int num )
                 m_convertedImage = m_background[num]->uMat();
             }
 
-			cv::ocl::finish();
-			glFinish();
-
-            cl_command_queue commandQueue = oclManager.getCommandQueue();
-            cl_int err;
-
-			clFinish(commandQueue);
-
-            err = clEnqueueAcquireGLObjects(commandQueue, 1, &m_clImage, 0, NULL, NULL);
-            if(err != CL_SUCCESS)
-            {
-                LOG4CPP_ERROR( logger, "error at  clEnqueueAcquireGLObjects:" << err );
-            }
-
-			cl_mem clBuffer = (cl_mem) m_convertedImage.handle(cv::ACCESS_READ);
-			cl_command_queue cv_ocl_queue = (cl_command_queue)cv::ocl::Queue::getDefault().ptr();
-
-            size_t offset = 0;
-            size_t dst_origin[3] = {0, 0, 0};
-            size_t region[3] = {static_cast<size_t>(m_convertedImage.cols), static_cast<size_t>(m_convertedImage.rows), 1};
-
-            err = clEnqueueCopyBufferToImage(cv_ocl_queue, clBuffer, m_clImage, offset, dst_origin, region, 0, NULL, NULL);
-            if (err != CL_SUCCESS)
-            {
-                LOG4CPP_ERROR( logger, "error at  clEnqueueCopyBufferToImage:" << err );
-            }
-
-            err = clEnqueueReleaseGLObjects(commandQueue, 1, &m_clImage, 0, NULL, NULL);
-            if(err != CL_SUCCESS)
-            {
-                LOG4CPP_ERROR( logger, "error at  clEnqueueReleaseGLObjects:" << err );
-            }
-			cv::ocl::finish();
+			uploadFromOpenCL( slot );
 
 
 #else // HAVE_OPENCL
@@ -294,33 +972,79 @@ void BackgroundImage::draw( Measurement::Timestamp& t, int num )
 #endif // HAVE_OPENCL
         } else {
             // load image from CPU buffer into texture
-            glBindTexture( GL_TEXTURE_2D, m_texture );
-            glTexSubImage2D( GL_TEXTURE_2D, 0, 0, 0, m_background[ num ]->width(), m_background[ num ]->height(),
-                    imgFormat, GL_UNSIGNED_BYTE, m_background[ num ]->Mat().data );
+            if ( bConvertDepth )
+                pConverted = &convertDepthImage( num );
+            glBindTexture( GL_TEXTURE_2D, slot.texture );
+            if ( dataRowLength )
+                glPixelStorei( GL_UNPACK_ROW_LENGTH, dataRowLength );
+            glTexSubImage2D( GL_TEXTURE_2D, 0, 0, 0, dataWidth, dataHeight,
+                    imgFormat, dataType, pConverted ? pConverted->data : m_background[ num ]->Mat().data );
+            if ( dataRowLength )
+                glPixelStorei( GL_UNPACK_ROW_LENGTH, 0 );
 
         }
 
+		if ( bUploadNeeded )
+		{
+			slot.uploadedSequence = m_imageSequence[ num ];
+
 #ifdef ENABLE_EVENT_TRACING
-		TRACEPOINT_MEASUREMENT_RECEIVE(getEventDomain(), m_background[num].time(), getName().c_str(), "TextureUpdated")
+			TRACEPOINT_MEASUREMENT_RECEIVE(getEventDomain(), m_background[num].time(), getName().c_str(), "TextureUpdated")
 #endif
+		}
 
-		glBindTexture(GL_TEXTURE_2D, m_texture);
+		glBindTexture(GL_TEXTURE_2D, slot.texture);
 
 		glTexEnvf( GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_REPLACE );
 
 		// display textured rectangle
 		double y0 = m_background[ num ]->origin() ? 0 : m_height;
 		double y1 = m_height - y0;
-		double tx = double( m_background[ num ]->width() ) / m_pow2Width;
-		double ty = double( m_background[ num ]->height() ) / m_pow2Height;
+		double tx = double( slot.width ) / slot.texWidth;
+		double ty = double( slot.height ) / slot.texHeight;
+
+		if ( bRawImage )
+			useRawProgram( slot );
+		else if ( bDepthShader )
+			useDepthProgram();
 
-		// draw two triangles
-		glBegin( GL_TRIANGLE_STRIP );
-		glTexCoord2d(  0, ty ); glVertex2d(       0, y1 );
-		glTexCoord2d(  0,  0 ); glVertex2d(       0, y0 );
-		glTexCoord2d( tx, ty ); glVertex2d( m_width, y1 );
-		glTexCoord2d( tx,  0 ); glVertex2d( m_width, y0 );
-		glEnd();
+		if ( bUndistort )
+		{
+			// draw the image warped by the precomputed undistortion mesh
+			int imageWidth = m_background[ num ]->width();
+			int imageHeight = m_background[ num ]->height();
+			if ( bRawImage )
+				rawImageSize( slot, imageWidth, imageHeight );
+
+			const std::vector< float >& mesh = undistortionMesh( num, imageWidth, imageHeight, m_background[ num ]->origin() );
+			for ( int j = 0; j < g_meshRows; j++ )
+			{
+				glBegin( GL_TRIANGLE_STRIP );
+				for ( int i = 0; i <= g_meshColumns; i++ )
+					for ( int k = j; k <= j + 1; k++ )
+					{
+						const float* c = &mesh[ 2 * ( k * ( g_meshColumns + 1 ) + i ) ];
+						glTexCoord2d( c[ 0 ] * tx, c[ 1 ] * ty );
+						glVertex2d( double( i ) / g_meshColumns * m_width, y0 + double( k ) / g_meshRows * ( y1 - y0 ) );
+					}
+				glEnd();
+			}
+		}
+		else
+		{
+			// draw two triangles
+			glBegin( GL_TRIANGLE_STRIP );
+			glTexCoord2d(  0, ty ); glVertex2d(       0, y1 );
+			glTexCoord2d(  0,  0 ); glVertex2d(       0, y0 );
+			glTexCoord2d( tx, ty ); glVertex2d( m_width, y1 );
+			glTexCoord2d( tx,  0 ); glVertex2d( m_width, y0 );
+			glEnd();
+		}
+
+#ifdef HAVE_GLEW
+		if ( bRawImage || bDepthShader )
+			glUseProgram( 0 );
+#endif
 
 		glBindTexture(GL_TEXTURE_2D, 0);
  
@@ -329,6 +1053,7 @@ void BackgroundImage::draw( Measurement::Timestamp& t, int num )
 	
 	// change timestamp to image time
 	t = m_background[num].time();
+	m_lastUpdateTime = t;
 	
 	// restore opengl state
 	glEnable( GL_BLEND );
@@ -351,23 +1076,9 @@ void BackgroundImage::imageIn( const Ubitrack::Measurement::ImageMeasurement& im
 	LOG4CPP_DEBUG( logger, "received background image with timestamp " << img.time() );
 	boost::mutex::scoped_lock l( m_imageLock[num] );
 
-	if(img->depth() == IPL_DEPTH_32F){
-        // @todo should this computation be moved to the rendering thread ?
-        // also this does assume the image is on CPU !!!
-		boost::shared_ptr<Ubitrack::Vision::Image> p(new Ubitrack::Vision::Image(img->width(), img->height(), 1, IPL_DEPTH_8U ));
-		float* depthData = (float*) img->Mat().data;
-		unsigned char* up =(unsigned char*) p->Mat().data;
-		LOG4CPP_INFO(logger, "copy data");
-		for(unsigned int i=0;i<img->width()*img->height();i++)
-			if(depthData[i] != depthData[i])
-				up[i] = 0;
-			else 
-				up[i] = depthData[i]*255;
-		
-		m_background[num] = Ubitrack::Measurement::ImageMeasurement(img.time(), p);
-	} else {
-		m_background[num] = img;
-	}
+	// float (depth) images are converted for display in the render thread
+	m_background[num] = img;
+	m_imageSequence[num]++;
 	m_pModule->invalidate( this );
 }
 
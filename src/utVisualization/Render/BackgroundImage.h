@@ -28,6 +28,8 @@
 #include <utUtil/CleanWindows.h>
  #endif
 
+#include <vector>
+
 #include "RenderModule.h"
 #include <utVision/Image.h>
 #ifdef HAVE_OPENCL
@@ -45,6 +47,20 @@ namespace Ubitrack { namespace Drivers {
  * @ingroup driver_components
  * Component for planar background images.
  * Provides two push-in ports for images.
+ *
+ * Packed YUV 4:2:2 (YUYV/UYVY), NV12 and Bayer images can be displayed without CPU conversion
+ * by setting the \c rawFormat attribute. The raw bytes are then uploaded into a luminance
+ * texture and converted to RGB in a fragment shader, which requires GLEW and OpenGL 2.0.
+ *
+ * 32 bit float images (e.g. from depth cameras) are uploaded into a float texture and mapped
+ * to colors by a fragment shader, using the \c depthNear, \c depthFar and \c depthColormap
+ * attributes. Without float texture support, the conversion is done on the CPU in the render
+ * thread, using buffers that are reused across frames.
+ *
+ * If the optional "Intrinsics" (3x3 matrix) and "Distortion" (4-vector k1, k2, p1, p2) pull ports
+ * are connected, the image is undistorted while drawing by rendering it through a mesh whose
+ * texture coordinates are looked up in the distorted image. The mesh is only recomputed when the
+ * camera parameters or the image size change.
  */
 class BackgroundImage
 	: public VirtualObject
@@ -84,23 +100,150 @@ protected:
 	Ubitrack::Measurement::ImageMeasurement m_background[2];
 	boost::mutex m_imageLock[2];
 
+	/** sequence number of the last image received on each slot, 0 = none yet */
+	unsigned long m_imageSequence[2];
+
+	/** number of texture uploads skipped because the texture was already up to date */
+	unsigned long m_skippedUploads;
+
+	/** OpenGL texture holding the image of one slot */
+	struct TextureSlot
+	{
+		TextureSlot();
+
+		bool bInitialized;
+		GLuint texture;
+
+		/** image size and format the texture was allocated for */
+		int width, height;
+		GLenum format;
+		int channels;
+		GLenum type;
+
+		/** allocated texture size, only padded if non-power-of-two textures are unsupported */
+		unsigned texWidth, texHeight;
+
+		/** sequence number of the image currently held by the texture, 0 = none */
+		unsigned long uploadedSequence;
+
+#ifdef HAVE_OPENCL
+		cl_mem clImage;
+#endif
+	};
+
+	/** (re-)allocates the texture of one image slot */
+	void initTexture( TextureSlot& slot, int width, int height, GLenum format, int channels, GLenum type );
+
+	/** checks whether textures may have arbitrary sizes */
+	static bool nonPowerOfTwoSupported();
+
+	/** checks whether float textures and shaders are available for displaying depth images */
+	static bool floatTexturesSupported();
+
+	/** computes the size of the decoded image from the uploaded raw data */
+	void rawImageSize( const TextureSlot& slot, int& width, int& height ) const;
+
+	/** activates the raw format decoding shader for the given texture */
+	void useRawProgram( const TextureSlot& slot );
+
 	// variables for textured drawing
 	bool m_bUseTexture;
-	bool m_bTextureInitialized;
-	GLuint m_texture;
+	TextureSlot m_texture[2];
+
+	/** raw camera formats that are converted to RGB by a fragment shader */
+	enum RawFormat { rawNone, rawYUYV, rawUYVY, rawNV12, rawBayerRGGB, rawBayerGRBG, rawBayerGBRG, rawBayerBGGR } m_rawFormat;
+	GLuint m_rawProgram;
+	bool m_bRawProgramFailed;
+
+	/** maps float depth images to 8-bit on the CPU, if no float textures are available */
+	const cv::Mat& convertDepthImage( int num );
+
+	/** activates the depth mapping shader */
+	void useDepthProgram();
+
+	/** depth range mapped to black..white (or the colormap) */
+	double m_depthNear;
+	double m_depthFar;
+
+	/** colormap applied to float depth images */
+	enum DepthColormap { depthGrey, depthJet } m_depthColormap;
+	GLuint m_depthProgram;
+	bool m_bDepthProgramFailed;
+
+	/** reused buffers of the CPU depth conversion, per slot */
+	cv::Mat m_depthDisplay[2];
+	cv::Mat m_depthMask[2];
+	cv::Mat m_depthColor[2];
 
 #ifdef HAVE_OPENCL
 	//OpenCL
-	cl_mem m_clImage;
 	cv::UMat m_convertedImage;
+
+	/** how texture writes by OpenCL are synchronized with OpenGL */
+	enum InteropSync
+	{
+		/** not determined yet */
+		syncUnknown,
+		/** glFinish before acquiring, clFinish after releasing */
+		syncFinish,
+		/** implicit synchronization of cl_khr_gl_event, glFlush before acquiring */
+		syncImplicit,
+		/**
+		 * explicit events in both directions: the acquire waits on an event created from a GL fence
+		 * (cl_khr_gl_event), GL waits on a sync object created from the release event (GL_ARB_cl_event)
+		 */
+		syncEvent
+	} m_interopSync;
+
+	/** clCreateEventFromGLsyncKHR of the platform, for syncEvent */
+	void* m_createEventFromGLsync;
+
+	/** GL fence (GLsync) and the OpenCL event the last acquire waited on, kept until the event completed */
+	void* m_acquireFence;
+	cl_event m_acquireEvent;
+
+	/** chooses the synchronization supported by the OpenCL device and the GL context, without glFinish if possible */
+	static InteropSync detectInteropSync( cl_command_queue queue, void*& createEventFromGLsync );
+
+	/** deletes the fence and event of the last acquire, waiting for the event if it is still pending */
+	void releaseAcquireFence();
+
+	/** copies the (converted) GPU image into the texture of a slot, using OpenCV's command queue only */
+	void uploadFromOpenCL( TextureSlot& slot );
 #endif
 
-	unsigned m_pow2Width;
-	unsigned m_pow2Height;
+	/** texture coordinates of the undistortion mesh of one image slot */
+	struct UndistortionMesh
+	{
+		UndistortionMesh();
+
+		/** parameter version, image size and origin the mesh was computed for */
+		unsigned long version;
+		int width, height;
+		int origin;
+
+		/** texture coordinates per vertex, relative to the image size */
+		std::vector< float > texCoords;
+	};
+
+	/** stores new undistortion parameters, invalidating the meshes if they have changed */
+	void setUndistortion( const Math::Matrix< double, 3, 3 >& intrinsics, const Math::Vector< double, 4 >& distortion );
+
+	/** returns the undistortion mesh of a slot, recomputing it if the parameters or the image size have changed */
+	const std::vector< float >& undistortionMesh( int num, int width, int height, int origin );
+
+	Math::Matrix< double, 3, 3 > m_undistortIntrinsics;
+	Math::Vector< double, 4 > m_undistortCoeffs;
+	unsigned long m_undistortVersion;
+	UndistortionMesh m_undistortMesh[2];
 
 	Ubitrack::Dataflow::PushConsumer< Ubitrack::Measurement::ImageMeasurement > m_image0;
 	Ubitrack::Dataflow::PushConsumer< Ubitrack::Measurement::ImageMeasurement > m_image1;
 
+	/** optional camera parameters for undistorting the background image */
+	Ubitrack::Dataflow::PullConsumer< Ubitrack::Measurement::Matrix3x3 > m_intrinsicsPort;
+	Ubitrack::Dataflow::PullConsumer< Ubitrack::Measurement::Vector4D > m_distortionPort;
+
 
 };
 
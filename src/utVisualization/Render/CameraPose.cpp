@@ -43,6 +43,13 @@ void CameraPose::draw( Measurement::Timestamp& t, int parity )
 	glMatrixMode( GL_MODELVIEW );
 	boost::mutex::scoped_lock l( m_poseLock );
 	glMultMatrixd( m_pose );
+	m_drawnPose = m_measurement;
+}
+
+Measurement::Pose CameraPose::drawnPose()
+{
+	boost::mutex::scoped_lock l( m_poseLock );
+	return m_drawnPose;
 }
 
 bool CameraPose::hasWaitingEvents()
@@ -64,6 +71,7 @@ void CameraPose::poseIn( const Ubitrack::Measurement::Pose& pose, int redraw )
 
 	boost::mutex::scoped_lock l( m_poseLock );
 	for ( int i = 0; i < 16; i++ ) m_pose[i] = tmp[i];
+	m_measurement = pose;
 
 	// the camera pose has changed, so redraw the world
 	if (redraw) {
@@ -54,6 +54,13 @@ public:
 
 	virtual bool hasWaitingEvents();
 
+	/** the pose used by the last draw(), empty before the first one */
+	Measurement::Pose drawnPose();
+
+	/** may be replayed for the second eye with single-pass stereo */
+	virtual bool isEyeIndependent()
+	{ return true; }
+
 protected:
 
 	void poseIn( const Ubitrack::Measurement::Pose& pose, int redraw );
@@ -63,6 +70,10 @@ protected:
 	PullConsumer< Ubitrack::Measurement::Pose > m_pull;
 
 	double m_pose[16];
+
+	/** the measurement m_pose was computed from and the one used by the last draw() */
+	Measurement::Pose m_measurement;
+	Measurement::Pose m_drawnPose;
 	boost::mutex m_poseLock;
 };
 
@@ -61,6 +61,10 @@ public:
 	/** check whether there are events waiting in the queue */
 	virtual bool hasWaitingEvents();
 
+	/** may be replayed for the second eye with single-pass stereo */
+	virtual bool isEyeIndependent()
+	{ return true; }
+
 protected:
 	boost::mutex m_positionLock;
 	Ubitrack::Measurement::Position2D m_crossPosition;
@@ -0,0 +1,77 @@
+/*
+ * Ubitrack - Library for Ubiquitous Tracking
+ * Copyright 2006, Technische Universitaet Muenchen, and individual
+ * contributors as indicated by the @authors tag. See the
+ * copyright.txt in the distribution for a full listing of individual
+ * contributors.
+ *
+ * This is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this software; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA, or see the FSF site: http://www.fsf.org.
+ */
+
+/**
+ * @file
+ * Conversion of window depth to the distance to the image plane, shared by the
+ * ZBufferOutput component and its test
+ */
+
+#ifndef __DepthProjection_h_INCLUDED__
+#define __DepthProjection_h_INCLUDED__
+
+namespace Ubitrack { namespace Drivers {
+
+/**
+ * coefficients mapping normalized device depth z to eye space depth
+ * ( p23 - z * p33 ) / ( z * p32 - p22 ), taken from the projection matrix
+ */
+struct DepthProjection
+{
+	float p22, p23, p32, p33;
+
+	/**
+	 * takes the coefficients from a projection matrix, a matrix without depth information
+	 * is replaced by a perspective one with the given near and far planes
+	 * @param m column major, as returned for GL_PROJECTION_MATRIX
+	 */
+	static DepthProjection fromMatrix( const double* m, double zNear, double zFar )
+	{
+		DepthProjection p;
+		p.p22 = static_cast< float >( m[ 10 ] );
+		p.p23 = static_cast< float >( m[ 14 ] );
+		p.p32 = static_cast< float >( m[ 11 ] );
+		p.p33 = static_cast< float >( m[ 15 ] );
+
+		// no depth information in the projection, assume a perspective one
+		if ( p.p22 == 0.0f && p.p32 == 0.0f )
+		{
+			p.p22 = static_cast< float >( -( zFar + zNear ) / ( zFar - zNear ) );
+			p.p23 = static_cast< float >( -2.0 * zFar * zNear / ( zFar - zNear ) );
+			p.p32 = -1.0f;
+			p.p33 = 0.0f;
+		}
+		return p;
+	}
+
+	/** distance to the image plane for a window depth in [0, 1], 0 for the far plane, like the shader of ZBufferOutput */
+	float distance( float depth ) const
+	{
+		float z = 2.0f * depth - 1.0f;
+		return depth < 1.0f ? -( p23 - z * p33 ) / ( z * p32 - p22 ) : 0.0f;
+	}
+};
+
+} } // namespace Ubitrack::Drivers
+
+#endif
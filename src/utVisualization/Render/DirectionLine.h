@@ -54,6 +54,10 @@ public:
 
 	virtual bool hasWaitingEvents();
 
+	/** may be replayed for the second eye with single-pass stereo */
+	virtual bool isEyeIndependent()
+	{ return true; }
+
 protected:
 
 	/// target position push input
@@ -0,0 +1,346 @@
+/*
+ * Ubitrack - Library for Ubiquitous Tracking
+ * Copyright 2006, Technische Universitaet Muenchen, and individual
+ * contributors as indicated by the @authors tag. See the
+ * copyright.txt in the distribution for a full listing of individual
+ * contributors.
+ *
+ * This is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this software; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA, or see the FSF site: http://www.fsf.org.
+ */
+
+/**
+ * @file
+ * Implementation of the instanced ellipsoid rendering
+ */
+
+#ifdef HAVE_GLEW
+	#include "GL/glew.h"
+#endif
+
+#include <cmath>
+#include <cstddef>
+#include "EllipsoidBatch.h"
+#include "Shader.h"
+
+namespace Ubitrack { namespace Drivers {
+
+namespace {
+
+/** tessellation of the unit sphere, as previously used with gluSphere */
+const int g_sphereSlices = 20;
+const int g_sphereStacks = 10;
+
+/**
+ * Unit sphere with positions (which are also the normals) and triangle indices.
+ * Shared by all batches, only the GL buffers are per batch.
+ */
+struct SphereMesh
+{
+	SphereMesh()
+	{
+		const double pi = 3.14159265358979;
+		for ( int stack = 0; stack <= g_sphereStacks; stack++ )
+		{
+			double theta = pi * stack / g_sphereStacks;
+			for ( int slice = 0; slice <= g_sphereSlices; slice++ )
+			{
+				double phi = 2.0 * pi * slice / g_sphereSlices;
+				vertices.push_back( float( std::sin( theta ) * std::cos( phi ) ) );
+				vertices.push_back( float( std::sin( theta ) * std::sin( phi ) ) );
+				vertices.push_back( float( std::cos( theta ) ) );
+			}
+		}
+
+		// counter-clockwise seen from outside
+		for ( int stack = 0; stack < g_sphereStacks; stack++ )
+			for ( int slice = 0; slice < g_sphereSlices; slice++ )
+			{
+				GLuint a = stack * ( g_sphereSlices + 1 ) + slice;
+				GLuint b = a + g_sphereSlices + 1;
+				indices.push_back( a ); indices.push_back( b ); indices.push_back( a + 1 );
+				indices.push_back( a + 1 ); indices.push_back( b ); indices.push_back( b + 1 );
+			}
+	}
+
+	std::vector< float > vertices;
+	std::vector< GLuint > indices;
+};
+
+const SphereMesh& sphereMesh()
+{
+	static SphereMesh mesh;
+	return mesh;
+}
+
+/**
+ * Places the unit sphere per instance and applies the lighting of the render module
+ * (light 0 with colour material) if lighting is enabled.
+ */
+const char* g_ellipsoidVertexShader =
+	"#version 120\n"
+	"attribute vec3 vertex;\n"
+	"attribute vec3 axis0;\n"
+	"attribute vec3 axis1;\n"
+	"attribute vec3 axis2;\n"
+	"attribute vec3 center;\n"
+	"attribute vec3 radii;\n"
+	"attribute vec4 instanceColor;\n"
+	"uniform bool lighting;\n"
+	"varying vec4 color;\n"
+	"void main()\n"
+	"{\n"
+	"	mat3 rotation = mat3( axis0, axis1, axis2 );\n"
+	"	gl_Position = gl_ModelViewProjectionMatrix * vec4( center + rotation * ( radii * vertex ), 1.0 );\n"
+	"	color = instanceColor;\n"
+	"	if ( lighting )\n"
+	"	{\n"
+	"		vec3 n = normalize( gl_NormalMatrix * ( rotation * ( vertex / max( radii, vec3( 1e-12 ) ) ) ) );\n"
+	"		vec3 l = normalize( gl_LightSource[ 0 ].position.xyz );\n"
+	"		vec3 light = gl_LightModel.ambient.rgb + gl_LightSource[ 0 ].ambient.rgb\n"
+	"			+ gl_LightSource[ 0 ].diffuse.rgb * max( dot( n, l ), 0.0 );\n"
+	"		color.rgb *= light;\n"
+	"	}\n"
+	"}\n";
+
+const char* g_ellipsoidFragmentShader =
+	"varying vec4 color;\n"
+	"void main()\n"
+	"{\n"
+	"	gl_FragColor = color;\n"
+	"}\n";
+
+/** instance attributes: name, number of floats, offset in Instance */
+struct InstanceAttribute
+{
+	const char* name;
+	GLint size;
+	std::size_t offset;
+};
+
+} // anonymous namespace
+
+
+EllipsoidBatch::EllipsoidBatch()
+	: m_program( 0 )
+	, m_meshBuffer( 0 )
+	, m_indexBuffer( 0 )
+	, m_instanceBuffer( 0 )
+	, m_bInstancingChecked( false )
+	, m_bInstancing( false )
+	, m_bCoreInstancing( false )
+{
+}
+
+
+void EllipsoidBatch::clear()
+{
+	m_instances.clear();
+}
+
+
+void EllipsoidBatch::add( const ErrorEllipsoid& ellipsoid, float r, float g, float b, float a )
+{
+	Instance instance;
+	for ( int i = 0; i < 3; i++ )
+	{
+		for ( int j = 0; j < 3; j++ )
+			instance.axes[ 3 * j + i ] = float( ellipsoid.rotation()( i, j ) );
+		instance.center[ i ] = float( ellipsoid.position()( i ) );
+		instance.radii[ i ] = float( ellipsoid.sizes()( i ) );
+	}
+	instance.color[ 0 ] = r;
+	instance.color[ 1 ] = g;
+	instance.color[ 2 ] = b;
+	instance.color[ 3 ] = a;
+	m_instances.push_back( instance );
+}
+
+
+void EllipsoidBatch::draw()
+{
+	if ( m_instances.empty() )
+		return;
+
+	if ( !m_bInstancingChecked )
+	{
+		m_bInstancingChecked = true;
+		m_bInstancing = initInstancing();
+		if ( !m_bInstancing )
+			LOG4CPP_INFO( logger, "Instanced arrays not available, drawing error ellipsoids one by one" );
+	}
+
+	// instanced draws cannot be compiled into the display lists of single-pass stereo
+	GLint list = 0;
+	glGetIntegerv( GL_LIST_INDEX, &list );
+
+	if ( m_bInstancing && !list )
+		drawInstanced();
+	else
+		drawFallback();
+}
+
+
+bool EllipsoidBatch::initInstancing()
+{
+#ifdef HAVE_GLEW
+	if ( !shadersSupported() || !( GLEW_VERSION_3_3 || ( GLEW_ARB_instanced_arrays && GLEW_ARB_draw_instanced ) ) )
+		return false;
+
+	// the ARB entry points may be missing in contexts that only provide the core functions
+	m_bCoreInstancing = GLEW_VERSION_3_3 != 0;
+
+	m_program = compileShaderProgram( g_ellipsoidVertexShader, g_ellipsoidFragmentShader );
+	if ( !m_program )
+		return false;
+
+	const SphereMesh& mesh( sphereMesh() );
+	glGenBuffers( 1, &m_meshBuffer );
+	glBindBuffer( GL_ARRAY_BUFFER, m_meshBuffer );
+	glBufferData( GL_ARRAY_BUFFER, mesh.vertices.size() * sizeof( float ), &mesh.vertices[ 0 ], GL_STATIC_DRAW );
+
+	glGenBuffers( 1, &m_indexBuffer );
+	glBindBuffer( GL_ELEMENT_ARRAY_BUFFER, m_indexBuffer );
+	glBufferData( GL_ELEMENT_ARRAY_BUFFER, mesh.indices.size() * sizeof( GLuint ), &mesh.indices[ 0 ], GL_STATIC_DRAW );
+
+	glGenBuffers( 1, &m_instanceBuffer );
+
+	glBindBuffer( GL_ARRAY_BUFFER, 0 );
+	glBindBuffer( GL_ELEMENT_ARRAY_BUFFER, 0 );
+	return true;
+#else
+	return false;
+#endif
+}
+
+
+void EllipsoidBatch::drawInstanced()
+{
+#ifdef HAVE_GLEW
+	static const InstanceAttribute attributes[] = {
+		{ "axis0", 3, offsetof( Instance, axes ) },
+		{ "axis1", 3, offsetof( Instance, axes ) + 3 * sizeof( float ) },
+		{ "axis2", 3, offsetof( Instance, axes ) + 6 * sizeof( float ) },
+		{ "center", 3, offsetof( Instance, center ) },
+		{ "radii", 3, offsetof( Instance, radii ) },
+		{ "instanceColor", 4, offsetof( Instance, color ) }
+	};
+	const int nAttributes = sizeof( attributes ) / sizeof( attributes[ 0 ] );
+
+	glUseProgram( m_program );
+	glUniform1i( glGetUniformLocation( m_program, "lighting" ), glIsEnabled( GL_LIGHTING ) );
+
+	// the instance data changes every frame, orphan the old buffer
+	glBindBuffer( GL_ARRAY_BUFFER, m_instanceBuffer );
+	glBufferData( GL_ARRAY_BUFFER, m_instances.size() * sizeof( Instance ), &m_instances[ 0 ], GL_STREAM_DRAW );
+
+	GLint locations[ nAttributes ];
+	for ( int i = 0; i < nAttributes; i++ )
+	{
+		locations[ i ] = glGetAttribLocation( m_program, attributes[ i ].name );
+		if ( locations[ i ] < 0 )
+			continue;
+		glEnableVertexAttribArray( locations[ i ] );
+		glVertexAttribPointer( locations[ i ], attributes[ i ].size, GL_FLOAT, GL_FALSE, sizeof( Instance ), 
+			reinterpret_cast< const GLvoid* >( attributes[ i ].offset ) );
+		if ( m_bCoreInstancing )
+			glVertexAttribDivisor( locations[ i ], 1 );
+		else
+			glVertexAttribDivisorARB( locations[ i ], 1 );
+	}
+
+	GLint vertexLocation = glGetAttribLocation( m_program, "vertex" );
+	glBindBuffer( GL_ARRAY_BUFFER, m_meshBuffer );
+	glEnableVertexAttribArray( vertexLocation );
+	glVertexAttribPointer( vertexLocation, 3, GL_FLOAT, GL_FALSE, 0, 0 );
+
+	glBindBuffer( GL_ELEMENT_ARRAY_BUFFER, m_indexBuffer );
+	GLsizei nIndices = GLsizei( sphereMesh().indices.size() );
+	if ( m_bCoreInstancing )
+		glDrawElementsInstanced( GL_TRIANGLES, nIndices, GL_UNSIGNED_INT, 0, GLsizei( m_instances.size() ) );
+	else
+		glDrawElementsInstancedARB( GL_TRIANGLES, nIndices, GL_UNSIGNED_INT, 0, GLsizei( m_instances.size() ) );
+
+	// leave the attribute state clean for the fixed-function components
+	glDisableVertexAttribArray( vertexLocation );
+	for ( int i = 0; i < nAttributes; i++ )
+		if ( locations[ i ] >= 0 )
+		{
+			if ( m_bCoreInstancing )
+				glVertexAttribDivisor( locations[ i ], 0 );
+			else
+				glVertexAttribDivisorARB( locations[ i ], 0 );
+			glDisableVertexAttribArray( locations[ i ] );
+		}
+
+	glBindBuffer( GL_ELEMENT_ARRAY_BUFFER, 0 );
+	glBindBuffer( GL_ARRAY_BUFFER, 0 );
+	glUseProgram( 0 );
+#endif
+}
+
+
+void EllipsoidBatch::drawFallback()
+{
+	const SphereMesh& mesh( sphereMesh() );
+
+	// the vertices of the unit sphere are also its normals
+	glPushAttrib( GL_ENABLE_BIT );
+	glEnable( GL_NORMALIZE );
+	glPushClientAttrib( GL_CLIENT_VERTEX_ARRAY_BIT );
+	glEnableClientState( GL_VERTEX_ARRAY );
+	glEnableClientState( GL_NORMAL_ARRAY );
+	glVertexPointer( 3, GL_FLOAT, 0, &mesh.vertices[ 0 ] );
+	glNormalPointer( GL_FLOAT, 0, &mesh.vertices[ 0 ] );
+
+	glMatrixMode( GL_MODELVIEW );
+	for ( std::vector< Instance >::const_iterator it = m_instances.begin(); it != m_instances.end(); it++ )
+	{
+		GLfloat m[ 16 ] = {
+			it->axes[ 0 ] * it->radii[ 0 ], it->axes[ 1 ] * it->radii[ 0 ], it->axes[ 2 ] * it->radii[ 0 ], 0,
+			it->axes[ 3 ] * it->radii[ 1 ], it->axes[ 4 ] * it->radii[ 1 ], it->axes[ 5 ] * it->radii[ 1 ], 0,
+			it->axes[ 6 ] * it->radii[ 2 ], it->axes[ 7 ] * it->radii[ 2 ], it->axes[ 8 ] * it->radii[ 2 ], 0,
+			it->center[ 0 ], it->center[ 1 ], it->center[ 2 ], 1 };
+
+		glPushMatrix();
+		glMultMatrixf( m );
+		glColor4fv( it->color );
+		glDrawElements( GL_TRIANGLES, GLsizei( mesh.indices.size() ), GL_UNSIGNED_INT, &mesh.indices[ 0 ] );
+		glPopMatrix();
+	}
+
+	glPopClientAttrib();
+	glPopAttrib();
+}
+
+
+void EllipsoidBatch::glCleanup()
+{
+#ifdef HAVE_GLEW
+	deleteShaderProgram( m_program );
+	if ( m_meshBuffer )
+		glDeleteBuffers( 1, &m_meshBuffer );
+	if ( m_indexBuffer )
+		glDeleteBuffers( 1, &m_indexBuffer );
+	if ( m_instanceBuffer )
+		glDeleteBuffers( 1, &m_instanceBuffer );
+	m_meshBuffer = m_indexBuffer = m_instanceBuffer = 0;
+#endif
+	m_bInstancingChecked = false;
+	m_bInstancing = false;
+	m_bCoreInstancing = false;
+}
+
+} } // namespace Ubitrack::Drivers
@@ -0,0 +1,102 @@
+/*
+ * Ubitrack - Library for Ubiquitous Tracking
+ * Copyright 2006, Technische Universitaet Muenchen, and individual
+ * contributors as indicated by the @authors tag. See the
+ * copyright.txt in the distribution for a full listing of individual
+ * contributors.
+ *
+ * This is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this software; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA, or see the FSF site: http://www.fsf.org.
+ */
+
+/**
+ * @file
+ * Instanced rendering of error ellipsoids
+ */
+
+#ifndef __EllipsoidBatch_h_INCLUDED__
+#define __EllipsoidBatch_h_INCLUDED__
+
+#include <vector>
+#include "ErrorEllipsoid.h"
+
+namespace Ubitrack { namespace Drivers {
+
+/**
+ * Collects error ellipsoids and draws them with a single instanced draw call of a shared
+ * sphere mesh, with per-instance transformation and colour.
+ * Without GLSL and instanced arrays, or while a display list is compiled, the mesh is drawn once
+ * per ellipsoid from a vertex array.
+ * All drawing methods must be called on the GL thread. The GL objects are not deleted by the
+ * destructor, call glCleanup() from the component's glCleanup() instead.
+ */
+class EllipsoidBatch
+{
+public:
+
+	EllipsoidBatch();
+
+	/** removes all ellipsoids */
+	void clear();
+
+	/** adds an ellipsoid with the given colour */
+	void add( const ErrorEllipsoid& ellipsoid, float r, float g, float b, float a = 1.0f );
+
+	/** number of ellipsoids in the batch */
+	std::size_t size() const
+	{ return m_instances.size(); }
+
+	/** draws all ellipsoids in the current model-view coordinate frame */
+	void draw();
+
+	/** deletes the GL objects */
+	void glCleanup();
+
+protected:
+
+	/** per-instance data, also the layout of the instance buffer */
+	struct Instance
+	{
+		float axes[ 9 ];
+		float center[ 3 ];
+		float radii[ 3 ];
+		float color[ 4 ];
+	};
+
+	/** compiles the program and creates the buffers, false if instancing is not available */
+	bool initInstancing();
+
+	/** draws one instanced call */
+	void drawInstanced();
+
+	/** draws the mesh once per instance with fixed-function transformations */
+	void drawFallback();
+
+	std::vector< Instance > m_instances;
+
+	GLuint m_program;
+	GLuint m_meshBuffer;
+	GLuint m_indexBuffer;
+	GLuint m_instanceBuffer;
+	bool m_bInstancingChecked;
+	bool m_bInstancing;
+
+	/** whether the OpenGL 3.3 entry points are used instead of the ARB ones */
+	bool m_bCoreInstancing;
+};
+
+} } // namespace Ubitrack::Drivers
+
+#endif
@@ -29,19 +29,16 @@
  */
 
 #include "ErrorEllipsoid.h"
-
-#ifdef HAVE_LAPACK
+#include "SymmetricEigen.h"
 
 #include <math.h>
-#include <boost/numeric/ublas/matrix_proxy.hpp>
-#include <boost/numeric/bindings/lapack/syev.hpp>
+#include <algorithm>
 #include <log4cpp/Category.hh>
 
 //static log4cpp::Category& logger( log4cpp::Category::getInstance( "Render.PoseErrorVisualization" ) );
 
 using namespace Ubitrack::Math;
 namespace ublas = boost::numeric::ublas;
-namespace lapack = boost::numeric::bindings::lapack;
 
 
 namespace Ubitrack { namespace Drivers {
@@ -49,49 +46,49 @@ namespace Ubitrack { namespace Drivers {
 ErrorEllipsoid::ErrorEllipsoid( const Math::Vector< double, 3 >& position, double scaling )
 	: m_position( position )
 	, m_scaling( scaling )
+	, m_sizes( 0, 0, 0 )
 	, m_rotation( ublas::identity_matrix< double >( 4, 4 ) )
 {
-	m_pQuadric = gluNewQuadric();
-}
-
-
-ErrorEllipsoid::~ErrorEllipsoid()
-{
-	gluDeleteQuadric( m_pQuadric );
 }
 
 
-void ErrorEllipsoid::draw()
+void ErrorEllipsoid::setCovariance( const Math::Matrix< double, 3, 3 >& covariance )
 {
-	// set transformation
-	//glMatrixMode( GL_MODELVIEW );
-	glPushMatrix();
-	glTranslated( m_position( 0 ), m_position( 1 ), m_position( 2 ) );
-	glMultMatrixd( m_rotation.content() );
-	glScaled( m_sizes( 0 ), m_sizes( 1 ), m_sizes( 2 ) );
-
-	// draw sphere
-	gluSphere( m_pQuadric, 1.0, 20, 10 );
-
-	glPopMatrix();
+	ErrorEllipsoid* pThis = this;
+	setCovariances( &pThis, &covariance, 1 );
 }
 
 
-void ErrorEllipsoid::setCovariance( const Math::Matrix< double, 3, 3 >& covariance )
+void ErrorEllipsoid::setCovariances( ErrorEllipsoid* const* ellipsoids, const Math::Matrix< double, 3, 3 >* covariances, unsigned count )
 {
-	ublas::subrange( m_rotation, 0, 3, 0, 3 ) = covariance;
-	ublas::matrix_range< Math::Matrix< double, 4, 4 > > upperLeft( m_rotation, ublas::range( 0, 3 ), ublas::range( 0, 3 ) );
-	lapack::syev( 'V', 'U', upperLeft, m_sizes, lapack::minimal_workspace() );
-	for ( unsigned i = 0; i < 3; i++ )
-		if ( m_sizes( i ) > 0 )
-			m_sizes( i ) = sqrt( m_sizes( i ) ) * m_scaling;
-		else
-			m_sizes( i )  = 0;
-
-	LOG4CPP_TRACE( logger, "Size = " << m_sizes );
+	// enough for the four ellipsoids of a pose error in one batch
+	const unsigned batchSize = 4;
+	Math::Vector< double, 3 > values[ batchSize ];
+	Math::Matrix< double, 3, 3 > vectors[ batchSize ];
+
+	for ( unsigned first = 0; first < count; first += batchSize )
+	{
+		unsigned n = std::min( batchSize, count - first );
+		symmetricEigen3( covariances + first, n, values, vectors );
+
+		for ( unsigned e = 0; e < n; e++ )
+		{
+			ErrorEllipsoid& ellipsoid = *ellipsoids[ first + e ];
+			for ( unsigned i = 0; i < 3; i++ )
+			{
+				for ( unsigned j = 0; j < 3; j++ )
+					ellipsoid.m_rotation( i, j ) = vectors[ e ]( i, j );
+
+				if ( values[ e ]( i ) > 0 )
+					ellipsoid.m_sizes( i ) = sqrt( values[ e ]( i ) ) * ellipsoid.m_scaling;
+				else
+					ellipsoid.m_sizes( i ) = 0;
+			}
+
+			LOG4CPP_TRACE( logger, "Size = " << ellipsoid.m_sizes );
+		}
+	}
 }
 
 
 } } // namespace Ubitrack::Drivers
-
-#endif // HAVE_LAPACK
@@ -31,16 +31,12 @@
 #ifndef __ERRORELLIPSOID_H_INCLUDED__
 #define __ERRORELLIPSOID_H_INCLUDED__
 
-
-
-#ifdef HAVE_LAPACK
-
 #include "RenderModule.h"
 
 namespace Ubitrack { namespace Drivers {
 
 /**
- * Draws 3x3 covariances as ellipsoids
+ * Decomposes 3x3 covariances into ellipsoids, which are drawn by an EllipsoidBatch
  */
 class ErrorEllipsoid
 {
@@ -52,21 +48,30 @@ public:
 	 */
 	ErrorEllipsoid( const Math::Vector< double, 3 >& position = ( Math::Vector< double, 3 >( 0, 0, 0 ) ), double scaling = 3.0 );
 
-	/** destructor */
-	~ErrorEllipsoid();
-
 	/**
 	 * sets the covariance matrix
 	 */
 	void setCovariance( const Math::Matrix< double, 3, 3 >& covariance );
 
-	/** renders the ellipsoid */
-	void draw();
+	/**
+	 * sets the covariance matrices of several ellipsoids, decomposing them together
+	 * @param ellipsoids count ellipsoids to update
+	 * @param covariances count covariance matrices
+	 */
+	static void setCovariances( ErrorEllipsoid* const* ellipsoids, const Math::Matrix< double, 3, 3 >* covariances, unsigned count );
 
 	/** returns the position */
 	const Math::Vector< double, 3 >& position() const
 	{ return m_position; }
 
+	/** returns the semi-axis lengths */
+	const Math::Vector< double, 3 >& sizes() const
+	{ return m_sizes; }
+
+	/** returns the rotation, the upper left 3x3 block contains the axes as columns */
+	const Math::Matrix< double, 4, 4 >& rotation() const
+	{ return m_rotation; }
+
 	/** sets the scaling */
 	void setScaling( double scaling )
 	{ m_scaling = scaling; }
@@ -82,11 +87,8 @@ protected:
 	// result of the decomposition
 	Math::Vector< double, 3 > m_sizes;
 	Math::Matrix< double, 4, 4 > m_rotation;
-
-	GLUquadricObj* m_pQuadric;
 };
 
 } } // namespace Ubitrack::Drivers
 
-#endif // HAVE_LAPACK
 #endif
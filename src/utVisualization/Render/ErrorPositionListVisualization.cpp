@@ -0,0 +1,108 @@
+/*
+ * Ubitrack - Library for Ubiquitous Tracking
+ * Copyright 2006, Technische Universitaet Muenchen, and individual
+ * contributors as indicated by the @authors tag. See the
+ * copyright.txt in the distribution for a full listing of individual
+ * contributors.
+ *
+ * This is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this software; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA, or see the FSF site: http://www.fsf.org.
+ */
+
+/**
+ * @file
+ * Implementation of the position error list visualization component
+ */
+
+#include "ErrorPositionListVisualization.h"
+
+#include <sstream>
+#include <log4cpp/Category.hh>
+
+namespace Ubitrack { namespace Drivers {
+
+ErrorPositionListVisualization::ErrorPositionListVisualization( const std::string& name, boost::shared_ptr< Graph::UTQLSubgraph > subgraph,
+	const VirtualObjectKey& componentKey, VirtualCamera* pModule )
+	: TrackedObject( name, subgraph, componentKey, pModule )
+	, m_errorPushPort( "ErrorInput", *this, boost::bind( &ErrorPositionListVisualization::receiveErrors, this, _1 ) )
+	, m_scaling( 3.0 )
+{
+	subgraph->m_DataflowAttributes.getAttributeData( "scaling", m_scaling );
+
+	std::istringstream cparse( subgraph->m_DataflowAttributes.getAttributeString( "rgba" ) );
+	cparse >> m_color[ 0 ] >> m_color[ 1 ] >> m_color[ 2 ] >> m_color[ 3 ];
+	if ( !cparse )
+	{
+		m_color[ 0 ] = 0.3f; m_color[ 1 ] = 0.9f; m_color[ 2 ] = 0.9f; m_color[ 3 ] = 1.0f;
+	}
+}
+
+
+void ErrorPositionListVisualization::draw3DContent( Measurement::Timestamp& t, int )
+{
+	m_batch.clear();
+	{
+		boost::mutex::scoped_lock l( m_poseLock );
+		for ( std::vector< ErrorEllipsoid >::const_iterator it = m_ellipsoids.begin(); it != m_ellipsoids.end(); it++ )
+			m_batch.add( *it, m_color[ 0 ], m_color[ 1 ], m_color[ 2 ], m_color[ 3 ] );
+	}
+
+	LOG4CPP_DEBUG( logger, "Drawing " << m_batch.size() << " ellipsoids" );
+
+	// save old state
+	GLboolean oldCullMode;
+	glGetBooleanv( GL_CULL_FACE, &oldCullMode );
+
+	// set new state
+	glEnable( GL_CULL_FACE );
+
+	m_batch.draw();
+
+	// restore old state
+	if ( !oldCullMode )
+		glDisable( GL_CULL_FACE );
+}
+
+
+void ErrorPositionListVisualization::receiveErrors( const Ubitrack::Measurement::ErrorPositionList& errors )
+{
+	LOG4CPP_DEBUG( logger, "Received " << errors->size() << " error positions" );
+
+	// decompose outside the lock, the render thread only needs the results
+	std::size_t count = errors->size();
+	std::vector< ErrorEllipsoid > ellipsoids( count, ErrorEllipsoid( Math::Vector< double, 3 >( 0, 0, 0 ), m_scaling ) );
+	std::vector< Math::Matrix< double, 3, 3 > > covariances( count );
+	std::vector< ErrorEllipsoid* > pointers( count );
+	for ( std::size_t i = 0; i < count; i++ )
+	{
+		ellipsoids[ i ].setPosition( (*errors)[ i ].value );
+		covariances[ i ] = (*errors)[ i ].covariance;
+		pointers[ i ] = &ellipsoids[ i ];
+	}
+	if ( count )
+		ErrorEllipsoid::setCovariances( &pointers[ 0 ], &covariances[ 0 ], unsigned( count ) );
+
+	boost::mutex::scoped_lock l( m_poseLock );
+	m_ellipsoids.swap( ellipsoids );
+}
+
+
+void ErrorPositionListVisualization::glCleanup()
+{
+	m_batch.glCleanup();
+}
+
+
+} } // namespace Ubitrack::Drivers
@@ -0,0 +1,90 @@
+/*
+ * Ubitrack - Library for Ubiquitous Tracking
+ * Copyright 2006, Technische Universitaet Muenchen, and individual
+ * contributors as indicated by the @authors tag. See the
+ * copyright.txt in the distribution for a full listing of individual
+ * contributors.
+ *
+ * This is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this software; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA, or see the FSF site: http://www.fsf.org.
+ */
+
+/**
+ * @file
+ * Visualization of a list of position errors, e.g. of a calibration point set
+ */ 
+ 
+#ifndef __ErrorPositionListVisualization_h_INCLUDED__
+#define __ErrorPositionListVisualization_h_INCLUDED__
+
+#include <vector>
+#include "TrackedObject.h"
+#include "ErrorEllipsoid.h"
+#include "EllipsoidBatch.h"
+
+namespace Ubitrack { namespace Drivers {
+
+/**
+ * @ingroup driver_components
+ * Component for position error list visualization.
+ * Draws the covariance ellipsoids of all positions with a single instanced draw call.
+ */
+class ErrorPositionListVisualization
+	: public TrackedObject
+{
+public:
+
+	/**
+	 * Constructor
+	 * @param name edge name
+	 * @param config component configuration
+	 * @param componentKey the unique identifier for this component
+	 * @param pModule parent object
+	 */
+	ErrorPositionListVisualization( const std::string& name, boost::shared_ptr< Graph::UTQLSubgraph > subgraph, 
+		const VirtualObjectKey& componentKey, VirtualCamera* pModule );
+
+	/** render the object */
+	virtual void draw3DContent( Measurement::Timestamp&, int );
+
+	virtual void glCleanup();
+
+	/** may be replayed for the second eye with single-pass stereo */
+	virtual bool isEyeIndependent()
+	{ return true; }
+
+protected:
+	/** receives error position lists */
+	void receiveErrors( const Measurement::ErrorPositionList& errors );
+
+	/** the errorIn push port */
+	PushConsumer< Measurement::ErrorPositionList > m_errorPushPort;
+
+	/** scaling of the ellipsoids in multiples of sigma */
+	double m_scaling;
+
+	/** colour of the ellipsoids */
+	float m_color[ 4 ];
+
+	/** the decomposed ellipsoids of the last list */
+	std::vector< ErrorEllipsoid > m_ellipsoids;
+
+	EllipsoidBatch m_batch;
+};
+
+
+} } // namespace Ubitrack::Drivers
+
+#endif
@@ -0,0 +1,129 @@
+/*
+ * Ubitrack - Library for Ubiquitous Tracking
+ * Copyright 2006, Technische Universitaet Muenchen, and individual
+ * contributors as indicated by the @authors tag. See the
+ * copyright.txt in the distribution for a full listing of individual
+ * contributors.
+ *
+ * This is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this software; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA, or see the FSF site: http://www.fsf.org.
+ */
+
+/**
+ * @file
+ * Implementation of the frame latency measurement
+ */
+
+#include <algorithm>
+#include <sstream>
+#include <log4cpp/Category.hh>
+#include "FrameLatency.h"
+
+static log4cpp::Category& latencyLogger( log4cpp::Category::getInstance( "Drivers.Render.FrameLatency" ) );
+
+namespace Ubitrack { namespace Drivers {
+
+namespace {
+	/** number of 1 ms histogram buckets, plus one for longer frames */
+	const unsigned g_histogramBuckets = 100;
+
+	double toMs( Measurement::Timestamp from, Measurement::Timestamp to )
+	{ return ( double( to ) - double( from ) ) * 1e-6; }
+}
+
+FrameLatency::FrameLatency( const std::string& name, boost::shared_ptr< Graph::UTQLSubgraph > subgraph, 
+	const VirtualObjectKey& componentKey, VirtualCamera* pModule )
+	: VirtualObject( name, subgraph, componentKey, pModule )
+	, m_latencyPort( "Latency", *this )
+	, m_componentsPort( "Components", *this )
+	, m_percentilesPort( "Percentiles", *this )
+	, m_lastInput( 0 )
+	, m_histogram( g_histogramBuckets + 1, 0 )
+	, m_frames( 0 )
+	, m_maxLatency( 0.0 )
+	, m_logInterval( 300 )
+{
+	subgraph->m_DataflowAttributes.getAttributeData( "logInterval", m_logInterval );
+}
+
+void FrameLatency::framePresented( const FrameTiming& timing )
+{
+	// nothing to measure if the frame shows no new measurement
+	if ( !timing.newestInput || timing.newestInput == m_lastInput )
+		return;
+	m_lastInput = timing.newestInput;
+
+	Measurement::Timestamp present = timing.present ? timing.present : timing.swapEnd;
+	double latency = toMs( timing.newestInput, present );
+
+	Math::Vector< double, 4 > components;
+	components( 0 ) = toMs( timing.newestInput, timing.renderStart );
+	components( 1 ) = toMs( timing.renderStart, timing.renderEnd );
+	components( 2 ) = toMs( timing.renderEnd, timing.swapEnd );
+	components( 3 ) = toMs( timing.swapEnd, present );
+
+	LOG4CPP_DEBUG( latencyLogger, getName() << ": latency " << latency << "ms (queueing " << components( 0 )
+		<< ", render " << components( 1 ) << ", swap " << components( 2 ) << ", display " << components( 3 )
+		<< ( timing.bPresentMeasured ? ")" : ", estimated)" ) << ", input spread " 
+		<< toMs( timing.oldestInput, timing.newestInput ) << "ms" );
+
+	m_latencyPort.send( Measurement::Distance( present, latency ) );
+	m_componentsPort.send( Measurement::Vector4D( present, components ) );
+
+	unsigned bucket = latency > 0.0 ? std::min( unsigned( latency ), g_histogramBuckets ) : 0;
+	m_histogram[ bucket ]++;
+	m_maxLatency = std::max( m_maxLatency, latency );
+	m_frames++;
+
+	if ( m_logInterval > 0 && m_frames >= unsigned( m_logInterval ) )
+		reportHistogram( present );
+}
+
+int FrameLatency::percentile( double fraction ) const
+{
+	unsigned limit = unsigned( fraction * m_frames );
+	unsigned sum = 0;
+	for ( unsigned i = 0; i < m_histogram.size(); i++ )
+	{
+		sum += m_histogram[ i ];
+		if ( sum > limit )
+			return i + 1;
+	}
+	return g_histogramBuckets + 1;
+}
+
+void FrameLatency::reportHistogram( Measurement::Timestamp time )
+{
+	std::ostringstream overflow;
+	if ( m_histogram[ g_histogramBuckets ] )
+		overflow << ", " << m_histogram[ g_histogramBuckets ] << " frames above " << g_histogramBuckets << "ms";
+
+	LOG4CPP_INFO( latencyLogger, getName() << ": latency over " << m_frames << " frames: p50 < " << percentile( 0.5 )
+		<< "ms, p90 < " << percentile( 0.9 ) << "ms, p99 < " << percentile( 0.99 ) << "ms, max " 
+		<< m_maxLatency << "ms" << overflow.str() );
+
+	Math::Vector< double, 4 > summary;
+	summary( 0 ) = percentile( 0.5 );
+	summary( 1 ) = percentile( 0.9 );
+	summary( 2 ) = percentile( 0.99 );
+	summary( 3 ) = m_maxLatency;
+	m_percentilesPort.send( Measurement::Vector4D( time, summary ) );
+
+	std::fill( m_histogram.begin(), m_histogram.end(), 0 );
+	m_frames = 0;
+	m_maxLatency = 0.0;
+}
+
+} } // namespace Ubitrack::Drivers
@@ -0,0 +1,90 @@
+/*
+ * Ubitrack - Library for Ubiquitous Tracking
+ * Copyright 2006, Technische Universitaet Muenchen, and individual
+ * contributors as indicated by the @authors tag. See the
+ * copyright.txt in the distribution for a full listing of individual
+ * contributors.
+ *
+ * This is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this software; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA, or see the FSF site: http://www.fsf.org.
+ */
+
+/**
+ * @file
+ * Motion-to-photon latency of the rendered frames
+ */
+
+#ifndef _FRAMELATENCY_H_
+#define _FRAMELATENCY_H_
+
+#include <vector>
+#include "RenderModule.h"
+
+namespace Ubitrack { namespace Drivers {
+
+
+/**
+ * @ingroup driver_components
+ * Measures the latency from the newest measurement used in a frame to its presentation.
+ * Pushes the end-to-end latency in ms on "Latency" and its components (queueing, render,
+ * swap, display) on "Components". A histogram of the latency is summarized periodically, the
+ * summary (p50, p90, p99, max in ms) is logged and pushed on "Percentiles".
+ */
+class FrameLatency
+	: public VirtualObject
+{
+public:
+
+	/**
+	 * Constructor
+	 * @param name edge name
+	 * @param config component configuration
+	 * @param componentKey the unique identifier for this component
+	 * @param pModule parent object
+	 */
+	FrameLatency( const std::string& name, boost::shared_ptr< Graph::UTQLSubgraph > subgraph, 
+		const VirtualObjectKey& componentKey, VirtualCamera* pModule );
+
+	/** records the timing of a presented frame */
+	virtual void framePresented( const FrameTiming& timing );
+
+protected:
+
+	/** logs and pushes percentiles of the histogram and resets it */
+	void reportHistogram( Measurement::Timestamp time );
+
+	/** returns the upper bucket bound below which the given fraction of frames lies */
+	int percentile( double fraction ) const;
+
+	PushSupplier< Measurement::Distance > m_latencyPort;
+	PushSupplier< Measurement::Vector4D > m_componentsPort;
+	PushSupplier< Measurement::Vector4D > m_percentilesPort;
+
+	/** input time of the last measured frame, frames showing no new measurement are skipped */
+	Measurement::Timestamp m_lastInput;
+
+	/** latency histogram in 1 ms buckets, the last bucket collects everything above */
+	std::vector< unsigned > m_histogram;
+	unsigned m_frames;
+	double m_maxLatency;
+
+	/** number of frames between histogram summaries, 0 = never */
+	int m_logInterval;
+};
+
+
+} } // namespace Ubitrack::Drivers
+
+#endif
@@ -34,8 +34,8 @@ ImageOutput::ImageOutput( const std::string& name, boost::shared_ptr< Graph::UTQ
 {
 }
 
-/** render the object */
-void ImageOutput::draw( Measurement::Timestamp&, int parity )
+/** reads back the finished frame, containing both eyes with single-image stereo */
+void ImageOutput::drawFinished( Measurement::Timestamp&, int parity )
 {
 	if (parity) return;
 
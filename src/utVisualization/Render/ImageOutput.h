@@ -50,8 +50,8 @@ public:
 	ImageOutput( const std::string& name, boost::shared_ptr< Graph::UTQLSubgraph > subgraph, 
 		const VirtualObjectKey& componentKey, VirtualCamera* pModule );
 
-	/** render the object */
-	virtual void draw( Measurement::Timestamp&, int parity );
+	/** reads back the finished frame, containing both eyes with single-image stereo */
+	virtual void drawFinished( Measurement::Timestamp&, int parity );
 
 protected:
 
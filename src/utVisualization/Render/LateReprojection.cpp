@@ -0,0 +1,227 @@
+/*
+ * Ubitrack - Library for Ubiquitous Tracking
+ * Copyright 2006, Technische Universitaet Muenchen, and individual
+ * contributors as indicated by the @authors tag. See the
+ * copyright.txt in the distribution for a full listing of individual
+ * contributors.
+ *
+ * This is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this software; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA, or see the FSF site: http://www.fsf.org.
+ */
+
+/**
+ * @file
+ * Implementation of the late reprojection
+ */
+
+#ifdef HAVE_GLEW
+	#include "GL/glew.h"
+#endif
+
+#include <cmath>
+#include <algorithm>
+#include "LateReprojection.h"
+#include "CameraPose.h"
+
+namespace Ubitrack { namespace Drivers {
+
+
+LateReprojection::LateReprojection( const std::string& name, boost::shared_ptr< Graph::UTQLSubgraph > subgraph, 
+	const VirtualObjectKey& componentKey, VirtualCamera* pModule )
+	: VirtualObject( name, subgraph, componentKey, pModule )
+	, m_push( "PushInput", *this, boost::bind( &LateReprojection::poseIn, this, _1 ) )
+	, m_pull( "PullInput", *this )
+	, m_prediction( 0 )
+	, m_bRedirected( false )
+	, m_bFailed( false )
+{
+}
+
+
+/**
+ * callback from Pose port, redrawing is left to the CameraPose component
+ * @param pose current camera pose
+ */
+void LateReprojection::poseIn( const Measurement::Pose& pose )
+{
+	boost::mutex::scoped_lock l( m_poseLock );
+	m_latestPose = pose;
+}
+
+
+bool LateReprojection::latestPose( Measurement::Timestamp t, Measurement::Pose& pose )
+{
+	if ( m_pull.isConnected() )
+	{
+		pose = m_pull.get( t );
+		return true;
+	}
+
+	boost::mutex::scoped_lock l( m_poseLock );
+	pose = m_latestPose;
+	return pose.get() != 0;
+}
+
+
+Measurement::Pose LateReprojection::cameraPose()
+{
+	VirtualCamera::ComponentList objects = getModule().getAllComponents();
+	for ( VirtualCamera::ComponentList::iterator i = objects.begin(); i != objects.end(); i++ )
+		if ( CameraPose* pCameraPose = dynamic_cast< CameraPose* >( i->get() ) )
+			return pCameraPose->drawnPose();
+	return Measurement::Pose();
+}
+
+
+void LateReprojection::draw( Measurement::Timestamp& t, int parity )
+{
+	// the second pass of single-image stereo renders into the same target
+	if ( m_bRedirected || m_bFailed )
+		return;
+
+	if ( getModule().getStereoRenderPasses() == VirtualCamera::stereoRenderSingle )
+	{
+		// both eyes share one image, a common warp would be wrong for packed stereo formats
+		LOG4CPP_ERROR( logger, getName() << ": late reprojection does not support single-image stereo" );
+		m_bFailed = true;
+		return;
+	}
+
+	if ( !RenderTarget::supported() || !m_target.resize( getModule().m_width, getModule().m_height ) )
+	{
+		LOG4CPP_ERROR( logger, getName() << ": late reprojection requires framebuffer objects" );
+		m_bFailed = true;
+		return;
+	}
+
+	// the late pose is predicted as far ahead of drawFinished() as the render pose is of draw()
+	m_prediction = static_cast< long long >( t ) - static_cast< long long >( Measurement::now() );
+
+	try
+	{
+		if ( !latestPose( t, m_renderPose ) )
+			m_renderPose.reset();
+	}
+	catch( const Util::Exception& e )
+	{
+		LOG4CPP_DEBUG( logger, getName() << ": no render pose: " << e );
+		m_renderPose.reset();
+	}
+	if ( m_renderPose )
+		m_lastUpdateTime = m_renderPose.time();
+
+	m_target.bind();
+	glClear( GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT );
+	m_bRedirected = true;
+}
+
+
+void LateReprojection::drawFinished( Measurement::Timestamp&, int )
+{
+	if ( !m_bRedirected )
+		return;
+	m_bRedirected = false;
+	RenderTarget::unbind();
+
+	// projection the frame was rendered with, still set by the last pass
+	GLdouble projection[ 16 ];
+	glGetDoublev( GL_PROJECTION_MATRIX, projection );
+
+	// the pose the frame was drawn with, CameraPose may have received newer ones since
+	Measurement::Pose renderPose( cameraPose() );
+	if ( !renderPose )
+		renderPose = m_renderPose;
+
+	// rotation from the render camera to the latest camera: ~latest * render
+	GLdouble correction[ 16 ] = { 1, 0, 0, 0,  0, 1, 0, 0,  0, 0, 1, 0,  0, 0, 0, 1 };
+	Measurement::Pose latest;
+	try
+	{
+		Measurement::Timestamp target( static_cast< Measurement::Timestamp >( 
+			static_cast< long long >( Measurement::now() ) + m_prediction ) );
+		if ( renderPose && latestPose( target, latest ) && latest.time() != renderPose.time() )
+		{
+			Math::Quaternion delta( ( ~( latest->rotation() ) ) * renderPose->rotation() );
+			Math::Matrix< double, 4, 4 > m( delta, Math::Vector< double, 3 >( 0, 0, 0 ) );
+			for ( int i = 0; i < 16; i++ )
+				correction[ i ] = m.content()[ i ];
+
+			m_lastUpdateTime = latest.time();
+			LOG4CPP_DEBUG( logger, getName() << ": corrected " << ( double( latest.time() ) - double( renderPose.time() ) ) * 1e-6
+				<< "ms of motion by " << 2.0 * std::acos( std::min( 1.0, std::fabs( delta.w() ) ) ) * 180.0 / 3.14159265358979 << " degrees" );
+		}
+	}
+	catch( const Util::Exception& e )
+	{
+		LOG4CPP_DEBUG( logger, getName() << ": no late pose: " << e );
+	}
+
+	// the image plane at half the depth range, as seen from the render camera
+	GLdouble identity[ 16 ] = { 1, 0, 0, 0,  0, 1, 0, 0,  0, 0, 1, 0,  0, 0, 0, 1 };
+	GLint viewport[ 4 ] = { 0, 0, 1, 1 };
+	GLdouble corners[ 4 ][ 3 ];
+	for ( int i = 0; i < 4; i++ )
+	{
+		GLdouble x = ( i == 1 || i == 2 ) ? 1.0 : 0.0;
+		GLdouble y = ( i >= 2 ) ? 1.0 : 0.0;
+		GLdouble nearPoint[ 3 ], farPoint[ 3 ];
+		gluUnProject( x, y, 0.0, identity, projection, viewport, &nearPoint[ 0 ], &nearPoint[ 1 ], &nearPoint[ 2 ] );
+		gluUnProject( x, y, 1.0, identity, projection, viewport, &farPoint[ 0 ], &farPoint[ 1 ], &farPoint[ 2 ] );
+		for ( int j = 0; j < 3; j++ )
+			corners[ i ][ j ] = 0.5 * ( nearPoint[ j ] + farPoint[ j ] );
+	}
+
+	// draw it from the latest camera, perspective-correct texturing gives the homography
+	glClear( GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT );
+	glPushAttrib( GL_ENABLE_BIT );
+	glDisable( GL_DEPTH_TEST );
+	glDisable( GL_LIGHTING );
+	glDisable( GL_BLEND );
+	glDisable( GL_CULL_FACE );
+	glEnable( GL_TEXTURE_2D );
+	glBindTexture( GL_TEXTURE_2D, m_target.texture() );
+	glTexEnvi( GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_REPLACE );
+
+	glMatrixMode( GL_PROJECTION );
+	glPushMatrix();
+	glLoadMatrixd( projection );
+	glMatrixMode( GL_MODELVIEW );
+	glPushMatrix();
+	glLoadMatrixd( correction );
+
+	glBegin( GL_QUADS );
+	for ( int i = 0; i < 4; i++ )
+	{
+		glTexCoord2d( ( i == 1 || i == 2 ) ? 1.0 : 0.0, ( i >= 2 ) ? 1.0 : 0.0 );
+		glVertex3dv( corners[ i ] );
+	}
+	glEnd();
+
+	glPopMatrix();
+	glMatrixMode( GL_PROJECTION );
+	glPopMatrix();
+	glMatrixMode( GL_MODELVIEW );
+	glBindTexture( GL_TEXTURE_2D, 0 );
+	glPopAttrib();
+}
+
+
+void LateReprojection::glCleanup()
+{
+	m_target.release();
+}
+
+
+} } // namespace Ubitrack::Drivers
@@ -0,0 +1,107 @@
+/*
+ * Ubitrack - Library for Ubiquitous Tracking
+ * Copyright 2006, Technische Universitaet Muenchen, and individual
+ * contributors as indicated by the @authors tag. See the
+ * copyright.txt in the distribution for a full listing of individual
+ * contributors.
+ *
+ * This is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this software; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA, or see the FSF site: http://www.fsf.org.
+ */
+
+/**
+ * @file
+ * Late reprojection of the rendered frame with the latest camera pose
+ */
+
+#ifndef __LATEREPROJECTION_H__
+#define __LATEREPROJECTION_H__
+
+#include "RenderModule.h"
+#include "RenderTarget.h"
+#include <utMath/Pose.h>
+
+namespace Ubitrack { namespace Drivers {
+
+
+/**
+ * @ingroup driver_components
+ * Late-stage reprojection ("timewarp") for optical see-through displays.
+ * The scene is rendered into an offscreen target. Before the buffers are swapped, the
+ * camera pose is sampled again and the image is warped by the rotation between the
+ * pose used for rendering and the latest one.
+ * Takes the same pose as the CameraPose component, which still sets the render pose. The pose
+ * CameraPose has drawn the frame with is used as render pose, the own input only if there is
+ * no CameraPose. Pull inputs are sampled with the same prediction offset as the rendering.
+ */
+class LateReprojection
+	: public VirtualObject
+{
+public:
+
+	/**
+	 * Constructor
+	 * @param name edge name
+	 * @param config component configuration
+	 * @param componentKey the unique identifier for this component
+	 * @param pModule parent object
+	 */
+	LateReprojection( const std::string& name, boost::shared_ptr< Graph::UTQLSubgraph > subgraph, 
+		const VirtualObjectKey& componentKey, VirtualCamera* pModule );
+
+	/** redirects rendering into the offscreen target and remembers the render pose */
+	virtual void draw( Measurement::Timestamp& t, int parity );
+
+	/** warps the rendered image into the window with the latest pose */
+	virtual void drawFinished( Measurement::Timestamp& t, int parity );
+
+	virtual void glCleanup();
+
+protected:
+
+	void poseIn( const Measurement::Pose& pose );
+
+	/** latest pose from the push or pull input, false if none is available */
+	bool latestPose( Measurement::Timestamp t, Measurement::Pose& pose );
+
+	/** the pose the first CameraPose component has drawn the current frame with */
+	Measurement::Pose cameraPose();
+
+	// pose input
+	PushConsumer< Measurement::Pose > m_push;
+	PullConsumer< Measurement::Pose > m_pull;
+
+	Measurement::Pose m_latestPose;
+	boost::mutex m_poseLock;
+
+	/** pose the current frame is rendered with, if there is no CameraPose */
+	Measurement::Pose m_renderPose;
+
+	/** time the frame is rendered for minus the time of draw(), in ns */
+	long long m_prediction;
+
+	RenderTarget m_target;
+
+	/** true while the current frame is rendered into m_target */
+	bool m_bRedirected;
+
+	/** set if offscreen rendering is not possible */
+	bool m_bFailed;
+};
+
+
+} } // namespace Ubitrack::Drivers
+
+#endif
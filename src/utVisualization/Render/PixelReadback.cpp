@@ -0,0 +1,214 @@
+/*
+ * Ubitrack - Library for Ubiquitous Tracking
+ * Copyright 2006, Technische Universitaet Muenchen, and individual
+ * contributors as indicated by the @authors tag. See the
+ * copyright.txt in the distribution for a full listing of individual
+ * contributors.
+ *
+ * This is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this software; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA, or see the FSF site: http://www.fsf.org.
+ */
+
+/**
+ * @file
+ * Implementation of the asynchronous framebuffer readback
+ */
+
+#ifdef HAVE_GLEW
+	#include "GL/glew.h"
+#endif
+
+#include <algorithm>
+#include "PixelReadback.h"
+
+namespace Ubitrack { namespace Drivers {
+
+PixelReadback::PixelReadback( unsigned nBuffers )
+	: m_buffers( std::max( nBuffers, 1u ) )
+	, m_oldest( 0 )
+	, m_nPending( 0 )
+{
+}
+
+#ifdef HAVE_GLEW
+
+bool PixelReadback::supported()
+{
+	return GLEW_VERSION_2_1 || GLEW_ARB_pixel_buffer_object;
+}
+
+
+bool PixelReadback::start( int x, int y, int width, int height, GLenum format, GLenum type, 
+	std::size_t rowBytes, Measurement::Timestamp time )
+{
+	if ( m_nPending == m_buffers.size() )
+		return false;
+
+	Buffer& buffer = m_buffers[ ( m_oldest + m_nPending ) % m_buffers.size() ];
+	std::size_t bytes = rowBytes * height;
+	if ( !buffer.buffer )
+		glGenBuffers( 1, &buffer.buffer );
+	glBindBuffer( GL_PIXEL_PACK_BUFFER, buffer.buffer );
+	if ( buffer.capacity != bytes )
+	{
+		glBufferData( GL_PIXEL_PACK_BUFFER, bytes, 0, GL_STREAM_READ );
+		buffer.capacity = bytes;
+	}
+
+	// with a pack buffer bound, glReadPixels only queues the copy
+	GLint alignment;
+	glGetIntegerv( GL_PACK_ALIGNMENT, &alignment );
+	glPixelStorei( GL_PACK_ALIGNMENT, 1 );
+	glReadPixels( x, y, width, height, format, type, 0 );
+	glPixelStorei( GL_PACK_ALIGNMENT, alignment );
+	glBindBuffer( GL_PIXEL_PACK_BUFFER, 0 );
+
+	if ( GLEW_VERSION_3_2 || GLEW_ARB_sync )
+		buffer.fence = glFenceSync( GL_SYNC_GPU_COMMANDS_COMPLETE, 0 );
+	buffer.width = width;
+	buffer.height = height;
+	buffer.time = time;
+	m_nPending++;
+	return true;
+}
+
+
+bool PixelReadback::finished( bool bWait )
+{
+	if ( !m_nPending )
+		return false;
+
+	Buffer& buffer = m_buffers[ m_oldest ];
+	if ( !buffer.fence )
+		return bWait || m_nPending == m_buffers.size();
+
+	GLsync fence = static_cast< GLsync >( buffer.fence );
+	GLenum result = glClientWaitSync( fence, bWait ? GL_SYNC_FLUSH_COMMANDS_BIT : 0, bWait ? 1000000000ULL : 0 );
+	return result == GL_ALREADY_SIGNALED || result == GL_CONDITION_SATISFIED;
+}
+
+
+const unsigned char* PixelReadback::map( int& width, int& height, Measurement::Timestamp& time )
+{
+	if ( !m_nPending )
+		return 0;
+
+	Buffer& buffer = m_buffers[ m_oldest ];
+	width = buffer.width;
+	height = buffer.height;
+	time = buffer.time;
+
+	glBindBuffer( GL_PIXEL_PACK_BUFFER, buffer.buffer );
+	const unsigned char* pData = static_cast< const unsigned char* >( glMapBuffer( GL_PIXEL_PACK_BUFFER, GL_READ_ONLY ) );
+	glBindBuffer( GL_PIXEL_PACK_BUFFER, 0 );
+	if ( !pData )
+		LOG4CPP_ERROR( logger, "Cannot map pixel buffer: " << glGetError() );
+	return pData;
+}
+
+
+void PixelReadback::unmap()
+{
+	if ( !m_nPending )
+		return;
+
+	glBindBuffer( GL_PIXEL_PACK_BUFFER, m_buffers[ m_oldest ].buffer );
+	glUnmapBuffer( GL_PIXEL_PACK_BUFFER );
+	glBindBuffer( GL_PIXEL_PACK_BUFFER, 0 );
+	discard();
+}
+
+
+void PixelReadback::discard()
+{
+	if ( !m_nPending )
+		return;
+
+	deleteFence( m_buffers[ m_oldest ] );
+	m_oldest = ( m_oldest + 1 ) % m_buffers.size();
+	m_nPending--;
+}
+
+
+void PixelReadback::release()
+{
+	for ( std::size_t i = 0; i < m_buffers.size(); i++ )
+	{
+		deleteFence( m_buffers[ i ] );
+		if ( m_buffers[ i ].buffer )
+			glDeleteBuffers( 1, &m_buffers[ i ].buffer );
+		m_buffers[ i ] = Buffer();
+	}
+	m_oldest = 0;
+	m_nPending = 0;
+}
+
+
+void PixelReadback::deleteFence( Buffer& buffer )
+{
+	if ( buffer.fence )
+		glDeleteSync( static_cast< GLsync >( buffer.fence ) );
+	buffer.fence = 0;
+}
+
+#else // HAVE_GLEW
+
+bool PixelReadback::supported()
+{
+	return false;
+}
+
+
+bool PixelReadback::start( int, int, int, int, GLenum, GLenum, std::size_t, Measurement::Timestamp )
+{
+	LOG4CPP_ERROR( logger, "Pixel buffer objects require the render module to be compiled with GLEW" );
+	return false;
+}
+
+
+bool PixelReadback::finished( bool )
+{
+	return false;
+}
+
+
+const unsigned char* PixelReadback::map( int&, int&, Measurement::Timestamp& )
+{
+	return 0;
+}
+
+
+void PixelReadback::unmap()
+{
+}
+
+
+void PixelReadback::discard()
+{
+}
+
+
+void PixelReadback::release()
+{
+}
+
+
+void PixelReadback::deleteFence( Buffer& )
+{
+}
+
+#endif // HAVE_GLEW
+
+} } // namespace Ubitrack::Drivers
@@ -0,0 +1,131 @@
+/*
+ * Ubitrack - Library for Ubiquitous Tracking
+ * Copyright 2006, Technische Universitaet Muenchen, and individual
+ * contributors as indicated by the @authors tag. See the
+ * copyright.txt in the distribution for a full listing of individual
+ * contributors.
+ *
+ * This is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this software; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA, or see the FSF site: http://www.fsf.org.
+ */
+
+/**
+ * @file
+ * Asynchronous readback of the framebuffer used by the render components
+ *
+ * Files using this class have to include GL/glew.h before any other GL header.
+ */
+
+#ifndef __PixelReadback_h_INCLUDED__
+#define __PixelReadback_h_INCLUDED__
+
+#include <vector>
+#include "RenderModule.h"
+
+namespace Ubitrack { namespace Drivers {
+
+/**
+ * Ring of pixel buffer objects that framebuffer contents are read into without waiting for the GPU.
+ * A read started in one frame is usually finished one or two frames later, when it can be mapped.
+ * Reads finish in the order they were started. All methods must be called on the GL thread.
+ * The GL objects are not deleted by the destructor, call release() from glCleanup() instead.
+ * Requires GLEW and OpenGL 2.1 or GL_ARB_pixel_buffer_object. Fences (OpenGL 3.2 or GL_ARB_sync)
+ * are used to check for finished reads if available, otherwise a read is assumed to be finished
+ * when all buffers are in use.
+ */
+class PixelReadback
+{
+public:
+
+	/** @param nBuffers number of reads that can be in flight */
+	PixelReadback( unsigned nBuffers = 3 );
+
+	/** checks whether the current GL context supports pixel buffer objects */
+	static bool supported();
+
+	/** number of buffers */
+	unsigned size() const
+	{ return static_cast< unsigned >( m_buffers.size() ); }
+
+	/** number of reads started but not yet mapped or discarded */
+	unsigned pending() const
+	{ return m_nPending; }
+
+	/**
+	 * starts reading a rectangle of the current read buffer
+	 * @param rowBytes size of a pixel row in bytes, rows are packed without alignment
+	 * @param time timestamp that is returned with the data
+	 * @return false if all buffers are pending
+	 */
+	bool start( int x, int y, int width, int height, GLenum format, GLenum type, 
+		std::size_t rowBytes, Measurement::Timestamp time );
+
+	/**
+	 * checks whether the oldest pending read has finished
+	 * @param bWait wait for the read instead of only checking
+	 */
+	bool finished( bool bWait );
+
+	/**
+	 * maps the oldest pending read, the data stays valid until unmap()
+	 * @return the pixels, bottom row first, or 0 on errors
+	 */
+	const unsigned char* map( int& width, int& height, Measurement::Timestamp& time );
+
+	/** unmaps the oldest read and frees its buffer */
+	void unmap();
+
+	/** frees the buffer of the oldest read without looking at the data */
+	void discard();
+
+	/** deletes the GL objects, pending reads are lost */
+	void release();
+
+protected:
+
+	struct Buffer
+	{
+		Buffer()
+			: buffer( 0 )
+			, fence( 0 )
+			, capacity( 0 )
+			, width( 0 )
+			, height( 0 )
+			, time( 0 )
+		{}
+
+		GLuint buffer;
+
+		/** GLsync of the read, 0 without fence support */
+		void* fence;
+
+		std::size_t capacity;
+		int width, height;
+		Measurement::Timestamp time;
+	};
+
+	/** deletes the fence of a buffer */
+	void deleteFence( Buffer& buffer );
+
+	std::vector< Buffer > m_buffers;
+
+	/** index of the oldest pending read */
+	unsigned m_oldest;
+	unsigned m_nPending;
+};
+
+} } // namespace Ubitrack::Drivers
+
+#endif
@@ -55,6 +55,10 @@ public:
 
 	virtual bool hasWaitingEvents();
 
+	/** may be replayed for the second eye with single-pass stereo */
+	virtual bool isEyeIndependent()
+	{ return true; }
+
 protected:
 
 	/**
@@ -30,18 +30,12 @@
 
 #include "PoseErrorVisualization.h"
 
-#ifdef HAVE_LAPACK
-
 #include <math.h>
-#include <boost/numeric/ublas/matrix_proxy.hpp>
-#include <boost/numeric/bindings/lapack/syev.hpp>
 #include <log4cpp/Category.hh>
 
 //static log4cpp::Category& logger( log4cpp::Category::getInstance( "Render.PoseErrorVisualization" ) );
 
 using namespace Ubitrack::Math;
-namespace ublas = boost::numeric::ublas;
-namespace lapack = boost::numeric::bindings::lapack;
 
 
 namespace Ubitrack { namespace Drivers {
@@ -64,6 +58,24 @@ void rotErrorJacobian( Math::Matrix< double, 3, 3 >& j, const Math::Vector< doub
 	j( 2, 2 ) = 0.0;
 }
 
+
+/**
+ * Computes j * c * j^T for the 3x3 block of a 6x6 covariance starting at offset
+ */
+void transformCovariance( Math::Matrix< double, 3, 3 >& result, const Math::Matrix< double, 3, 3 >& j,
+	const Math::Matrix< double, 6, 6 >& c, unsigned offset )
+{
+	double tmp[ 3 ][ 3 ];
+	for ( unsigned r = 0; r < 3; r++ )
+		for ( unsigned k = 0; k < 3; k++ )
+			tmp[ r ][ k ] = j( r, 0 ) * c( offset, offset + k ) + j( r, 1 ) * c( offset + 1, offset + k ) + j( r, 2 ) * c( offset + 2, offset + k );
+
+	// the result is symmetric
+	for ( unsigned r = 0; r < 3; r++ )
+		for ( unsigned k = r; k < 3; k++ )
+			result( r, k ) = result( k, r ) = tmp[ r ][ 0 ] * j( k, 0 ) + tmp[ r ][ 1 ] * j( k, 1 ) + tmp[ r ][ 2 ] * j( k, 2 );
+}
+
 } // anonymous namespace
 
 PoseErrorVisualization::PoseErrorVisualization( const std::string& name, boost::shared_ptr< Graph::UTQLSubgraph > subgraph,
@@ -106,32 +118,31 @@ void PoseErrorVisualization::draw3DContent( Measurement::Timestamp& t, int )
 	glLineWidth( 1 );
 	glEnable( GL_LINE_SMOOTH );
 
-	// position error
-	glColor3f( 0.8f, 0.8f, 0.0f );
-	m_posEllipsoid.draw();
-
-	// x-axis rotation error
+	// position error and x, y, z rotation errors in one draw call
+	m_batch.clear();
+	{
+		boost::mutex::scoped_lock l( m_poseLock );
+		m_batch.add( m_posEllipsoid, 0.8f, 0.8f, 0.0f );
+		m_batch.add( m_rotXEllipsoid, 0.8f, 0.0f, 0.0f );
+		m_batch.add( m_rotYEllipsoid, 0.0f, 0.8f, 0.0f );
+		m_batch.add( m_rotZEllipsoid, 0.0f, 0.0f, 0.8f );
+	}
+	m_batch.draw();
+
+	// rotation axes
 	glColor3f( 0.8f, 0.0f, 0.0f );
-	m_rotXEllipsoid.draw();
-
 	glBegin( GL_LINES );
 		glVertex3d( 0, 0, 0 );
 		glVertex3d( m_rotXEllipsoid.position()( 0 ), m_rotXEllipsoid.position()( 1 ), m_rotXEllipsoid.position()( 2 ) );
 	glEnd();
 
-	// y-axis rotation error
 	glColor3f( 0.0f, 0.8f, 0.0f );
-	m_rotYEllipsoid.draw();
-
 	glBegin( GL_LINES );
 		glVertex3d( 0, 0, 0 );
 		glVertex3d( m_rotYEllipsoid.position()( 0 ), m_rotYEllipsoid.position()( 1 ), m_rotYEllipsoid.position()( 2 ) );
 	glEnd();
 
-	// z-axis rotation error
 	glColor3f( 0.0f, 0.0f, 0.8f );
-	m_rotZEllipsoid.draw();
-
 	glBegin( GL_LINES );
 		glVertex3d( 0, 0, 0 );
 		glVertex3d( m_rotZEllipsoid.position()( 0 ), m_rotZEllipsoid.position()( 1 ), m_rotZEllipsoid.position()( 2 ) );
@@ -147,47 +158,39 @@ void PoseErrorVisualization::draw3DContent( Measurement::Timestamp& t, int )
 }
 
 
+void PoseErrorVisualization::glCleanup()
+{
+	m_batch.glCleanup();
+}
+
+
 void PoseErrorVisualization::receiveError( const Ubitrack::Measurement::ErrorPose& error )
 {
 	LOG4CPP_DEBUG( logger, "Received error pose" );
 	LOG4CPP_TRACE( logger, *error );
 
-	boost::mutex::scoped_lock l( m_poseLock );
+	const Math::Matrix< double, 6, 6 >& covariance( error->covariance() );
+	Matrix< double, 3, 3 > errors[ 4 ];
 
 	// rotate the position covariance into the target coordinate frame
 	Matrix< double, 3, 3 > j( ~error->rotation() );
-	Matrix< double, 3, 3 > tmp( ublas::prod( j, ublas::subrange( error->covariance(), 0, 3, 0, 3 ) ) );
-	Matrix< double, 3, 3 > posError( ublas::prod( tmp, ublas::trans( j ) ) );
-
-	LOG4CPP_TRACE( logger, "Position error: " << std::endl << posError );
-	m_posEllipsoid.setCovariance( posError );
-
-	// x rotation error
-	rotErrorJacobian( j, m_rotXEllipsoid.position() );
-	noalias( tmp ) = ublas::prod( j, ublas::subrange( error->covariance(), 3, 6, 3, 6 ) );
-	noalias( posError ) = ublas::prod( tmp, ublas::trans( j ) );
-
-	LOG4CPP_TRACE( logger, "X rotation error: " << std::endl << posError );
-	m_rotXEllipsoid.setCovariance( posError );
-
-	// y rotation error
-	rotErrorJacobian( j, m_rotYEllipsoid.position() );
-	noalias( tmp ) = ublas::prod( j, ublas::subrange( error->covariance(), 3, 6, 3, 6 ) );
-	noalias( posError ) = ublas::prod( tmp, ublas::trans( j ) );
-
-	LOG4CPP_TRACE( logger, "Y rotation error: " << std::endl << posError );
-	m_rotYEllipsoid.setCovariance( posError );
-
-	// z rotation error
-	rotErrorJacobian( j, m_rotZEllipsoid.position() );
-	noalias( tmp ) = ublas::prod( j, ublas::subrange( error->covariance(), 3, 6, 3, 6 ) );
-	noalias( posError ) = ublas::prod( tmp, ublas::trans( j ) );
-
-	LOG4CPP_TRACE( logger, "Z rotation error: " << std::endl << posError );
-	m_rotZEllipsoid.setCovariance( posError );
+	transformCovariance( errors[ 0 ], j, covariance, 0 );
+	LOG4CPP_TRACE( logger, "Position error: " << std::endl << errors[ 0 ] );
+
+	// x, y and z rotation error
+	ErrorEllipsoid* rotEllipsoids[ 3 ] = { &m_rotXEllipsoid, &m_rotYEllipsoid, &m_rotZEllipsoid };
+	for ( int i = 0; i < 3; i++ )
+	{
+		rotErrorJacobian( j, rotEllipsoids[ i ]->position() );
+		transformCovariance( errors[ i + 1 ], j, covariance, 3 );
+		LOG4CPP_TRACE( logger, "Rotation error " << i << ": " << std::endl << errors[ i + 1 ] );
+	}
+
+	// decompose all four together
+	ErrorEllipsoid* ellipsoids[ 4 ] = { &m_posEllipsoid, &m_rotXEllipsoid, &m_rotYEllipsoid, &m_rotZEllipsoid };
+	boost::mutex::scoped_lock l( m_poseLock );
+	ErrorEllipsoid::setCovariances( ellipsoids, errors, 4 );
 }
 
 
 } } // namespace Ubitrack::Drivers
-
-#endif // HAVE_LAPACK
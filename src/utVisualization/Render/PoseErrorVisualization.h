@@ -31,11 +31,8 @@
 #ifndef __PoseErrorVisualization_h_INCLUDED__
 #define __PoseErrorVisualization_h_INCLUDED__
 
-
-
-#ifdef HAVE_LAPACK
-
 #include "ErrorEllipsoid.h"
+#include "EllipsoidBatch.h"
 #include "TrackedObject.h"
 
 namespace Ubitrack { namespace Drivers {
@@ -62,6 +59,12 @@ public:
 	/** render the object */
 	virtual void draw3DContent( Measurement::Timestamp&, int );
 
+	virtual void glCleanup();
+
+	/** may be replayed for the second eye with single-pass stereo */
+	virtual bool isEyeIndependent()
+	{ return true; }
+
 protected:
 	/** receives error poses */
 	void receiveError( const Measurement::ErrorPose& error );
@@ -74,10 +77,12 @@ protected:
 	ErrorEllipsoid m_rotXEllipsoid;
 	ErrorEllipsoid m_rotYEllipsoid;
 	ErrorEllipsoid m_rotZEllipsoid;
+
+	/** draws the four ellipsoids */
+	EllipsoidBatch m_batch;
 };
 
 
 } } // namespace Ubitrack::Drivers
 
-#endif // HAVE_LAPACK
 #endif
@@ -30,18 +30,12 @@
 
 #include "PositionErrorVisualization.h"
 
-#ifdef HAVE_LAPACK
-
 #include <math.h>
-#include <boost/numeric/ublas/matrix_proxy.hpp>
-#include <boost/numeric/bindings/lapack/syev.hpp>
 #include <log4cpp/Category.hh>
 
 //static log4cpp::Category& logger( log4cpp::Category::getInstance( "Render.PositionErrorVisualization" ) );
 
 using namespace Ubitrack::Math;
-namespace ublas = boost::numeric::ublas;
-namespace lapack = boost::numeric::bindings::lapack;
 
 
 namespace Ubitrack { namespace Drivers {
@@ -68,8 +62,12 @@ void PositionErrorVisualization::draw3DContent( Measurement::Timestamp& t, int )
 	// set new state
 	glEnable( GL_CULL_FACE );
 
-	glColor3f( 0.3f, 0.9f, 0.9f );
-	m_posEllipsoid.draw();
+	m_batch.clear();
+	{
+		boost::mutex::scoped_lock l( m_poseLock );
+		m_batch.add( m_posEllipsoid, 0.3f, 0.9f, 0.9f );
+	}
+	m_batch.draw();
 
 	// restore old state
 	if ( !oldCullMode )
@@ -82,11 +80,16 @@ void PositionErrorVisualization::receiveError( const Ubitrack::Measurement::Erro
 	LOG4CPP_DEBUG( logger, "Received error position" );
 	LOG4CPP_TRACE( logger, error->value << ", " << error->covariance );
 
+	boost::mutex::scoped_lock l( m_poseLock );
 	m_posEllipsoid.setPosition( error->value );
 	m_posEllipsoid.setCovariance( error->covariance );
 }
 
 
-} } // namespace Ubitrack::Drivers
+void PositionErrorVisualization::glCleanup()
+{
+	m_batch.glCleanup();
+}
+
 
-#endif // HAVE_LAPACK
+} } // namespace Ubitrack::Drivers
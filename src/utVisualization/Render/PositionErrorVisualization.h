@@ -31,12 +31,9 @@
 #ifndef __PositionErrorVisualization_h_INCLUDED__
 #define __PositionErrorVisualization_h_INCLUDED__
 
-
-
-#ifdef HAVE_LAPACK
-
 #include "TrackedObject.h"
 #include "ErrorEllipsoid.h"
+#include "EllipsoidBatch.h"
 
 namespace Ubitrack { namespace Drivers {
 
@@ -62,6 +59,12 @@ public:
 	/** render the object */
 	virtual void draw3DContent( Measurement::Timestamp&, int );
 
+	virtual void glCleanup();
+
+	/** may be replayed for the second eye with single-pass stereo */
+	virtual bool isEyeIndependent()
+	{ return true; }
+
 protected:
 	/** receives error poses */
 	void receiveError( const Measurement::ErrorPosition& error );
@@ -71,10 +74,10 @@ protected:
 
 	/* the ellipsoid */
 	ErrorEllipsoid m_posEllipsoid;
+	EllipsoidBatch m_batch;
 };
 
 
 } } // namespace Ubitrack::Drivers
 
-#endif // HAVE_LAPACK
 #endif
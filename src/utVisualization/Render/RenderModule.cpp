@@ -39,12 +39,12 @@ log4cpp::Category& loggerEvents( log4cpp::Category::getInstance( "Ubitrack.Event
 	#include "BackgroundImage.h"
 	#include "ZBufferOutput.h"
 	#include "ImageOutput.h"
+	#include "VideoRecorder.h"
 #endif
 
-#ifdef HAVE_LAPACK
-	#include "PoseErrorVisualization.h"
-	#include "PositionErrorVisualization.h"
-#endif
+#include "PoseErrorVisualization.h"
+#include "PositionErrorVisualization.h"
+#include "ErrorPositionListVisualization.h"
 
 #ifdef HAVE_COIN
 	#include "InventorObject.h"
@@ -58,6 +58,7 @@ log4cpp::Category& loggerEvents( log4cpp::Category::getInstance( "Ubitrack.Event
 #include "Intrinsics.h"
 #include "CameraPose.h"
 #include "ButtonOutput.h"
+#include "SharedMemoryOutput.h"
 #include "DropShadow.h"
 #include "WorldFrame.h"
 #include "Skybox.h"
@@ -68,6 +69,8 @@ log4cpp::Category& loggerEvents( log4cpp::Category::getInstance( "Ubitrack.Event
 #include "Cross2D.h"
 #include "Fullscreen.h"
 #include "StereoRendering.h"
+#include "FrameLatency.h"
+#include "LateReprojection.h"
 
 #include <utUtil/Exception.h>
 #include <utUtil/OS.h>
@@ -97,6 +100,7 @@ std::deque< VirtualCamera* > g_setup;
 std::map< std::string, int > g_names;
 std::map< int, VirtualCamera* > g_modules;
 std::set< VirtualObject* > g_cleanup_components;
+std::set< VirtualCamera* > g_cleanup_modules;
 boost::scoped_ptr< boost::thread > g_glutThread;
 boost::mutex g_globalMutex;
 boost::condition g_setup_performed;
@@ -181,6 +185,18 @@ void g_mainloop()
 			g_cleanup_done.notify_all();
 			LOG4CPP_DEBUG( logger, "g_mainloop(): Cleaning done" );
 		}
+
+		// modules being destroyed release their own GL objects before their window is destroyed below
+		if ( ! g_cleanup_modules.empty() )
+		{
+			while ( ! g_cleanup_modules.empty() )
+			{
+				VirtualCamera* module = *( g_cleanup_modules.begin() );
+				module->glCleanup();
+				g_cleanup_modules.erase( module );
+			}
+			g_cleanup_done.notify_all();
+		}
 		
 		// check
 		// - if a redraw is needed for any window
@@ -439,14 +455,14 @@ VirtualCamera::VirtualCamera( const VirtualCameraKey& key, boost::shared_ptr< Gr
 	, m_far(key.m_far)
 	, m_winHandle(0)
 	, m_redraw(1)
-	, m_doSync(0)
+	, m_doSync(key.m_vsync)
 	, m_parity(0)
 	, m_info(0)
 	, m_lasttime(0)
 	, m_lastframe(0)
 	, m_fps(0)
 	, m_lastRedrawTime(0)
-	, m_vsync()
+	, m_vsync(key.m_fps)
 	, m_stereoRenderPasses( stereoRenderNone )
 	, m_isSetupComplete(false)
 {
@@ -500,6 +516,15 @@ VirtualCamera::~VirtualCamera()
 		g_modules[ m_winHandle ] = 0;
 		g_names.erase( m_moduleKey );
 
+		// let the GL thread delete the objects of this module while its window still exists
+		if ( g_glutThread && m_winHandle )
+		{
+			g_cleanup_modules.insert( this );
+			g_continue.notify_all();
+			while ( g_cleanup_modules.find( this ) != g_cleanup_modules.end() )
+				g_cleanup_done.timed_wait( lock, boost::posix_time::milliseconds( 25 ) );
+		}
+
 		// kill thread if this was the last window
 		if ( g_names.empty() ) {
 			bKillThread = true;
@@ -522,6 +547,18 @@ VirtualCamera::~VirtualCamera()
 }
 
 
+void VirtualCamera::glCleanup()
+{
+	if ( m_stereoLists.empty() )
+		return;
+
+	glutSetWindow( m_winHandle );
+	for ( std::size_t i = 0; i < m_stereoLists.size(); i++ )
+		glDeleteLists( m_stereoLists[ i ], 1 );
+	m_stereoLists.clear();
+}
+
+
 void VirtualCamera::keyboard( unsigned char key, int x, int y )
 {
 	LOG4CPP_DEBUG( logger, "keyboard(): " << key << ", " << x << ", " << y );
@@ -539,7 +576,7 @@ void VirtualCamera::keyboard( unsigned char key, int x, int y )
 				#endif
 				break;
 			case 'i': m_info = !m_info; break;
-			case 'v': m_doSync = !m_doSync; break;
+			case 'v': m_doSync = m_doSync ? VideoSync::syncOff : ( m_moduleKey.m_vsync ? m_moduleKey.m_vsync : VideoSync::syncOn ); break;
 			case 's': m_parity = !m_parity; break;
 			// case 'q': delete this; break;
 		}
@@ -570,6 +607,72 @@ Math::Vector< double, 2 > VirtualCamera::getLastMousePos() {
 
 
 
+/** draws the first eye, recording runs of eye-independent components in display lists */
+void VirtualCamera::recordFirstEye( ComponentList& objects, Measurement::Timestamp& t )
+{
+	// every run of consecutive eye-independent components goes into one display list,
+	// the eye-dependent ones (projection, stereo separation, outputs, ...) are drawn directly
+	std::size_t list = 0;
+	bool bRecording = false;
+	for ( ComponentList::iterator i = objects.begin(); i != objects.end(); i++ )
+	{
+		if ( (*i)->replayForSecondEye() && !bRecording )
+		{
+			if ( list == m_stereoLists.size() )
+				m_stereoLists.push_back( glGenLists( 1 ) );
+			glNewList( m_stereoLists[ list ], GL_COMPILE_AND_EXECUTE );
+			bRecording = true;
+		}
+		else if ( !(*i)->replayForSecondEye() && bRecording )
+		{
+			glEndList();
+			bRecording = false;
+			list++;
+		}
+
+		try
+		{
+			(*i)->draw( t, 0 );
+		}
+		catch( const Util::Exception& e )
+		{
+			LOG4CPP_NOTICE( loggerEvents, "display(): Exception in main loop from component " << (*i)->getName() << ": " << e );
+		}
+	}
+
+	if ( bRecording )
+		glEndList();
+}
+
+
+/** draws the second eye, replaying the display lists recorded for the first eye */
+void VirtualCamera::replaySecondEye( ComponentList& objects, Measurement::Timestamp& t )
+{
+	std::size_t list = 0;
+	bool bReplayed = false;
+	for ( ComponentList::iterator i = objects.begin(); i != objects.end(); i++ )
+	{
+		if ( (*i)->replayForSecondEye() )
+		{
+			if ( !bReplayed )
+				glCallList( m_stereoLists[ list++ ] );
+			bReplayed = true;
+			continue;
+		}
+		bReplayed = false;
+
+		try
+		{
+			(*i)->draw( t, 1 );
+		}
+		catch( const Util::Exception& e )
+		{
+			LOG4CPP_NOTICE( loggerEvents, "display(): Exception in main loop from component " << (*i)->getName() << ": " << e );
+		}
+	}
+}
+
+
 void VirtualCamera::display()
 {
 	m_lastRedrawTime = Measurement::now();
@@ -581,13 +684,16 @@ void VirtualCamera::display()
 	{
 		// compute parity for frame sequential stereo
 		int retrace  = m_vsync.getRetrace();
-		parity = (retrace%2 == m_parity); // Nick: This seems to be broken on linux
+		// with GLX_OML_sync_control, this is the retrace the frame is scheduled for
+		parity = (retrace%2 == m_parity);
 	}
 
 	// predict a little bit (only for pull inputs)
 	Measurement::Timestamp imageTime( Measurement::now() + 5000000L );
 
-	// clear buffers
+	// clear buffers, the viewport may have been restricted to one eye by the stereo rendering
+	glDisable( GL_SCISSOR_TEST );
+	glViewport( 0, 0, m_width, m_height );
 	glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
 	glClear( GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT );
 
@@ -612,7 +718,10 @@ void VirtualCamera::display()
 
 	// iterate over all components (already sorted by priority thanks to std::map)
 	ComponentList objects = getAllComponents();
-	for ( ComponentList::iterator i = objects.begin(); i != objects.end(); i++ )
+	bool bSinglePass = m_stereoRenderPasses == stereoRenderSingle && m_moduleKey.m_bStereoSinglePass;
+	if ( bSinglePass )
+		recordFirstEye( objects, imageTime );
+	else for ( ComponentList::iterator i = objects.begin(); i != objects.end(); i++ )
 	{
 		try
 		{
@@ -628,11 +737,14 @@ void VirtualCamera::display()
 	{
 		// 2nd rendering pass for stereo separation when both eyes are to be rendered into a single image
 		// Only makes sense with color mask stereo separation.
+		glDisable( GL_SCISSOR_TEST ); // Clear the depth of both eyes for packed stereo formats.
 		glClear( GL_DEPTH_BUFFER_BIT ); // Let color buffer intact, only clear depth information.
 		glMatrixMode( GL_MODELVIEW );
 		glLoadIdentity(); // Reset transformation stack.
 
-		for ( ComponentList::iterator i = objects.begin(); i != objects.end(); i++ )
+		if ( bSinglePass )
+			replaySecondEye( objects, imageTime );
+		else for ( ComponentList::iterator i = objects.begin(); i != objects.end(); i++ )
 		{
 			try
 			{        
@@ -645,13 +757,44 @@ void VirtualCamera::display()
 		}
 	}
 
+	// restore the whole-window viewport and let components read the finished frame
+	glDisable( GL_SCISSOR_TEST );
+	glViewport( 0, 0, m_width, m_height );
+	glColorMask( GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE );
+
+	for ( ComponentList::iterator i = objects.begin(); i != objects.end(); i++ )
+	{
+		try
+		{
+			(*i)->drawFinished( imageTime, parity );
+		}
+		catch( const Util::Exception& e )
+		{
+			LOG4CPP_NOTICE( loggerEvents, "display(): Exception in main loop from component " << (*i)->getName() << ": " << e );
+		}
+	}
+
+	// source times of the measurements shown in this frame, after late reprojection may have sampled newer ones
+	m_frameTiming = FrameTiming();
+	m_frameTiming.renderStart = m_lastRedrawTime;
+	for ( ComponentList::iterator i = objects.begin(); i != objects.end(); i++ )
+	{
+		Measurement::Timestamp inputTime = (*i)->getTime();
+		if ( !inputTime )
+			continue;
+		if ( !m_frameTiming.oldestInput || inputTime < m_frameTiming.oldestInput )
+			m_frameTiming.oldestInput = inputTime;
+		if ( inputTime > m_frameTiming.newestInput )
+			m_frameTiming.newestInput = inputTime;
+	}
+
 	// print info string
 	if (m_info) {
   
 		std::ostringstream text;
 		text << std::fixed << std::showpoint << std::setprecision(2);
 		text << "FPS: " << m_fps;
-		text << " VSync: " << (m_doSync?"on":"off");
+		text << " VSync: " << (m_doSync==VideoSync::syncAdaptive?"adaptive":m_doSync?"on":"off");
 
 		glMatrixMode( GL_MODELVIEW );
 		glLoadIdentity();
@@ -679,12 +822,28 @@ void VirtualCamera::display()
 		glEnable( GL_LIGHTING );
 	}
 
-	// wait for the screen refresh
-	m_vsync.wait( m_doSync );
-	
-	// put current buffer into display
+	m_frameTiming.renderEnd = Measurement::now();
+
+	// wait for the screen refresh and put current buffer into display
 	LOG4CPP_TRACE( logger, "display(): Swapping buffers.." );
-	glutSwapBuffers();
+	m_vsync.swap( m_doSync, m_stereoRenderPasses == stereoRenderSequential );
+	LOG4CPP_TRACE( logger, "display(): Frame presented at " << m_vsync.getLastPresentTime()
+		<< ( m_vsync.isPresentTimeMeasured() ? " (reported by display)" : " (swap returned)" ) );
+
+	m_frameTiming.swapEnd = Measurement::now();
+	m_frameTiming.present = m_vsync.getLastPresentTime();
+	m_frameTiming.bPresentMeasured = m_vsync.isPresentTimeMeasured();
+	for ( ComponentList::iterator i = objects.begin(); i != objects.end(); i++ )
+	{
+		try
+		{
+			(*i)->framePresented( m_frameTiming );
+		}
+		catch( const Util::Exception& e )
+		{
+			LOG4CPP_NOTICE( loggerEvents, "display(): Exception in main loop from component " << (*i)->getName() << ": " << e );
+		}
+	}
 }
 
 
@@ -743,23 +902,30 @@ boost::shared_ptr< VirtualObject > VirtualCamera::createComponent( const std::st
 		return boost::shared_ptr< VirtualObject >( new StereoRendering( name, pConfig, key, pModule ) );
 	else if ( type == "Cross2D" )
 		return boost::shared_ptr< VirtualObject >( new Cross2D( name, pConfig, key, pModule ) );
+	else if ( type == "FrameLatency" )
+		return boost::shared_ptr< VirtualObject >( new FrameLatency( name, pConfig, key, pModule ) );
+	else if ( type == "LateReprojection" )
+		return boost::shared_ptr< VirtualObject >( new LateReprojection( name, pConfig, key, pModule ) );
+	else if ( type == "PoseErrorVisualization" )
+		return boost::shared_ptr< VirtualObject >( new PoseErrorVisualization( name, pConfig, key, pModule ) );
+	else if ( type == "PositionErrorVisualization" )
+		return boost::shared_ptr< VirtualObject >( new PositionErrorVisualization( name, pConfig, key, pModule ) );
+	else if ( type == "ErrorPositionListVisualization" )
+		return boost::shared_ptr< VirtualObject >( new ErrorPositionListVisualization( name, pConfig, key, pModule ) );
+	else if ( type == "SharedMemoryOutput" )
+		return boost::shared_ptr< VirtualObject >( new SharedMemoryOutput( name, pConfig, key, pModule ) );
 
 	#ifdef HAVE_OPENCV
 	else if ( type == "ImageOutput" )
 		return boost::shared_ptr< VirtualObject >( new ImageOutput( name, pConfig, key, pModule ) );
+	else if ( type == "VideoRecorder" )
+		return boost::shared_ptr< VirtualObject >( new VideoRecorder( name, pConfig, key, pModule ) );
 	else if ( type == "ZBufferOutput" )
 		return boost::shared_ptr< VirtualObject >( new ZBufferOutput( name, pConfig, key, pModule ) );
 	else if ( type == "BackgroundImage" )
 		return boost::shared_ptr< VirtualObject >( new BackgroundImage( name, pConfig, key, pModule ) );
 	#endif
 
-	#ifdef HAVE_LAPACK
-	else if ( type == "PoseErrorVisualization" )
-		return boost::shared_ptr< VirtualObject >( new PoseErrorVisualization( name, pConfig, key, pModule ) );
-	else if ( type == "PositionErrorVisualization" )
-		return boost::shared_ptr< VirtualObject >( new PositionErrorVisualization( name, pConfig, key, pModule ) );
-	#endif
-
     #ifdef HAVE_COIN
 	else if ( type == "InventorObject" )
 		return boost::shared_ptr< VirtualObject >( new InventorObject( name, pConfig, key, pModule ) );
@@ -792,16 +958,18 @@ UBITRACK_REGISTER_COMPONENT( ComponentFactory* const cf )
 	renderComponents.push_back( "StereoSeparation" );
 	renderComponents.push_back( "StereoRendering" );
 	renderComponents.push_back( "Cross2D" );
+	renderComponents.push_back( "FrameLatency" );
+	renderComponents.push_back( "LateReprojection" );
+	renderComponents.push_back( "PoseErrorVisualization" );
+	renderComponents.push_back( "PositionErrorVisualization" );
+	renderComponents.push_back( "ErrorPositionListVisualization" );
+	renderComponents.push_back( "SharedMemoryOutput" );
 	#ifdef HAVE_OPENCV
 		renderComponents.push_back( "ImageOutput" );
+		renderComponents.push_back( "VideoRecorder" );
 		renderComponents.push_back( "ZBufferOutput" );
 		renderComponents.push_back( "BackgroundImage" );
 	#endif
-
-	#ifdef HAVE_LAPACK
-		renderComponents.push_back( "PoseErrorVisualization" );
-		renderComponents.push_back( "PositionErrorVisualization" );
-	#endif
 	#ifdef HAVE_COIN
 		renderComponents.push_back( "InventorObject" );
 	#endif
@@ -89,6 +89,7 @@
 
 #include <string>
 #include <map>
+#include <vector>
 #include <cstdlib>
 
 #include <boost/thread.hpp>
@@ -147,6 +148,9 @@ public:
 		, m_bFullscreen( false )
 		, m_monitorPoint( Math::Vector< int, 2 >( 0, 0 ) )
 		, m_bEnableStencil( false )
+		, m_bStereoSinglePass( false )
+		, m_vsync( VideoSync::syncOff )
+		, m_fps( 0 )
 	{
 		// some sane defaults
 		m_fov  = 30;
@@ -169,9 +173,20 @@ public:
 			cameraNode->getAttributeData( "virtualCameraMonitorX", m_monitorPoint( 0 ) );
 			cameraNode->getAttributeData( "virtualCameraMonitorY", m_monitorPoint( 1 ) );
 			m_sGameMode = cameraNode->getAttributeString( "virtualCameraGameMode" );
+
+			// initial vsync mode (can be toggled with 'v') and software frame pacing
+			std::string sVSync = cameraNode->getAttributeString( "virtualCameraVSync" );
+			if ( sVSync == "on" )
+				m_vsync = VideoSync::syncOn;
+			else if ( sVSync == "adaptive" )
+				m_vsync = VideoSync::syncAdaptive;
+			cameraNode->getAttributeData( "virtualCameraFps", m_fps );
 			
 			// normally handlede by stereorendering, but we need it at module initialization
 			m_bEnableStencil = cameraNode->getAttributeString( "stereoType" ) == "lineSequential";
+
+			// record the first eye and replay it for the second one, see VirtualObject::isEyeIndependent()
+			m_bStereoSinglePass = cameraNode->getAttributeString( "stereoSinglePass" ) == "true";
 		}
 	}
 
@@ -184,6 +199,11 @@ public:
 	std::string m_sGameMode;
 	
 	bool m_bEnableStencil;
+	
+	bool m_bStereoSinglePass;
+
+	int m_vsync;
+	int m_fps;
 };
 
 
@@ -208,6 +228,7 @@ class VirtualObjectKey
 		
 			std::string& dfclass = subgraph->m_DataflowClass;
 			
+			if ( dfclass == "LateReprojection" ) m_priority =   5;
 			if ( dfclass == "Intrinsics"       ) m_priority =  10;
 			if ( dfclass == "CameraPose"       ) m_priority =  10;
 			if ( dfclass == "Projection"       ) m_priority =  10;
@@ -220,8 +241,11 @@ class VirtualObjectKey
 			if ( dfclass == "StereoSeparation" ) m_priority =  50;
 			if ( dfclass == "DropShadow"       ) m_priority = 150;
 			if ( dfclass == "ImageOutput"      ) m_priority = 200;
+			if ( dfclass == "VideoRecorder"    ) m_priority = 200;
+			if ( dfclass == "SharedMemoryOutput" ) m_priority = 200;
 			if ( dfclass == "ButtonOutput"     ) m_priority = 200;
 			if ( dfclass == "ZBufferOutput"    ) m_priority = 200;
+			if ( dfclass == "FrameLatency"     ) m_priority = 200;
 		}
 
 		// compare priorities first, then string contents
@@ -237,6 +261,33 @@ class VirtualObjectKey
 };
 
 
+/**
+ * @ingroup driver_components
+ * Timing of one rendered frame, from the measurements it shows to its presentation.
+ * All times are Ubitrack timestamps (ns), 0 = unknown.
+ */
+struct FrameTiming
+{
+	FrameTiming()
+		: oldestInput( 0 ), newestInput( 0 ), renderStart( 0 ), renderEnd( 0 ), swapEnd( 0 ), present( 0 )
+		, bPresentMeasured( false )
+	{}
+
+	/** oldest and newest source timestamp of the measurements used in the frame */
+	Measurement::Timestamp oldestInput;
+	Measurement::Timestamp newestInput;
+
+	/** start and end of drawing, return of the buffer swap */
+	Measurement::Timestamp renderStart;
+	Measurement::Timestamp renderEnd;
+	Measurement::Timestamp swapEnd;
+
+	/** time the frame was shown, measured by the display if bPresentMeasured, else equal to swapEnd */
+	Measurement::Timestamp present;
+	bool bPresentMeasured;
+};
+
+
 /**
  * @ingroup driver_components
  * Module for virtual OpenGL camera.
@@ -284,6 +335,9 @@ public:
 	/** redraw GL context, called from main GL thread _only_ */
 	void redraw();
 
+	/** deletes the GL objects of the module, called from main GL thread _only_ before the window is destroyed */
+	void glCleanup();
+
 	/** isSetupComplete ? **/
 	bool isSetupComplete();
 	
@@ -303,9 +357,25 @@ public:
 	void setStereoRenderPasses( StereoRenderPasses srp )
 	{ m_stereoRenderPasses = srp; }
 
+	/** how stereo is rendered */
+	StereoRenderPasses getStereoRenderPasses() const
+	{ return m_stereoRenderPasses; }
+
 
 protected:
 
+	/** draws the first eye, recording runs of eye-independent components in display lists */
+	void recordFirstEye( ComponentList& objects, Measurement::Timestamp& t );
+
+	/** draws the second eye, replaying the display lists recorded for the first eye */
+	void replaySecondEye( ComponentList& objects, Measurement::Timestamp& t );
+
+	/** timing of the last frame */
+	FrameTiming m_frameTiming;
+
+	/** display lists for single-pass stereo, reused every frame */
+	std::vector< GLuint > m_stereoLists;
+
 	int m_winHandle, m_redraw, m_doSync, m_parity, m_info, m_lasttime, m_lastframe;
 	unsigned char m_lastKey;
 	Math::Vector< double, 2 > m_lastMousePos;
@@ -370,11 +440,38 @@ public:
 	virtual void draw( Measurement::Timestamp& t, int parity )
 	{}
 
+	/**
+	 * called after all render passes of a frame, before the info text is drawn and the buffers
+	 * are swapped. The viewport covers the whole window again, so both eyes can be read back.
+	 */
+	virtual void drawFinished( Measurement::Timestamp& t, int parity )
+	{}
+
+	/** called after the buffers of a frame have been swapped */
+	virtual void framePresented( const FrameTiming& timing )
+	{}
+
 	/** check if there are events waiting for this component */
 	virtual bool hasWaitingEvents( )
 	{
 		return false;
 	}
+
+	/**
+	 * Components whose draw() does not depend on the eye and only issues GL commands that can
+	 * be compiled into a display list (no readbacks, no display lists of their own) may return
+	 * true. With single-pass stereo, they are then drawn once and replayed for the second eye.
+	 */
+	virtual bool isEyeIndependent()
+	{
+		return false;
+	}
+
+	/** true if the rendering of this object for the first eye may be replayed for the second one */
+	bool replayForSecondEye()
+	{
+		return m_stereoEye == stereoEyeAll && isEyeIndependent();
+	}
 	
 	Measurement::Timestamp getTime()
 	{ return m_lastUpdateTime; }
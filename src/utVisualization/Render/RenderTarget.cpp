@@ -0,0 +1,159 @@
+/*
+ * Ubitrack - Library for Ubiquitous Tracking
+ * Copyright 2006, Technische Universitaet Muenchen, and individual
+ * contributors as indicated by the @authors tag. See the
+ * copyright.txt in the distribution for a full listing of individual
+ * contributors.
+ *
+ * This is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this software; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA, or see the FSF site: http://www.fsf.org.
+ */
+
+/**
+ * @file
+ * Implementation of the offscreen render target
+ */
+
+#ifdef HAVE_GLEW
+	#include "GL/glew.h"
+#endif
+
+#include "RenderTarget.h"
+
+namespace Ubitrack { namespace Drivers {
+
+RenderTarget::RenderTarget()
+	: m_framebuffer( 0 )
+	, m_texture( 0 )
+	, m_depth( 0 )
+	, m_width( 0 )
+	, m_height( 0 )
+	, m_colorFormat( 0 )
+{
+}
+
+#ifdef HAVE_GLEW
+
+bool RenderTarget::supported()
+{
+	return GLEW_VERSION_3_0 || GLEW_ARB_framebuffer_object;
+}
+
+
+bool RenderTarget::resize( int width, int height, GLenum colorFormat )
+{
+	if ( m_framebuffer && width == m_width && height == m_height && colorFormat == m_colorFormat )
+		return true;
+
+	if ( !m_framebuffer )
+	{
+		glGenFramebuffers( 1, &m_framebuffer );
+		glGenTextures( 1, &m_texture );
+		glGenRenderbuffers( 1, &m_depth );
+	}
+
+	m_width = width;
+	m_height = height;
+	m_colorFormat = colorFormat;
+
+	GLint oldTexture = 0;
+	glGetIntegerv( GL_TEXTURE_BINDING_2D, &oldTexture );
+	glBindTexture( GL_TEXTURE_2D, m_texture );
+	glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST );
+	glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST );
+	glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE );
+	glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE );
+	glTexImage2D( GL_TEXTURE_2D, 0, colorFormat, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, 0 );
+	glBindTexture( GL_TEXTURE_2D, oldTexture );
+
+	glBindRenderbuffer( GL_RENDERBUFFER, m_depth );
+	glRenderbufferStorage( GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height );
+	glBindRenderbuffer( GL_RENDERBUFFER, 0 );
+
+	GLint oldFramebuffer = 0;
+	glGetIntegerv( GL_FRAMEBUFFER_BINDING, &oldFramebuffer );
+	glBindFramebuffer( GL_FRAMEBUFFER, m_framebuffer );
+	glFramebufferTexture2D( GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, m_texture, 0 );
+	glFramebufferRenderbuffer( GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, m_depth );
+	GLenum status = glCheckFramebufferStatus( GL_FRAMEBUFFER );
+	glBindFramebuffer( GL_FRAMEBUFFER, oldFramebuffer );
+
+	LOG4CPP_DEBUG( logger, "Render target resized to " << width << "x" << height << ", status " << status );
+	if ( status != GL_FRAMEBUFFER_COMPLETE )
+	{
+		LOG4CPP_ERROR( logger, "Incomplete framebuffer object: " << status );
+		return false;
+	}
+	return true;
+}
+
+
+void RenderTarget::bind()
+{
+	glBindFramebuffer( GL_FRAMEBUFFER, m_framebuffer );
+	glViewport( 0, 0, m_width, m_height );
+}
+
+
+void RenderTarget::unbind()
+{
+	glBindFramebuffer( GL_FRAMEBUFFER, 0 );
+}
+
+
+void RenderTarget::release()
+{
+	if ( !m_framebuffer )
+		return;
+
+	glDeleteFramebuffers( 1, &m_framebuffer );
+	glDeleteTextures( 1, &m_texture );
+	glDeleteRenderbuffers( 1, &m_depth );
+	m_framebuffer = m_texture = m_depth = 0;
+	m_width = m_height = 0;
+}
+
+#else // HAVE_GLEW
+
+bool RenderTarget::supported()
+{
+	return false;
+}
+
+
+bool RenderTarget::resize( int, int, GLenum )
+{
+	LOG4CPP_ERROR( logger, "Render targets require the render module to be compiled with GLEW" );
+	return false;
+}
+
+
+void RenderTarget::bind()
+{
+}
+
+
+void RenderTarget::unbind()
+{
+}
+
+
+void RenderTarget::release()
+{
+}
+
+#endif // HAVE_GLEW
+
+} } // namespace Ubitrack::Drivers
@@ -0,0 +1,90 @@
+/*
+ * Ubitrack - Library for Ubiquitous Tracking
+ * Copyright 2006, Technische Universitaet Muenchen, and individual
+ * contributors as indicated by the @authors tag. See the
+ * copyright.txt in the distribution for a full listing of individual
+ * contributors.
+ *
+ * This is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this software; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA, or see the FSF site: http://www.fsf.org.
+ */
+
+/**
+ * @file
+ * Offscreen render target used by the render components
+ *
+ * Files using this class have to include GL/glew.h before any other GL header.
+ */
+
+#ifndef __RenderTarget_h_INCLUDED__
+#define __RenderTarget_h_INCLUDED__
+
+#include "RenderModule.h"
+
+namespace Ubitrack { namespace Drivers {
+
+/**
+ * Framebuffer object with a color texture and a depth renderbuffer.
+ * All methods must be called on the GL thread. The GL objects are not deleted by the
+ * destructor, call release() from glCleanup() instead.
+ * Requires GLEW and OpenGL 3.0 or GL_ARB_framebuffer_object.
+ */
+class RenderTarget
+{
+public:
+
+	RenderTarget();
+
+	/** checks whether the current GL context supports framebuffer objects */
+	static bool supported();
+
+	/**
+	 * (re-)allocates the target if its size or color format differs
+	 * @return false if the framebuffer is incomplete
+	 */
+	bool resize( int width, int height, GLenum colorFormat = GL_RGBA8 );
+
+	/** renders into this target, setting the viewport to its size */
+	void bind();
+
+	/** renders into the window again, the viewport is left unchanged */
+	static void unbind();
+
+	/** deletes the GL objects */
+	void release();
+
+	/** color texture of the target */
+	GLuint texture() const
+	{ return m_texture; }
+
+	int width() const
+	{ return m_width; }
+
+	int height() const
+	{ return m_height; }
+
+protected:
+
+	GLuint m_framebuffer;
+	GLuint m_texture;
+	GLuint m_depth;
+
+	int m_width, m_height;
+	GLenum m_colorFormat;
+};
+
+} } // namespace Ubitrack::Drivers
+
+#endif
@@ -0,0 +1,154 @@
+/*
+ * Ubitrack - Library for Ubiquitous Tracking
+ * Copyright 2006, Technische Universitaet Muenchen, and individual
+ * contributors as indicated by the @authors tag. See the
+ * copyright.txt in the distribution for a full listing of individual
+ * contributors.
+ *
+ * This is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this software; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA, or see the FSF site: http://www.fsf.org.
+ */
+
+/**
+ * @file
+ * Implementation of the GLSL helper functions
+ */
+
+#ifdef HAVE_GLEW
+	#include "GL/glew.h"
+#endif
+
+#include "Shader.h"
+
+#include <vector>
+
+namespace Ubitrack { namespace Drivers {
+
+#ifdef HAVE_GLEW
+
+namespace {
+
+/** compiles a single shader stage, returns 0 on error */
+GLuint compileShader( GLenum type, const char* source )
+{
+	GLuint shader = glCreateShader( type );
+	glShaderSource( shader, 1, &source, 0 );
+	glCompileShader( shader );
+
+	GLint status = GL_FALSE;
+	glGetShaderiv( shader, GL_COMPILE_STATUS, &status );
+	if ( status != GL_TRUE )
+	{
+		GLint length = 0;
+		glGetShaderiv( shader, GL_INFO_LOG_LENGTH, &length );
+		std::vector< char > log( length + 1, 0 );
+		glGetShaderInfoLog( shader, length, 0, &log[ 0 ] );
+		LOG4CPP_ERROR( logger, "Error compiling " << ( type == GL_VERTEX_SHADER ? "vertex" : "fragment" ) << " shader: " << &log[ 0 ] );
+
+		glDeleteShader( shader );
+		return 0;
+	}
+
+	return shader;
+}
+
+} // anonymous namespace
+
+
+bool shadersSupported()
+{
+	return GLEW_VERSION_2_0 != 0;
+}
+
+
+GLuint compileShaderProgram( const char* vertexSource, const char* fragmentSource )
+{
+	if ( !shadersSupported() )
+	{
+		LOG4CPP_ERROR( logger, "GLSL programs are not supported by the OpenGL implementation" );
+		return 0;
+	}
+
+	GLuint vertexShader = 0;
+	if ( vertexSource && !( vertexShader = compileShader( GL_VERTEX_SHADER, vertexSource ) ) )
+		return 0;
+
+	GLuint fragmentShader = compileShader( GL_FRAGMENT_SHADER, fragmentSource );
+	if ( !fragmentShader )
+	{
+		if ( vertexShader )
+			glDeleteShader( vertexShader );
+		return 0;
+	}
+
+	GLuint program = glCreateProgram();
+	if ( vertexShader )
+		glAttachShader( program, vertexShader );
+	glAttachShader( program, fragmentShader );
+	glLinkProgram( program );
+
+	// the shaders are kept alive by the program until it is deleted
+	if ( vertexShader )
+		glDeleteShader( vertexShader );
+	glDeleteShader( fragmentShader );
+
+	GLint status = GL_FALSE;
+	glGetProgramiv( program, GL_LINK_STATUS, &status );
+	if ( status != GL_TRUE )
+	{
+		GLint length = 0;
+		glGetProgramiv( program, GL_INFO_LOG_LENGTH, &length );
+		std::vector< char > log( length + 1, 0 );
+		glGetProgramInfoLog( program, length, 0, &log[ 0 ] );
+		LOG4CPP_ERROR( logger, "Error linking shader program: " << &log[ 0 ] );
+
+		glDeleteProgram( program );
+		return 0;
+	}
+
+	return program;
+}
+
+
+void deleteShaderProgram( GLuint& program )
+{
+	if ( program )
+		glDeleteProgram( program );
+	program = 0;
+}
+
+#else // HAVE_GLEW
+
+bool shadersSupported()
+{
+	return false;
+}
+
+
+GLuint compileShaderProgram( const char*, const char* )
+{
+	LOG4CPP_ERROR( logger, "GLSL programs require the render module to be compiled with GLEW" );
+	return 0;
+}
+
+
+void deleteShaderProgram( GLuint& program )
+{
+	program = 0;
+}
+
+#endif // HAVE_GLEW
+
+} } // namespace Ubitrack::Drivers
@@ -0,0 +1,58 @@
+/*
+ * Ubitrack - Library for Ubiquitous Tracking
+ * Copyright 2006, Technische Universitaet Muenchen, and individual
+ * contributors as indicated by the @authors tag. See the
+ * copyright.txt in the distribution for a full listing of individual
+ * contributors.
+ *
+ * This is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this software; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA, or see the FSF site: http://www.fsf.org.
+ */
+
+/**
+ * @file
+ * Helper functions for GLSL shader programs used by the render components
+ *
+ * Files using these functions have to include GL/glew.h before any other GL header.
+ */
+
+#ifndef __Shader_h_INCLUDED__
+#define __Shader_h_INCLUDED__
+
+#include "RenderModule.h"
+
+namespace Ubitrack { namespace Drivers {
+
+/**
+ * Checks whether the current GL context supports GLSL programs.
+ * Always false if the render module was compiled without GLEW.
+ */
+bool shadersSupported();
+
+/**
+ * Compiles and links a GLSL program. Must be called on the GL thread.
+ * Compilation and link errors are written to the log.
+ * @param vertexSource source of the vertex shader, or 0 to use the fixed-function vertex stage
+ * @param fragmentSource source of the fragment shader
+ * @return handle of the linked program, 0 on error
+ */
+GLuint compileShaderProgram( const char* vertexSource, const char* fragmentSource );
+
+/** deletes a program created by compileShaderProgram and resets the handle to 0 */
+void deleteShaderProgram( GLuint& program );
+
+} } // namespace Ubitrack::Drivers
+
+#endif
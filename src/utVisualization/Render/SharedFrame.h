@@ -0,0 +1,126 @@
+/*
+ * Ubitrack - Library for Ubiquitous Tracking
+ * Copyright 2006, Technische Universitaet Muenchen, and individual
+ * contributors as indicated by the @authors tag. See the
+ * copyright.txt in the distribution for a full listing of individual
+ * contributors.
+ *
+ * This is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this software; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA, or see the FSF site: http://www.fsf.org.
+ */
+
+/**
+ * @file
+ * Layout of the shared memory segment written by the SharedMemoryOutput component
+ *
+ * The segment starts with a Header, followed by Header::slotCount slots of Header::slotSize
+ * bytes. Each slot starts with a Slot header, the pixels follow at Header::slotHeaderSize,
+ * top row first, Slot::stride bytes per row.
+ *
+ * The segment is a POSIX shared memory object named "/" followed by the shmName attribute
+ * (emulated by Boost.Interprocess on Windows). A reader maps it read-only and
+ * -# checks magic and version,
+ * -# waits for a new frame: on Linux with FUTEX_WAIT on Header::doorbell (not private,
+ *    the writer increments it after each frame and wakes all waiters), or by polling Header::published,
+ * -# loads Header::published and uses slot (published - 1) % slotCount,
+ * -# checks with an acquire load that Slot::sequence equals published, and copies the frame,
+ * -# issues an acquire fence (std::atomic_thread_fence( std::memory_order_acquire ) or equivalent),
+ * -# loads Slot::sequence again: if it changed, the writer has reused the slot while it was being read
+ *    and the copy has to be discarded.
+ *
+ * The fence is required: an acquire load of the second sequence number alone does not keep the reads
+ * of the frame data before it, and torn frames would be accepted. Processing the frame in place instead
+ * of copying it is possible if the check afterwards is done the same way.
+ *
+ * All counters are naturally aligned 32 or 64 bit integers. Readers in other languages access them
+ * with atomic loads (acquire). Header::active is 0 when the writer has stopped.
+ * tools/SharedFrameReader contains a reader following this protocol.
+ */
+
+#ifndef __SharedFrame_h_INCLUDED__
+#define __SharedFrame_h_INCLUDED__
+
+#include <boost/cstdint.hpp>
+#include <boost/atomic.hpp>
+#include <boost/static_assert.hpp>
+
+namespace Ubitrack { namespace Drivers { namespace SharedFrame {
+
+BOOST_STATIC_ASSERT( BOOST_ATOMIC_INT32_LOCK_FREE == 2 && BOOST_ATOMIC_INT64_LOCK_FREE == 2 );
+BOOST_STATIC_ASSERT( sizeof( boost::atomic< boost::uint32_t > ) == 4 && sizeof( boost::atomic< boost::uint64_t > ) == 8 );
+
+/** "UTFR" */
+const boost::uint32_t magic = 0x52465455;
+const boost::uint32_t version = 1;
+
+enum Format
+{
+	/** 3 bytes per pixel, blue first */
+	formatBGR8 = 1,
+
+	/** 4 bytes per pixel, red first */
+	formatRGBA8 = 2
+};
+
+/** at offset 0 of the segment */
+struct Header
+{
+	boost::uint32_t magic;
+	boost::uint32_t version;
+	boost::uint32_t slotCount;
+	boost::uint32_t slotHeaderSize;
+	boost::uint64_t slotSize;
+
+	/** offset of the first slot */
+	boost::uint64_t headerSize;
+
+	/** futex word, incremented after each published frame */
+	boost::atomic< boost::uint32_t > doorbell;
+
+	/** 1 while the writer is running */
+	boost::atomic< boost::uint32_t > active;
+
+	/** sequence number of the newest complete frame, starting at 1, 0 if there is none */
+	boost::atomic< boost::uint64_t > published;
+};
+
+/** at the start of each slot */
+struct Slot
+{
+	/** sequence number of the frame in the slot, 0 while the writer changes it */
+	boost::atomic< boost::uint64_t > sequence;
+
+	/** time the frame was rendered, in ns since the epoch */
+	boost::uint64_t timestamp;
+
+	boost::uint32_t width;
+	boost::uint32_t height;
+
+	/** a SharedFrame::Format */
+	boost::uint32_t format;
+
+	/** bytes per row */
+	boost::uint32_t stride;
+};
+
+/** header sizes, rounded up to a cache line */
+const boost::uint64_t headerSize = 128;
+const boost::uint32_t slotHeaderSize = 64;
+
+BOOST_STATIC_ASSERT( sizeof( Header ) <= headerSize && sizeof( Slot ) <= slotHeaderSize );
+
+} } } // namespace Ubitrack::Drivers::SharedFrame
+
+#endif
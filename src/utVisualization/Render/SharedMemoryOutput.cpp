@@ -0,0 +1,321 @@
+/*
+ * Ubitrack - Library for Ubiquitous Tracking
+ * Copyright 2006, Technische Universitaet Muenchen, and individual
+ * contributors as indicated by the @authors tag. See the
+ * copyright.txt in the distribution for a full listing of individual
+ * contributors.
+ *
+ * This is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this software; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA, or see the FSF site: http://www.fsf.org.
+ */
+
+/**
+ * @file
+ * Implementation of the shared memory frame export
+ */
+
+#ifdef HAVE_GLEW
+	#include "GL/glew.h"
+#endif
+
+#include <new>
+#include <cstring>
+#include <climits>
+#include <algorithm>
+#include <boost/interprocess/shared_memory_object.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+#include <utUtil/Exception.h>
+#include "SharedMemoryOutput.h"
+#include "SharedFrame.h"
+
+#ifdef __linux__
+	#include <unistd.h>
+	#include <sys/syscall.h>
+	#include <linux/futex.h>
+#endif
+
+namespace Ubitrack { namespace Drivers {
+
+
+/**
+ * The shared memory segment. Creates the segment and the header when constructed,
+ * marks it as inactive and removes the name when destroyed. Readers that have mapped
+ * the segment keep it until they unmap it.
+ */
+class SharedFrameRing
+{
+public:
+	SharedFrameRing( const std::string& name, unsigned nSlots, std::size_t frameBytes )
+		: m_name( name )
+		, m_nSlots( std::max( nSlots, 1u ) )
+		, m_slotSize( SharedFrame::slotHeaderSize + ( ( frameBytes + 63 ) & ~std::size_t( 63 ) ) )
+		, m_sequence( 0 )
+	{
+		using namespace boost::interprocess;
+
+		// a segment left behind by a crashed process would have the wrong size
+		shared_memory_object::remove( m_name.c_str() );
+		try
+		{
+			shared_memory_object shm( create_only, m_name.c_str(), read_write );
+			shm.truncate( static_cast< offset_t >( SharedFrame::headerSize + m_nSlots * m_slotSize ) );
+			mapped_region( shm, read_write ).swap( m_region );
+		}
+		catch ( const interprocess_exception& e )
+		{
+			UBITRACK_THROW( "Cannot create shared memory " + m_name + ": " + e.what() );
+		}
+
+		m_pBase = static_cast< unsigned char* >( m_region.get_address() );
+		m_pHeader = new( m_pBase ) SharedFrame::Header;
+		for ( unsigned i = 0; i < m_nSlots; i++ )
+		{
+			SharedFrame::Slot* pSlot = new( slot( i ) ) SharedFrame::Slot;
+			pSlot->sequence.store( 0, boost::memory_order_relaxed );
+		}
+
+		m_pHeader->version = SharedFrame::version;
+		m_pHeader->slotCount = m_nSlots;
+		m_pHeader->slotHeaderSize = SharedFrame::slotHeaderSize;
+		m_pHeader->slotSize = m_slotSize;
+		m_pHeader->headerSize = SharedFrame::headerSize;
+		m_pHeader->doorbell.store( 0, boost::memory_order_relaxed );
+		m_pHeader->published.store( 0, boost::memory_order_relaxed );
+		m_pHeader->active.store( 1, boost::memory_order_relaxed );
+
+		// readers check the magic number last
+		boost::atomic_thread_fence( boost::memory_order_release );
+		m_pHeader->magic = SharedFrame::magic;
+	}
+
+	~SharedFrameRing()
+	{
+		m_pHeader->active.store( 0, boost::memory_order_release );
+		ring();
+		boost::interprocess::shared_memory_object::remove( m_name.c_str() );
+	}
+
+	/** maximum number of bytes of a frame */
+	std::size_t capacity() const
+	{ return m_slotSize - SharedFrame::slotHeaderSize; }
+
+	/**
+	 * copies a frame into the next slot and wakes the readers
+	 * @param pData pixels, bottom row first as read by GL, rows packed
+	 */
+	void publish( const unsigned char* pData, int width, int height, int format, int bytesPerPixel, Measurement::Timestamp time )
+	{
+		boost::uint64_t sequence = ++m_sequence;
+		SharedFrame::Slot* pSlot = slot( static_cast< unsigned >( ( sequence - 1 ) % m_nSlots ) );
+
+		// readers still copying the old frame see the change of the sequence number
+		pSlot->sequence.store( 0, boost::memory_order_relaxed );
+		boost::atomic_thread_fence( boost::memory_order_release );
+
+		std::size_t rowBytes = static_cast< std::size_t >( width ) * bytesPerPixel;
+		pSlot->timestamp = time;
+		pSlot->width = width;
+		pSlot->height = height;
+		pSlot->format = format;
+		pSlot->stride = static_cast< boost::uint32_t >( rowBytes );
+
+		// GL starts with the bottom row, flip while copying
+		unsigned char* pPixels = reinterpret_cast< unsigned char* >( pSlot ) + SharedFrame::slotHeaderSize;
+		for ( int y = 0; y < height; y++ )
+			std::memcpy( pPixels + ( height - 1 - y ) * rowBytes, pData + y * rowBytes, rowBytes );
+
+		pSlot->sequence.store( sequence, boost::memory_order_release );
+		m_pHeader->published.store( sequence, boost::memory_order_release );
+		ring();
+	}
+
+protected:
+	SharedFrame::Slot* slot( unsigned i )
+	{ return reinterpret_cast< SharedFrame::Slot* >( m_pBase + SharedFrame::headerSize + i * m_slotSize ); }
+
+	/** increments the doorbell and wakes all readers waiting on it */
+	void ring()
+	{
+		m_pHeader->doorbell.fetch_add( 1, boost::memory_order_release );
+	#ifdef __linux__
+		// shared between processes, so no FUTEX_PRIVATE_FLAG
+		syscall( SYS_futex, reinterpret_cast< boost::uint32_t* >( &m_pHeader->doorbell ), FUTEX_WAKE, INT_MAX, 0, 0, 0 );
+	#endif
+	}
+
+	std::string m_name;
+	unsigned m_nSlots;
+	std::size_t m_slotSize;
+
+	boost::interprocess::mapped_region m_region;
+	unsigned char* m_pBase;
+	SharedFrame::Header* m_pHeader;
+
+	/** sequence number of the last published frame */
+	boost::uint64_t m_sequence;
+};
+
+
+SharedMemoryOutput::SharedMemoryOutput( const std::string& name, boost::shared_ptr< Graph::UTQLSubgraph > subgraph, 
+	const VirtualObjectKey& componentKey, VirtualCamera* pModule )
+	: VirtualObject( name, subgraph, componentKey, pModule )
+	, m_droppedPort( "Dropped", *this )
+	, m_shmName( "ubitrack_frames" )
+	, m_nSlots( 3 )
+	, m_glFormat( GL_BGR_EXT )
+	, m_bytesPerPixel( 3 )
+	, m_readback( 2 )
+	, m_bAsync( false )
+	, m_bInitialized( false )
+	, m_nDropped( 0 )
+	, m_nDroppedReported( 0 )
+	, m_lastDropReport( 0 )
+{
+	if ( subgraph->m_DataflowAttributes.hasAttribute( "shmName" ) )
+		m_shmName = subgraph->m_DataflowAttributes.getAttributeString( "shmName" );
+	if ( m_shmName.empty() )
+		UBITRACK_THROW( "SharedMemoryOutput requires a shmName" );
+	subgraph->m_DataflowAttributes.getAttributeData( "slots", m_nSlots );
+
+	if ( subgraph->m_DataflowAttributes.hasAttribute( "pixelFormat" ) )
+	{
+		std::string format = subgraph->m_DataflowAttributes.getAttributeString( "pixelFormat" );
+		if ( format == "rgba" )
+		{
+			m_glFormat = GL_RGBA;
+			m_bytesPerPixel = 4;
+		}
+		else if ( format != "bgr" )
+			UBITRACK_THROW( "Unknown pixelFormat " + format );
+	}
+
+	int readbackBuffers = 2;
+	subgraph->m_DataflowAttributes.getAttributeData( "readbackBuffers", readbackBuffers );
+	m_readback = PixelReadback( std::max( readbackBuffers, 1 ) );
+}
+
+
+SharedMemoryOutput::~SharedMemoryOutput()
+{
+	if ( m_pRing )
+		LOG4CPP_INFO( logger, getName() << ": stopped exporting to " << m_shmName << ", " << m_nDropped << " frames dropped" );
+}
+
+
+void SharedMemoryOutput::drawFinished( Measurement::Timestamp&, int parity )
+{
+	// like ImageOutput, only one eye of frame sequential stereo is exported
+	if ( parity )
+		return;
+
+	int width = m_pModule->m_width;
+	int height = m_pModule->m_height;
+	if ( !m_bInitialized )
+	{
+		m_bInitialized = true;
+		m_bAsync = PixelReadback::supported();
+		if ( !m_bAsync )
+			LOG4CPP_WARN( logger, getName() << ": pixel buffer objects are not supported, frames are read synchronously" );
+
+		try
+		{
+			m_pRing.reset( new SharedFrameRing( m_shmName, std::max( m_nSlots, 1 ), 
+				static_cast< std::size_t >( width ) * height * m_bytesPerPixel ) );
+			LOG4CPP_INFO( logger, getName() << ": exporting " << width << "x" << height << " frames to " << m_shmName );
+		}
+		catch ( const Util::Exception& e )
+		{
+			LOG4CPP_ERROR( logger, getName() << ": " << e );
+		}
+	}
+
+	if ( !m_pRing )
+		return;
+
+	std::size_t rowBytes = static_cast< std::size_t >( width ) * m_bytesPerPixel;
+	if ( rowBytes * height > m_pRing->capacity() )
+	{
+		m_nDropped++;
+		reportDrops();
+		return;
+	}
+
+	if ( m_bAsync )
+	{
+		// publish the finished reads, the oldest one has to be taken if no buffer is free for this frame
+		while ( m_readback.pending() && m_readback.finished( m_readback.pending() == m_readback.size() ) )
+			collect();
+
+		if ( !m_readback.start( 0, 0, width, height, m_glFormat, GL_UNSIGNED_BYTE, rowBytes, Measurement::now() ) )
+			m_nDropped++;
+	}
+	else
+	{
+		m_buffer.resize( rowBytes * height );
+		GLint alignment;
+		glGetIntegerv( GL_PACK_ALIGNMENT, &alignment );
+		glPixelStorei( GL_PACK_ALIGNMENT, 1 );
+		glReadPixels( 0, 0, width, height, m_glFormat, GL_UNSIGNED_BYTE, &m_buffer[ 0 ] );
+		glPixelStorei( GL_PACK_ALIGNMENT, alignment );
+		m_pRing->publish( &m_buffer[ 0 ], width, height, 
+			m_bytesPerPixel == 4 ? SharedFrame::formatRGBA8 : SharedFrame::formatBGR8, m_bytesPerPixel, Measurement::now() );
+	}
+
+	reportDrops();
+}
+
+
+void SharedMemoryOutput::collect()
+{
+	int width, height;
+	Measurement::Timestamp time;
+	const unsigned char* pData = m_readback.map( width, height, time );
+	if ( !pData )
+	{
+		m_readback.discard();
+		m_nDropped++;
+		return;
+	}
+
+	m_pRing->publish( pData, width, height, 
+		m_bytesPerPixel == 4 ? SharedFrame::formatRGBA8 : SharedFrame::formatBGR8, m_bytesPerPixel, time );
+	m_readback.unmap();
+}
+
+
+void SharedMemoryOutput::reportDrops()
+{
+	Measurement::Timestamp now = Measurement::now();
+	if ( m_nDropped == m_nDroppedReported || now < m_lastDropReport + 1000000000LL )
+		return;
+
+	LOG4CPP_WARN( logger, getName() << ": dropped " << m_nDropped - m_nDroppedReported << " frames (" 
+		<< m_nDropped << " total), the window is larger than the first frame or the readback is busy" );
+	m_nDroppedReported = m_nDropped;
+	m_lastDropReport = now;
+
+	m_droppedPort.send( Measurement::Distance( now, static_cast< double >( m_nDropped ) ) );
+}
+
+
+void SharedMemoryOutput::glCleanup()
+{
+	while ( m_pRing && m_readback.pending() && m_readback.finished( true ) )
+		collect();
+	m_readback.release();
+}
+
+
+} } // namespace Ubitrack::Drivers
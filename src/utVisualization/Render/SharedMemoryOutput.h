@@ -0,0 +1,111 @@
+/*
+ * Ubitrack - Library for Ubiquitous Tracking
+ * Copyright 2006, Technische Universitaet Muenchen, and individual
+ * contributors as indicated by the @authors tag. See the
+ * copyright.txt in the distribution for a full listing of individual
+ * contributors.
+ *
+ * This is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this software; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA, or see the FSF site: http://www.fsf.org.
+ */
+
+/**
+ * @file
+ * Export of the rendered frames to other processes through shared memory
+ */
+
+#ifndef _SHAREDMEMORYOUTPUT_H_
+#define _SHAREDMEMORYOUTPUT_H_
+
+#include <boost/scoped_ptr.hpp>
+#include "RenderModule.h"
+#include "PixelReadback.h"
+
+namespace Ubitrack { namespace Drivers {
+
+class SharedFrameRing;
+
+/**
+ * @ingroup driver_components
+ * Publishes the rendered frames into a ring of slots in a shared memory segment, where
+ * processes on the same machine can read them without further copies. The layout of the
+ * segment and the protocol for readers are described in SharedFrame.h.
+ * The frames are read back through pixel buffer objects, so a frame is published one or two
+ * frames after it was rendered. The size of a slot is fixed by the first frame, larger frames
+ * are dropped. The total number of dropped frames is pushed on "Dropped" when it changes.
+ */
+class SharedMemoryOutput
+	: public VirtualObject
+{
+public:
+
+	/**
+	 * Constructor
+	 * @param name edge name
+	 * @param config component configuration
+	 * @param componentKey the unique identifier for this component
+	 * @param pModule parent object
+	 */
+	SharedMemoryOutput( const std::string& name, boost::shared_ptr< Graph::UTQLSubgraph > subgraph, 
+		const VirtualObjectKey& componentKey, VirtualCamera* pModule );
+
+	/** marks the segment as inactive and removes it */
+	~SharedMemoryOutput();
+
+	/** publishes finished reads and starts reading the finished frame */
+	virtual void drawFinished( Measurement::Timestamp& t, int parity );
+
+	virtual void glCleanup();
+
+protected:
+
+	/** publishes the oldest read */
+	void collect();
+
+	/** logs and pushes the number of dropped frames, at most once per second */
+	void reportDrops();
+
+	/** total number of dropped frames */
+	PushSupplier< Measurement::Distance > m_droppedPort;
+
+	/** name of the shared memory object */
+	std::string m_shmName;
+	int m_nSlots;
+
+	/** GL format and bytes per pixel of the exported frames */
+	GLenum m_glFormat;
+	int m_bytesPerPixel;
+
+	PixelReadback m_readback;
+
+	/** whether pixel buffer objects are available, checked with the first frame */
+	bool m_bAsync;
+	bool m_bInitialized;
+
+	boost::scoped_ptr< SharedFrameRing > m_pRing;
+
+	/** frames are read here without pixel buffer objects */
+	std::vector< unsigned char > m_buffer;
+
+	/** frames dropped because they did not fit into a slot or no readback buffer was free */
+	unsigned long m_nDropped;
+	unsigned long m_nDroppedReported;
+	Measurement::Timestamp m_lastDropReport;
+};
+
+
+} } // namespace Ubitrack::Drivers
+
+#endif
@@ -22,10 +22,37 @@
  */
 
 
+#ifdef HAVE_GLEW
+	#include "GL/glew.h"
+#endif
+
 #include "StereoRendering.h"
+#include "Shader.h"
 
 namespace Ubitrack { namespace Drivers {
 
+namespace {
+
+/**
+ * Fragment shader interleaving the half-resolution eye images line- or column-wise.
+ * Like the stencil of line sequential stereo, even lines show the eye rendered with parity 1.
+ */
+const char* g_interleaveShader =
+	"uniform sampler2D evenEye;\n"
+	"uniform sampler2D oddEye;\n"
+	"uniform vec2 eyeSize;\n"
+	"uniform int columns;\n"
+	"void main()\n"
+	"{\n"
+	"	vec2 p = floor( gl_FragCoord.xy );\n"
+	"	float line = columns == 1 ? p.x : p.y;\n"
+	"	vec2 q = columns == 1 ? vec2( floor( p.x * 0.5 ), p.y ) : vec2( p.x, floor( p.y * 0.5 ) );\n"
+	"	vec2 tc = ( q + 0.5 ) / eyeSize;\n"
+	"	gl_FragColor = mod( line, 2.0 ) < 0.5 ? texture2D( evenEye, tc ) : texture2D( oddEye, tc );\n"
+	"}\n";
+
+} // anonymous namespace
+
 
 StereoRendering::StereoRendering( const std::string& name, boost::shared_ptr< Graph::UTQLSubgraph > pSubgraph, 
 	const VirtualObjectKey& componentKey, VirtualCamera* pModule )
@@ -33,6 +60,8 @@ StereoRendering::StereoRendering( const std::string& name, boost::shared_ptr< Gr
 	, m_stereoOffset( 0 )
 	, m_stencilWidth( -1 )
 	, m_stencilHeight( -1 )
+	, m_interleaveProgram( 0 )
+	, m_bInterleaveFailed( false )
 {
 	Graph::UTQLSubgraph::NodePtr pNode = pSubgraph->getNode( "Camera" );
 	
@@ -57,6 +86,26 @@ StereoRendering::StereoRendering( const std::string& name, boost::shared_ptr< Gr
 		m_stereoType = stereoRedBlue;
 		getModule().setStereoRenderPasses( VirtualCamera::stereoRenderSingle );
 	}
+	else if ( sStereoType == "sideBySide" )
+	{
+		m_stereoType = stereoSideBySide;
+		getModule().setStereoRenderPasses( VirtualCamera::stereoRenderSingle );
+	}
+	else if ( sStereoType == "topBottom" )
+	{
+		m_stereoType = stereoTopBottom;
+		getModule().setStereoRenderPasses( VirtualCamera::stereoRenderSingle );
+	}
+	else if ( sStereoType == "lineInterleaved" )
+	{
+		m_stereoType = stereoLineInterleaved;
+		getModule().setStereoRenderPasses( VirtualCamera::stereoRenderSingle );
+	}
+	else if ( sStereoType == "columnInterleaved" )
+	{
+		m_stereoType = stereoColumnInterleaved;
+		getModule().setStereoRenderPasses( VirtualCamera::stereoRenderSingle );
+	}
 	else
 		UBITRACK_THROW( "Invalid stereoType attribute" );
 		
@@ -87,6 +136,16 @@ void StereoRendering::draw( Measurement::Timestamp&, int parity )
 		glStencilFunc( GL_EQUAL, parity ? 1 : 0, 0x01 );
 		break;
 
+	case stereoSideBySide:
+	case stereoTopBottom:
+		setEyeViewport( parity );
+		break;
+
+	case stereoLineInterleaved:
+	case stereoColumnInterleaved:
+		bindEyeTarget( parity );
+		break;
+
 	default:
 		// TODO: other stereo methods
 		break;
@@ -102,6 +161,132 @@ void StereoRendering::draw( Measurement::Timestamp&, int parity )
 }
 
 
+void StereoRendering::setEyeViewport( int parity )
+{
+	// parity 1 is the left eye, as for the stereoEye attribute of the other components
+	int x = 0;
+	int y = 0;
+	int width = getModule().m_width;
+	int height = getModule().m_height;
+
+	if ( m_stereoType == stereoSideBySide )
+	{
+		width /= 2;
+		x = parity ? 0 : width;
+	}
+	else
+	{
+		height /= 2;
+		y = parity ? height : 0;
+	}
+
+	// the scissor keeps clears and full-window 2D drawing inside the eye's half
+	glViewport( x, y, width, height );
+	glScissor( x, y, width, height );
+	glEnable( GL_SCISSOR_TEST );
+}
+
+
+void StereoRendering::bindEyeTarget( int parity )
+{
+	if ( !m_interleaveProgram && !m_bInterleaveFailed )
+	{
+		if ( RenderTarget::supported() )
+			m_interleaveProgram = compileShaderProgram( 0, g_interleaveShader );
+		m_bInterleaveFailed = !m_interleaveProgram;
+		if ( m_bInterleaveFailed )
+			LOG4CPP_ERROR( logger, "Interleaved stereo requires framebuffer objects and GLSL, rendering both eyes into the window" );
+	}
+	if ( m_bInterleaveFailed )
+		return;
+
+	// each eye only needs every other line or column
+	int width = getModule().m_width;
+	int height = getModule().m_height;
+	if ( m_stereoType == stereoColumnInterleaved )
+		width = ( width + 1 ) / 2;
+	else
+		height = ( height + 1 ) / 2;
+
+	RenderTarget& target = m_eyeTarget[ parity ? 1 : 0 ];
+	if ( !target.resize( width, height ) )
+	{
+		m_bInterleaveFailed = true;
+		RenderTarget::unbind();
+		return;
+	}
+
+	target.bind();
+	glClear( GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT );
+}
+
+
+/** interleaves the eye images for line and column interleaved stereo */
+void StereoRendering::drawFinished( Measurement::Timestamp&, int )
+{
+	if ( ( m_stereoType != stereoLineInterleaved && m_stereoType != stereoColumnInterleaved ) || !m_interleaveProgram )
+		return;
+
+	RenderTarget::unbind();
+
+#ifdef HAVE_GLEW
+	glPushAttrib( GL_ENABLE_BIT );
+	glDisable( GL_DEPTH_TEST );
+	glDisable( GL_LIGHTING );
+	glDisable( GL_BLEND );
+
+	glMatrixMode( GL_PROJECTION );
+	glPushMatrix();
+	glLoadIdentity();
+	gluOrtho2D( 0.0, 1.0, 0.0, 1.0 );
+	glMatrixMode( GL_MODELVIEW );
+	glPushMatrix();
+	glLoadIdentity();
+
+	glActiveTexture( GL_TEXTURE1 );
+	glBindTexture( GL_TEXTURE_2D, m_eyeTarget[ 0 ].texture() );
+	glActiveTexture( GL_TEXTURE0 );
+	glBindTexture( GL_TEXTURE_2D, m_eyeTarget[ 1 ].texture() );
+
+	glUseProgram( m_interleaveProgram );
+	glUniform1i( glGetUniformLocation( m_interleaveProgram, "evenEye" ), 0 );
+	glUniform1i( glGetUniformLocation( m_interleaveProgram, "oddEye" ), 1 );
+	glUniform2f( glGetUniformLocation( m_interleaveProgram, "eyeSize" ),
+		float( m_eyeTarget[ 1 ].width() ), float( m_eyeTarget[ 1 ].height() ) );
+	glUniform1i( glGetUniformLocation( m_interleaveProgram, "columns" ), m_stereoType == stereoColumnInterleaved ? 1 : 0 );
+
+	glBegin( GL_TRIANGLE_STRIP );
+	glVertex2d( 0, 0 );
+	glVertex2d( 1, 0 );
+	glVertex2d( 0, 1 );
+	glVertex2d( 1, 1 );
+	glEnd();
+
+	glUseProgram( 0 );
+	glActiveTexture( GL_TEXTURE1 );
+	glBindTexture( GL_TEXTURE_2D, 0 );
+	glActiveTexture( GL_TEXTURE0 );
+	glBindTexture( GL_TEXTURE_2D, 0 );
+
+	glPopMatrix();
+	glMatrixMode( GL_PROJECTION );
+	glPopMatrix();
+	glMatrixMode( GL_MODELVIEW );
+	glPopAttrib();
+#endif
+}
+
+
+/** deletes OpenGL state */
+void StereoRendering::glCleanup()
+{
+	RenderTarget::unbind();
+	m_eyeTarget[ 0 ].release();
+	m_eyeTarget[ 1 ].release();
+	deleteShaderProgram( m_interleaveProgram );
+}
+
+
 void StereoRendering::initStencilBuffer()
 {
 	LOG4CPP_DEBUG( logger, "initializing stencil buffer for line sequential stereo )" );
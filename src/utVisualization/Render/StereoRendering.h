@@ -25,6 +25,7 @@
 #define _StereoRendering_H_
 
 #include "RenderModule.h"
+#include "RenderTarget.h"
 
 namespace Ubitrack { namespace Drivers {
 
@@ -54,12 +55,25 @@ public:
 	/** render the object */
 	virtual void draw( Measurement::Timestamp& time, int parity );
 
+	/** interleaves the eye images for line and column interleaved stereo */
+	virtual void drawFinished( Measurement::Timestamp& time, int parity );
+
+	/** deletes OpenGL state */
+	virtual void glCleanup();
+
 protected:
 	/** initialize the stencil buffer for line sequential stereo */
 	void initStencilBuffer();
 	
+	/** restricts rendering to the half of the window that belongs to an eye */
+	void setEyeViewport( int parity );
+
+	/** redirects rendering of an eye into its half-resolution render target */
+	void bindEyeTarget( int parity );
+
 	/** different stereo types */
-	enum { stereoLineSequential, stereoFrameSequential, stereoRedGreen, stereoRedBlue } m_stereoType;
+	enum { stereoLineSequential, stereoFrameSequential, stereoRedGreen, stereoRedBlue, stereoSideBySide, stereoTopBottom,
+		stereoLineInterleaved, stereoColumnInterleaved } m_stereoType;
 	
 	/** stereo offset for simple stereo = inter-eye distance */
 	double m_stereoOffset;
@@ -69,6 +83,13 @@ protected:
 	
 	/** stencil buffer height */
 	int m_stencilHeight;
+
+	/** half-resolution images of both eyes for interleaved stereo, indexed by parity */
+	RenderTarget m_eyeTarget[2];
+
+	/** shader combining the eye images */
+	GLuint m_interleaveProgram;
+	bool m_bInterleaveFailed;
 };
 
 } } // namespace Ubitrack::Drivers
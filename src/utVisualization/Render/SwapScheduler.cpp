@@ -0,0 +1,145 @@
+/*
+ * Ubitrack - Library for Ubiquitous Tracking
+ * Copyright 2006, Technische Universitaet Muenchen, and individual
+ * contributors as indicated by the @authors tag. See the 
+ * copyright.txt in the distribution for a full listing of individual
+ * contributors.
+ *
+ * This is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this software; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA, or see the FSF site: http://www.fsf.org.
+ */
+
+/**
+ * @ingroup driver_components
+ * @file
+ * Scheduling of buffer swaps for given vertical retraces
+ */
+
+#include "SwapScheduler.h"
+
+#include <algorithm>
+#include <log4cpp/Category.hh>
+
+#if defined( __linux__ )
+	#include <time.h>
+#endif
+
+extern log4cpp::Category& logger;
+
+
+namespace {
+
+/** converts an OML system time (microseconds, usually of CLOCK_MONOTONIC) to a Ubitrack timestamp */
+Ubitrack::Measurement::Timestamp ustToTimestamp( boost::int64_t ust )
+{
+#if defined( __linux__ )
+	timespec monotonic;
+	clock_gettime( CLOCK_MONOTONIC, &monotonic );
+	boost::int64_t nowUst = boost::int64_t( monotonic.tv_sec ) * 1000000 + monotonic.tv_nsec / 1000;
+	return Ubitrack::Measurement::now() - ( nowUst - ust ) * 1000;
+#else
+	return Ubitrack::Measurement::now();
+#endif
+}
+
+} // anonymous namespace
+
+
+SwapScheduler::SwapScheduler( boost::shared_ptr< SyncSource > pSource )
+	: m_pSyncSource( pSource )
+	, m_targetMsc( 0 )
+	, m_bTargetValid( false )
+	, m_lastTargetMsc( -1 )
+	, m_droppedFrames( 0 )
+	, m_lastPresentTime( 0 )
+	, m_bPresentTimeMeasured( false )
+{
+}
+
+
+bool SwapScheduler::available()
+{
+	return m_pSyncSource && m_pSyncSource->available();
+}
+
+
+bool SwapScheduler::getRetrace( boost::int64_t& msc )
+{
+	boost::int64_t ust = 0;
+	boost::int64_t sbc = 0;
+	if ( !m_pSyncSource->getSyncValues( ust, msc, sbc ) )
+		return false;
+
+	// target the next retrace, but never the same one twice, so the parity of consecutive
+	// frames alternates even if a frame was late
+	m_targetMsc = std::max( m_lastTargetMsc + 1, msc + 1 );
+	m_bTargetValid = true;
+	msc = m_targetMsc;
+	return true;
+}
+
+
+bool SwapScheduler::swap()
+{
+	if ( !m_bTargetValid )
+	{
+		boost::int64_t msc;
+		if ( !getRetrace( msc ) )
+			return false;
+	}
+	m_bTargetValid = false;
+	m_lastTargetMsc = m_targetMsc;
+
+	boost::int64_t sbc = m_pSyncSource->swapBuffersMsc( m_targetMsc );
+	if ( sbc < 0 )
+	{
+		LOG4CPP_WARN( logger, "VideoSync: scheduling the swap for retrace " << m_targetMsc << " failed" );
+		return false;
+	}
+
+	boost::int64_t ust = 0;
+	boost::int64_t msc = 0;
+	if ( !m_pSyncSource->waitForSbc( sbc, ust, msc ) )
+	{
+		// the swap was scheduled, only its time is unknown
+		LOG4CPP_WARN( logger, "VideoSync: waiting for swap " << sbc << " failed" );
+		m_lastPresentTime = Ubitrack::Measurement::now();
+		m_bPresentTimeMeasured = false;
+		return true;
+	}
+
+	m_lastPresentTime = ustToTimestamp( ust );
+	m_bPresentTimeMeasured = true;
+
+	// a swap shown later than its target means that frames were dropped
+	if ( msc > m_targetMsc )
+	{
+		m_droppedFrames += static_cast< unsigned long >( msc - m_targetMsc );
+		LOG4CPP_INFO( logger, "VideoSync: swap for retrace " << m_targetMsc << " shown at retrace " << msc
+			<< ", " << m_droppedFrames << " frames dropped in total" );
+	}
+	m_lastTargetMsc = msc;
+	return true;
+}
+
+
+void SwapScheduler::swappedNow()
+{
+	m_bTargetValid = false;
+
+	// the driver may queue the swap, so this is only an estimate of the present time
+	m_lastPresentTime = Ubitrack::Measurement::now();
+	m_bPresentTimeMeasured = false;
+}
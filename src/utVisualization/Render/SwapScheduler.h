@@ -0,0 +1,124 @@
+/*
+ * Ubitrack - Library for Ubiquitous Tracking
+ * Copyright 2006, Technische Universitaet Muenchen, and individual
+ * contributors as indicated by the @authors tag. See the 
+ * copyright.txt in the distribution for a full listing of individual
+ * contributors.
+ *
+ * This is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this software; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA, or see the FSF site: http://www.fsf.org.
+ */
+
+/**
+ * @ingroup driver_components
+ * @file
+ * Scheduling of buffer swaps for given vertical retraces, independent of the window system
+ */
+
+#ifndef __SwapScheduler_h_INCLUDED__
+#define __SwapScheduler_h_INCLUDED__
+
+#include <boost/cstdint.hpp>
+#include <boost/shared_ptr.hpp>
+#include <utMeasurement/Timestamp.h>
+
+/**
+ * Source of display timing that can schedule buffer swaps for a given vertical retrace.
+ * Implemented with GLX_OML_sync_control on Linux, and replaceable by a mock for testing
+ * the frame pacing without a display.
+ */
+class SyncSource {
+
+	public:
+
+		virtual ~SyncSource() {}
+
+		/** checks whether the source can be used with the current GL context */
+		virtual bool available() = 0;
+
+		/**
+		 * reads the current counters
+		 * @param ust system time of the last retrace in microseconds
+		 * @param msc media stream counter = number of the last retrace
+		 * @param sbc number of completed buffer swaps
+		 */
+		virtual bool getSyncValues( boost::int64_t& ust, boost::int64_t& msc, boost::int64_t& sbc ) = 0;
+
+		/** schedules a buffer swap for the given retrace, returns the swap buffer count of the swap or -1 */
+		virtual boost::int64_t swapBuffersMsc( boost::int64_t targetMsc ) = 0;
+
+		/** blocks until the swap with the given count has been done, returns its retrace and time */
+		virtual bool waitForSbc( boost::int64_t sbc, boost::int64_t& ust, boost::int64_t& msc ) = 0;
+};
+
+/**
+ * Chooses the retrace of the next swap, schedules it with a SyncSource and keeps track of
+ * late swaps and the time frames were shown. Used by VideoSync, which does the swaps that
+ * are not scheduled.
+ */
+class SwapScheduler {
+
+	public:
+
+		SwapScheduler( boost::shared_ptr< SyncSource > pSource = boost::shared_ptr< SyncSource >() );
+
+		/** replaces the timing source, e.g. by a mock */
+		void setSyncSource( boost::shared_ptr< SyncSource > pSource ) { m_pSyncSource = pSource; m_bTargetValid = false; }
+
+		/** true if swaps can be scheduled */
+		bool available();
+
+		/**
+		 * determines the retrace the next scheduled swap will target
+		 * @return false if the source cannot report its counters
+		 */
+		bool getRetrace( boost::int64_t& msc );
+
+		/**
+		 * schedules the swap for the retrace from getRetrace() and waits until it has been done
+		 * @return false if the swap could not be scheduled, the caller has to swap immediately
+		 */
+		bool swap();
+
+		/** records a swap done immediately, the present time is estimated by its return */
+		void swappedNow();
+
+		/** number of retraces the scheduled swaps were late */
+		unsigned long getDroppedFrames() { return m_droppedFrames; }
+
+		/** time the last frame was shown */
+		Ubitrack::Measurement::Timestamp getLastPresentTime() { return m_lastPresentTime; }
+
+		/** true if the last present time was reported by the display, false if it is the return time of the swap */
+		bool isPresentTimeMeasured() { return m_bPresentTimeMeasured; }
+
+	private:
+
+		boost::shared_ptr< SyncSource > m_pSyncSource;
+
+		/** retrace targeted by the next swap */
+		boost::int64_t m_targetMsc;
+		bool m_bTargetValid;
+
+		/** retrace targeted by the last swap, -1 = none */
+		boost::int64_t m_lastTargetMsc;
+
+		unsigned long m_droppedFrames;
+
+		Ubitrack::Measurement::Timestamp m_lastPresentTime;
+		bool m_bPresentTimeMeasured;
+};
+
+#endif
@@ -0,0 +1,147 @@
+/*
+ * Ubitrack - Library for Ubiquitous Tracking
+ * Copyright 2006, Technische Universitaet Muenchen, and individual
+ * contributors as indicated by the @authors tag. See the
+ * copyright.txt in the distribution for a full listing of individual
+ * contributors.
+ *
+ * This is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this software; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA, or see the FSF site: http://www.fsf.org.
+ */
+
+/**
+ * @file
+ * Implementation of the symmetric 3x3 eigen-decomposition
+ */
+
+#include <cmath>
+#include <algorithm>
+#include "SymmetricEigen.h"
+
+namespace Ubitrack { namespace Drivers {
+
+namespace {
+
+/** number of matrices decomposed in lockstep */
+const unsigned g_lanes = 4;
+
+/** Jacobi converges quadratically, five sweeps are enough for doubles */
+const unsigned g_maxSweeps = 5;
+
+/**
+ * Jacobi rotation annihilating a[p][q] in all lanes, r is the remaining index.
+ * Lanes with a zero off-diagonal element get the identity rotation.
+ */
+void jacobiRotate( double a[ 3 ][ 3 ][ g_lanes ], double v[ 3 ][ 3 ][ g_lanes ], int p, int q, int r )
+{
+	for ( unsigned l = 0; l < g_lanes; l++ )
+	{
+		double apq = a[ p ][ q ][ l ];
+		double theta = ( a[ q ][ q ][ l ] - a[ p ][ p ][ l ] ) / ( 2.0 * ( apq != 0.0 ? apq : 1.0 ) );
+		double t = ( theta >= 0.0 ? 1.0 : -1.0 ) / ( std::fabs( theta ) + std::sqrt( theta * theta + 1.0 ) );
+		t = apq != 0.0 ? t : 0.0;
+		double c = 1.0 / std::sqrt( t * t + 1.0 );
+		double s = t * c;
+
+		a[ p ][ p ][ l ] -= t * apq;
+		a[ q ][ q ][ l ] += t * apq;
+		a[ p ][ q ][ l ] = a[ q ][ p ][ l ] = 0.0;
+
+		double arp = a[ r ][ p ][ l ];
+		double arq = a[ r ][ q ][ l ];
+		a[ r ][ p ][ l ] = a[ p ][ r ][ l ] = c * arp - s * arq;
+		a[ r ][ q ][ l ] = a[ q ][ r ][ l ] = s * arp + c * arq;
+
+		for ( int k = 0; k < 3; k++ )
+		{
+			double vkp = v[ k ][ p ][ l ];
+			double vkq = v[ k ][ q ][ l ];
+			v[ k ][ p ][ l ] = c * vkp - s * vkq;
+			v[ k ][ q ][ l ] = s * vkp + c * vkq;
+		}
+	}
+}
+
+} // anonymous namespace
+
+
+void symmetricEigen3( const Math::Matrix< double, 3, 3 >* matrices, unsigned count, 
+	Math::Vector< double, 3 >* eigenvalues, Math::Matrix< double, 3, 3 >* eigenvectors )
+{
+	for ( unsigned first = 0; first < count; first += g_lanes )
+	{
+		unsigned lanes = std::min( g_lanes, count - first );
+
+		// structure of arrays, unused lanes decompose the identity
+		double a[ 3 ][ 3 ][ g_lanes ];
+		double v[ 3 ][ 3 ][ g_lanes ];
+		for ( int i = 0; i < 3; i++ )
+			for ( int j = 0; j < 3; j++ )
+				for ( unsigned l = 0; l < g_lanes; l++ )
+				{
+					double identity = i == j ? 1.0 : 0.0;
+					a[ i ][ j ][ l ] = l >= lanes ? identity : matrices[ first + l ]( std::min( i, j ), std::max( i, j ) );
+					v[ i ][ j ][ l ] = identity;
+				}
+
+		for ( unsigned sweep = 0; sweep < g_maxSweeps; sweep++ )
+		{
+			// stop when the off-diagonal elements are negligible in all lanes
+			bool bConverged = true;
+			for ( unsigned l = 0; l < g_lanes; l++ )
+			{
+				double off = a[ 0 ][ 1 ][ l ] * a[ 0 ][ 1 ][ l ] + a[ 0 ][ 2 ][ l ] * a[ 0 ][ 2 ][ l ] + a[ 1 ][ 2 ][ l ] * a[ 1 ][ 2 ][ l ];
+				double diag = a[ 0 ][ 0 ][ l ] * a[ 0 ][ 0 ][ l ] + a[ 1 ][ 1 ][ l ] * a[ 1 ][ 1 ][ l ] + a[ 2 ][ 2 ][ l ] * a[ 2 ][ 2 ][ l ];
+				bConverged = bConverged && off <= 1e-30 * diag;
+			}
+			if ( bConverged )
+				break;
+
+			jacobiRotate( a, v, 0, 1, 2 );
+			jacobiRotate( a, v, 0, 2, 1 );
+			jacobiRotate( a, v, 1, 2, 0 );
+		}
+
+		for ( unsigned l = 0; l < lanes; l++ )
+		{
+			// sort ascending like syev
+			int order[ 3 ] = { 0, 1, 2 };
+			for ( int i = 0; i < 2; i++ )
+				for ( int j = i + 1; j < 3; j++ )
+					if ( a[ order[ j ] ][ order[ j ] ][ l ] < a[ order[ i ] ][ order[ i ] ][ l ] )
+						std::swap( order[ i ], order[ j ] );
+
+			Math::Vector< double, 3 >& values = eigenvalues[ first + l ];
+			Math::Matrix< double, 3, 3 >& vectors = eigenvectors[ first + l ];
+			for ( int j = 0; j < 3; j++ )
+			{
+				values( j ) = a[ order[ j ] ][ order[ j ] ][ l ];
+				for ( int k = 0; k < 3; k++ )
+					vectors( k, j ) = v[ k ][ order[ j ] ][ l ];
+			}
+
+			// make the eigenvectors a rotation, a reflection would turn ellipsoids inside out
+			double det = 
+				vectors( 0, 0 ) * ( vectors( 1, 1 ) * vectors( 2, 2 ) - vectors( 2, 1 ) * vectors( 1, 2 ) ) -
+				vectors( 0, 1 ) * ( vectors( 1, 0 ) * vectors( 2, 2 ) - vectors( 2, 0 ) * vectors( 1, 2 ) ) +
+				vectors( 0, 2 ) * ( vectors( 1, 0 ) * vectors( 2, 1 ) - vectors( 2, 0 ) * vectors( 1, 1 ) );
+			if ( det < 0.0 )
+				for ( int k = 0; k < 3; k++ )
+					vectors( k, 2 ) = -vectors( k, 2 );
+		}
+	}
+}
+
+} } // namespace Ubitrack::Drivers
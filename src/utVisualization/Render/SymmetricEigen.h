@@ -0,0 +1,52 @@
+/*
+ * Ubitrack - Library for Ubiquitous Tracking
+ * Copyright 2006, Technische Universitaet Muenchen, and individual
+ * contributors as indicated by the @authors tag. See the
+ * copyright.txt in the distribution for a full listing of individual
+ * contributors.
+ *
+ * This is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this software; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA, or see the FSF site: http://www.fsf.org.
+ */
+
+/**
+ * @file
+ * Eigen-decomposition of symmetric 3x3 matrices, e.g. for error ellipsoids
+ */
+
+#ifndef __SymmetricEigen_h_INCLUDED__
+#define __SymmetricEigen_h_INCLUDED__
+
+#include <utMath/Matrix.h>
+#include <utMath/Vector.h>
+
+namespace Ubitrack { namespace Drivers {
+
+/**
+ * Computes eigenvalues and eigenvectors of symmetric 3x3 matrices with the cyclic Jacobi method.
+ * Up to four matrices are processed in lockstep, so the inner loops can be vectorized.
+ * Like LAPACK syev, the eigenvalues are sorted in ascending order and the eigenvectors are
+ * stored in the corresponding columns. The eigenvectors form a proper rotation (det = +1).
+ * @param matrices symmetric input matrices, only the upper triangle is used
+ * @param count number of matrices
+ * @param eigenvalues receives count eigenvalue vectors
+ * @param eigenvectors receives count eigenvector matrices, may not alias the input
+ */
+void symmetricEigen3( const Math::Matrix< double, 3, 3 >* matrices, unsigned count, 
+	Math::Vector< double, 3 >* eigenvalues, Math::Matrix< double, 3, 3 >* eigenvectors );
+
+} } // namespace Ubitrack::Drivers
+
+#endif
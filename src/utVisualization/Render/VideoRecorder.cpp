@@ -0,0 +1,321 @@
+/*
+ * Ubitrack - Library for Ubiquitous Tracking
+ * Copyright 2006, Technische Universitaet Muenchen, and individual
+ * contributors as indicated by the @authors tag. See the
+ * copyright.txt in the distribution for a full listing of individual
+ * contributors.
+ *
+ * This is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this software; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA, or see the FSF site: http://www.fsf.org.
+ */
+
+/**
+ * @file
+ * Implementation of the video recorder
+ */
+
+#ifdef HAVE_GLEW
+	#include "GL/glew.h"
+#endif
+
+#include <cstring>
+#include <deque>
+#include <algorithm>
+#include <boost/thread.hpp>
+#include <boost/bind.hpp>
+#include <utUtil/Exception.h>
+#include <utVisualization/FrameFileWriter.h>
+#include "VideoRecorder.h"
+
+namespace Ubitrack { namespace Drivers {
+
+
+/**
+ * Encodes frames in a pool of threads. The frames are preallocated, a frame is free again
+ * when it has been written, so the number of frames bounds the queue.
+ * Video files are written by a single thread, image sequences by all of them.
+ * Like the recording HighguiWindow, the files are written by a FrameFileWriter and the
+ * recording stops at the first error, e.g. when the frame size of a video file changes.
+ */
+class FrameEncoder
+{
+public:
+	FrameEncoder( const std::string& path, double fps, int width, int height, unsigned nFrames, unsigned nThreads )
+		: m_file( path, fps )
+		, m_bStop( false )
+		, m_bFailed( false )
+		, m_nSubmitted( 0 )
+		, m_nWritten( 0 )
+	{
+		for ( unsigned i = 0; i < nFrames; i++ )
+			m_free.push_back( cv::Mat( height, width, CV_8UC3 ) );
+
+		if ( !m_file.sequence() )
+			nThreads = 1;
+		for ( unsigned i = 0; i < nThreads; i++ )
+			m_threads.create_thread( boost::bind( &FrameEncoder::threadProc, this ) );
+	}
+
+	~FrameEncoder()
+	{
+		finish();
+	}
+
+	/** writes the queued frames and stops the threads */
+	void finish()
+	{
+		{
+			boost::mutex::scoped_lock l( m_mutex );
+			m_bStop = true;
+			m_condition.notify_all();
+		}
+		m_threads.join_all();
+	}
+
+	/** takes a free frame of the given size, returns false if all frames are queued or the recording failed */
+	bool acquire( cv::Mat& frame, int width, int height )
+	{
+		{
+			boost::mutex::scoped_lock l( m_mutex );
+			if ( m_free.empty() || m_bFailed )
+				return false;
+			frame = m_free.back();
+			m_free.pop_back();
+		}
+
+		// only reallocates if the window size changed
+		frame.create( height, width, CV_8UC3 );
+		return true;
+	}
+
+	/** queues an acquired frame for writing */
+	void submit( const cv::Mat& frame )
+	{
+		boost::mutex::scoped_lock l( m_mutex );
+		m_queue.push_back( std::make_pair( frame, m_nSubmitted++ ) );
+		m_condition.notify_one();
+	}
+
+	unsigned long written()
+	{
+		boost::mutex::scoped_lock l( m_mutex );
+		return m_nWritten;
+	}
+
+protected:
+	void threadProc()
+	{
+		while ( true )
+		{
+			std::pair< cv::Mat, unsigned long > job;
+			{
+				boost::mutex::scoped_lock l( m_mutex );
+				while ( m_queue.empty() && !m_bStop )
+					m_condition.wait( l );
+				if ( m_queue.empty() )
+					break;
+				job = m_queue.front();
+				m_queue.pop_front();
+			}
+
+			try
+			{
+				m_file.write( job.first, job.second );
+
+				boost::mutex::scoped_lock l( m_mutex );
+				m_free.push_back( job.first );
+				m_nWritten++;
+			}
+			catch ( const std::exception& e )
+			{
+				LOG4CPP_ERROR( logger, "Recording to " << m_file.path() << " failed: " << e.what() );
+				boost::mutex::scoped_lock l( m_mutex );
+				m_bFailed = true;
+				m_free.push_back( job.first );
+				for ( std::size_t i = 0; i < m_queue.size(); i++ )
+					m_free.push_back( m_queue[ i ].first );
+				m_queue.clear();
+			}
+		}
+	}
+
+	// thread safe for image sequences, which are written by all threads
+	FrameFileWriter m_file;
+
+	boost::mutex m_mutex;
+	boost::condition m_condition;
+	boost::thread_group m_threads;
+	bool m_bStop;
+
+	// set after a write error, no frames are accepted afterwards
+	bool m_bFailed;
+
+	std::vector< cv::Mat > m_free;
+	std::deque< std::pair< cv::Mat, unsigned long > > m_queue;
+	unsigned long m_nSubmitted;
+	unsigned long m_nWritten;
+};
+
+
+VideoRecorder::VideoRecorder( const std::string& name, boost::shared_ptr< Graph::UTQLSubgraph > subgraph, 
+	const VirtualObjectKey& componentKey, VirtualCamera* pModule )
+	: VirtualObject( name, subgraph, componentKey, pModule )
+	, m_droppedPort( "Dropped", *this )
+	, m_fps( 30.0 )
+	, m_queueSize( 4 )
+	, m_encoderThreads( 2 )
+	, m_readback( 3 )
+	, m_bAsync( false )
+	, m_bInitialized( false )
+	, m_nDropped( 0 )
+	, m_nDroppedReported( 0 )
+	, m_lastDropReport( 0 )
+{
+	if ( subgraph->m_DataflowAttributes.hasAttribute( "recordPath" ) )
+		m_path = subgraph->m_DataflowAttributes.getAttributeString( "recordPath" );
+	if ( m_path.empty() )
+		UBITRACK_THROW( "VideoRecorder requires a recordPath" );
+	subgraph->m_DataflowAttributes.getAttributeData( "recordFps", m_fps );
+	subgraph->m_DataflowAttributes.getAttributeData( "recordQueue", m_queueSize );
+	subgraph->m_DataflowAttributes.getAttributeData( "encoderThreads", m_encoderThreads );
+	m_queueSize = std::max( m_queueSize, 1 );
+	m_encoderThreads = std::max( m_encoderThreads, 1 );
+
+	int readbackBuffers = 3;
+	subgraph->m_DataflowAttributes.getAttributeData( "readbackBuffers", readbackBuffers );
+	m_readback = PixelReadback( std::max( readbackBuffers, 1 ) );
+}
+
+
+VideoRecorder::~VideoRecorder()
+{
+	if ( !m_pEncoder )
+		return;
+
+	m_pEncoder->finish();
+	reportDrops( true );
+	LOG4CPP_INFO( logger, getName() << ": recorded " << m_pEncoder->written() << " frames to " << m_path 
+		<< ", " << m_nDropped << " dropped" );
+}
+
+
+void VideoRecorder::drawFinished( Measurement::Timestamp&, int parity )
+{
+	// like ImageOutput, only one eye of frame sequential stereo is recorded
+	if ( parity )
+		return;
+
+	int width = m_pModule->m_width;
+	int height = m_pModule->m_height;
+	if ( !m_bInitialized )
+	{
+		m_bInitialized = true;
+		m_bAsync = PixelReadback::supported();
+		if ( !m_bAsync )
+			LOG4CPP_WARN( logger, getName() << ": pixel buffer objects are not supported, frames are read synchronously" );
+
+		// the file is opened by the encoder with the first frame, errors stop the recording
+		m_pEncoder.reset( new FrameEncoder( m_path, m_fps, width, height, m_queueSize, m_encoderThreads ) );
+	}
+
+	if ( !m_pEncoder )
+		return;
+
+	if ( m_bAsync )
+	{
+		// hand on the finished reads, the oldest one has to be taken if no buffer is free for this frame
+		while ( m_readback.pending() && m_readback.finished( m_readback.pending() == m_readback.size() ) )
+			collect();
+
+		if ( !m_readback.start( 0, 0, width, height, GL_BGR, GL_UNSIGNED_BYTE, width * 3, Measurement::now() ) )
+			m_nDropped++;
+	}
+	else
+	{
+		cv::Mat frame;
+		if ( m_pEncoder->acquire( frame, width, height ) )
+		{
+			GLint alignment;
+			glGetIntegerv( GL_PACK_ALIGNMENT, &alignment );
+			glPixelStorei( GL_PACK_ALIGNMENT, 1 );
+			glReadPixels( 0, 0, width, height, GL_BGR, GL_UNSIGNED_BYTE, frame.data );
+			glPixelStorei( GL_PACK_ALIGNMENT, alignment );
+			cv::flip( frame, frame, 0 );
+			m_pEncoder->submit( frame );
+		}
+		else
+			m_nDropped++;
+	}
+
+	reportDrops( false );
+}
+
+
+void VideoRecorder::collect()
+{
+	int width, height;
+	Measurement::Timestamp time;
+	const unsigned char* pData = m_readback.map( width, height, time );
+	if ( !pData )
+	{
+		m_readback.discard();
+		m_nDropped++;
+		return;
+	}
+
+	cv::Mat frame;
+	if ( !m_pEncoder->acquire( frame, width, height ) )
+	{
+		m_readback.unmap();
+		m_nDropped++;
+		return;
+	}
+
+	// GL starts with the bottom row, flip while copying out of the mapped buffer
+	std::size_t rowBytes = width * 3;
+	for ( int y = 0; y < height; y++ )
+		std::memcpy( frame.ptr( height - 1 - y ), pData + y * rowBytes, rowBytes );
+	m_readback.unmap();
+
+	m_pEncoder->submit( frame );
+}
+
+
+void VideoRecorder::reportDrops( bool bFinal )
+{
+	Measurement::Timestamp now = Measurement::now();
+	if ( m_nDropped == m_nDroppedReported || ( !bFinal && now < m_lastDropReport + 1000000000LL ) )
+		return;
+
+	LOG4CPP_WARN( logger, getName() << ": dropped " << m_nDropped - m_nDroppedReported << " frames (" 
+		<< m_nDropped << " total), the encoder cannot keep up or the recording failed" );
+	m_nDroppedReported = m_nDropped;
+	m_lastDropReport = now;
+
+	if ( !bFinal )
+		m_droppedPort.send( Measurement::Distance( now, static_cast< double >( m_nDropped ) ) );
+}
+
+
+void VideoRecorder::glCleanup()
+{
+	// the frames still in flight are part of the recording
+	while ( m_pEncoder && m_readback.pending() && m_readback.finished( true ) )
+		collect();
+	m_readback.release();
+}
+
+
+} } // namespace Ubitrack::Drivers
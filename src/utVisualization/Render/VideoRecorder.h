@@ -0,0 +1,105 @@
+/*
+ * Ubitrack - Library for Ubiquitous Tracking
+ * Copyright 2006, Technische Universitaet Muenchen, and individual
+ * contributors as indicated by the @authors tag. See the
+ * copyright.txt in the distribution for a full listing of individual
+ * contributors.
+ *
+ * This is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this software; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA, or see the FSF site: http://www.fsf.org.
+ */
+
+/**
+ * @file
+ * Recording of the rendered frames to a video file
+ */
+
+#ifndef _VIDEORECORDER_H_
+#define _VIDEORECORDER_H_
+
+#include <boost/scoped_ptr.hpp>
+#include "RenderModule.h"
+#include "PixelReadback.h"
+
+namespace Ubitrack { namespace Drivers {
+
+class FrameEncoder;
+
+/**
+ * @ingroup driver_components
+ * Records the rendered frames to a video file or an image sequence.
+ * The frames are read back through pixel buffer objects without stalling the render loop
+ * and encoded by a thread pool. Frames are dropped and counted instead of delaying the
+ * rendering when the encoder cannot keep up. The total number of dropped frames is pushed
+ * on "Dropped" when it changes.
+ */
+class VideoRecorder
+	: public VirtualObject
+{
+public:
+
+	/**
+	 * Constructor
+	 * @param name edge name
+	 * @param config component configuration
+	 * @param componentKey the unique identifier for this component
+	 * @param pModule parent object
+	 */
+	VideoRecorder( const std::string& name, boost::shared_ptr< Graph::UTQLSubgraph > subgraph, 
+		const VirtualObjectKey& componentKey, VirtualCamera* pModule );
+
+	/** stops the encoder after writing the queued frames */
+	~VideoRecorder();
+
+	/** hands finished reads to the encoder and starts reading the finished frame */
+	virtual void drawFinished( Measurement::Timestamp& t, int parity );
+
+	virtual void glCleanup();
+
+protected:
+
+	/** copies the oldest read into a free encoder frame, or drops it */
+	void collect();
+
+	/** logs and pushes the number of dropped frames, at most once per second */
+	void reportDrops( bool bFinal );
+
+	/** total number of dropped frames */
+	PushSupplier< Measurement::Distance > m_droppedPort;
+
+	/** output file, image sequences contain a format specifier like "frame_%06d.png" */
+	std::string m_path;
+	double m_fps;
+	int m_queueSize;
+	int m_encoderThreads;
+
+	PixelReadback m_readback;
+
+	/** whether pixel buffer objects are available, checked with the first frame */
+	bool m_bAsync;
+	bool m_bInitialized;
+
+	boost::scoped_ptr< FrameEncoder > m_pEncoder;
+
+	/** frames dropped because the encoder was busy or the recording failed */
+	unsigned long m_nDropped;
+	unsigned long m_nDroppedReported;
+	Measurement::Timestamp m_lastDropReport;
+};
+
+
+} } // namespace Ubitrack::Drivers
+
+#endif
@@ -31,50 +31,204 @@
 
 #include "VideoSync.h"
 
+#include <string>
+#include <log4cpp/Category.hh>
+
+#if defined( __linux__ )
+	#include <time.h>
+	#include <unistd.h>
+	#include <sys/timerfd.h>
+#endif
+
+extern log4cpp::Category& logger;
+
 void VideoSync::alarm( int ) { cont = 1; }
 int  VideoSync::cont = 0;
 
 int VideoSync::getFrame() { return frame; }
 
+
+void VideoSync::swapNow()
+{
+	glutSwapBuffers();
+	m_scheduler.swappedNow();
+}
+
+
+void VideoSync::swap( int flag, bool bScheduled )
+{
+	// pacing and swap interval apply in both cases
+	wait( flag );
+
+	// adaptive vsync is done by the swap interval, as scheduled swaps never tear
+	if ( !bScheduled || flag != syncOn || !m_scheduler.available() || !m_scheduler.swap() )
+		swapNow();
+}
+
+int VideoSync::getRetrace()
+{
+	boost::int64_t msc;
+	if ( !m_scheduler.available() || !m_scheduler.getRetrace( msc ) )
+		return getRetraceCount();
+	return static_cast< int >( msc );
+}
+
 #ifdef _WIN32
 
-	VideoSync::VideoSync( int fps ) {
+	VideoSync::VideoSync( int fps )
+		: m_timerFd( -1 )
+		, m_bSwapControlChecked( false )
+		, m_bSwapControlTear( false )
+	{
 		wglSwapIntervalEXT = (PFNWGLSWAPINTERVALFARPROC)wglGetProcAddress( "wglSwapIntervalEXT" );
 		state = 0;
 		frame = 0;
 	}
 
+	VideoSync::~VideoSync() {}
+
 	void VideoSync::wait( int flag ) {
 		frame++;
-		if (flag == state) return;
-		if (wglSwapIntervalEXT) wglSwapIntervalEXT( flag );
-		state = flag;
+		setSwapInterval( flag );
 	}
 
-	int VideoSync::getRetrace() { return frame; }
+	bool VideoSync::setSwapInterval( int flag ) {
+		if (!wglSwapIntervalEXT) return false;
+
+		if ( !m_bSwapControlChecked )
+		{
+			// the extension string can only be queried with a current context
+			typedef const char* (WINAPI *PFNWGLGETEXTENSIONSSTRINGARBPROC)( HDC );
+			typedef const char* (WINAPI *PFNWGLGETEXTENSIONSSTRINGEXTPROC)( void );
+			PFNWGLGETEXTENSIONSSTRINGARBPROC getExtensionsARB = (PFNWGLGETEXTENSIONSSTRINGARBPROC)wglGetProcAddress( "wglGetExtensionsStringARB" );
+			PFNWGLGETEXTENSIONSSTRINGEXTPROC getExtensionsEXT = (PFNWGLGETEXTENSIONSSTRINGEXTPROC)wglGetProcAddress( "wglGetExtensionsStringEXT" );
+			const char* extensions = getExtensionsARB ? getExtensionsARB( wglGetCurrentDC() ) : getExtensionsEXT ? getExtensionsEXT() : 0;
+			m_bSwapControlTear = extensions && std::string( extensions ).find( "WGL_EXT_swap_control_tear" ) != std::string::npos;
+			m_bSwapControlChecked = true;
+
+			LOG4CPP_INFO( logger, "VideoSync: swap control WGL_EXT_swap_control" << ( m_bSwapControlTear ? " with adaptive vsync" : "" ) );
+		}
+
+		// a negative interval enables adaptive vsync, which needs WGL_EXT_swap_control_tear, otherwise use normal vsync
+		int interval = flag ? 1 : 0;
+		if ( flag == syncAdaptive )
+		{
+			if ( m_bSwapControlTear )
+				interval = -1;
+			else if ( interval != state )
+				LOG4CPP_WARN( logger, "VideoSync: adaptive vsync needs WGL_EXT_swap_control_tear, using normal vsync" );
+		}
+
+		if ( interval == state ) return true;
+		wglSwapIntervalEXT( interval );
+		state = interval;
+		return true;
+	}
+
+	int VideoSync::getRetraceCount() { return frame; }
 
 #elif __APPLE__
 
-	VideoSync::VideoSync( int fps ) {
+	VideoSync::VideoSync( int fps )
+		: m_timerFd( -1 )
+	{
 		state = 0;
 		frame = 0;
 	}
 
+	VideoSync::~VideoSync() {}
+
 	void VideoSync::wait( int flag ) {
 		frame++;
-		if (flag == state) return;
-		const GLint tmp = flag;
+		setSwapInterval( flag );
+	}
+
+	bool VideoSync::setSwapInterval( int flag ) {
+		if (flag == state) return true;
+		// no adaptive vsync on OS X
+		const GLint tmp = flag ? 1 : 0;
 		CGLSetParameter( CGLGetCurrentContext(), kCGLCPSwapInterval, &tmp );
 		state = flag;
+		return true;
 	}
 
-	int VideoSync::getRetrace() { return frame; }
+	int VideoSync::getRetraceCount() { return frame; }
 
 #else
 
 	#include <signal.h>
 	#include <unistd.h>
 	#include <sys/time.h>
+	#include <string.h>
+
+	namespace {
+
+	/** timing of the current GLX drawable based on GLX_OML_sync_control */
+	class OMLSyncSource
+		: public SyncSource
+	{
+	public:
+
+		OMLSyncSource()
+			: m_bChecked( false )
+			, m_bAvailable( false )
+		{
+			m_getSyncValues = (pglXGetSyncValuesOML) glXGetProcAddress( (const GLubyte*)"glXGetSyncValuesOML" );
+			m_swapBuffersMsc = (pglXSwapBuffersMscOML) glXGetProcAddress( (const GLubyte*)"glXSwapBuffersMscOML" );
+			m_waitForSbc = (pglXWaitForSbcOML) glXGetProcAddress( (const GLubyte*)"glXWaitForSbcOML" );
+		}
+
+		virtual bool available()
+		{
+			if ( !m_bChecked )
+			{
+				// the extension string can only be queried with a current context
+				Display* display = glXGetCurrentDisplay();
+				if ( !display )
+					return false;
+
+				const char* extensions = glXQueryExtensionsString( display, DefaultScreen( display ) );
+				m_bAvailable = extensions && strstr( extensions, "GLX_OML_sync_control" ) &&
+					m_getSyncValues && m_swapBuffersMsc && m_waitForSbc;
+				m_bChecked = true;
+
+				LOG4CPP_INFO( logger, "VideoSync: " << ( m_bAvailable ? "using GLX_OML_sync_control" :
+					"GLX_OML_sync_control not available, using GLX_SGI_video_sync" ) );
+			}
+			return m_bAvailable;
+		}
+
+		virtual bool getSyncValues( boost::int64_t& ust, boost::int64_t& msc, boost::int64_t& sbc )
+		{
+			return m_getSyncValues( glXGetCurrentDisplay(), glXGetCurrentDrawable(), &ust, &msc, &sbc ) == True;
+		}
+
+		virtual boost::int64_t swapBuffersMsc( boost::int64_t targetMsc )
+		{
+			return m_swapBuffersMsc( glXGetCurrentDisplay(), glXGetCurrentDrawable(), targetMsc, 0, 0 );
+		}
+
+		virtual bool waitForSbc( boost::int64_t sbc, boost::int64_t& ust, boost::int64_t& msc )
+		{
+			boost::int64_t reachedSbc = 0;
+			return m_waitForSbc( glXGetCurrentDisplay(), glXGetCurrentDrawable(), sbc, &ust, &msc, &reachedSbc ) == True;
+		}
+
+	protected:
+
+		typedef Bool (*pglXGetSyncValuesOML)( Display*, GLXDrawable, boost::int64_t* ust, boost::int64_t* msc, boost::int64_t* sbc );
+		typedef boost::int64_t (*pglXSwapBuffersMscOML)( Display*, GLXDrawable, boost::int64_t target, boost::int64_t divisor, boost::int64_t remainder );
+		typedef Bool (*pglXWaitForSbcOML)( Display*, GLXDrawable, boost::int64_t target, boost::int64_t* ust, boost::int64_t* msc, boost::int64_t* sbc );
+
+		pglXGetSyncValuesOML m_getSyncValues;
+		pglXSwapBuffersMscOML m_swapBuffersMsc;
+		pglXWaitForSbcOML m_waitForSbc;
+
+		bool m_bChecked;
+		bool m_bAvailable;
+	};
+
+	} // anonymous namespace
 
 	/**
 	 * create a video sync object
@@ -83,22 +237,103 @@ int VideoSync::getFrame() { return frame; }
 	 *
 	 */
 	VideoSync::VideoSync( int fps )
+		: m_scheduler( boost::shared_ptr< SyncSource >( new OMLSyncSource() ) )
+		, m_timerFd( -1 )
+		, m_bSwapControlChecked( false )
+		, m_bSwapControlTear( false )
 	{
 		mode = fps;
 		frame = 0;
+		state = -1;
 
 		glXGetVideoSyncSGI  = (pglXGetVideoSyncSGI)  glXGetProcAddress( (const GLubyte*)"glXGetVideoSyncSGI"  );
 		glXWaitVideoSyncSGI = (pglXWaitVideoSyncSGI) glXGetProcAddress( (const GLubyte*)"glXWaitVideoSyncSGI" );
+		glXSwapIntervalEXT  = 0;
+		glXSwapIntervalMESA = 0;
+		glXSwapIntervalSGI  = 0;
 
-		/*if (mode) {
-			int usec = 1000000 / fps;
-			struct itimerval delay = { { 0, usec }, { 0, usec } };
-			signal( SIGALRM, alarm );
-			setitimer( ITIMER_REAL, &delay, 0 );
-		}*/
+#if defined( __linux__ )
+		// software pacing with a timer the render thread sleeps on
+		if ( mode > 0 )
+		{
+			m_timerFd = timerfd_create( CLOCK_MONOTONIC, TFD_CLOEXEC );
+			long period = 1000000000L / mode;
+			struct itimerspec delay = { { period / 1000000000L, period % 1000000000L }, { period / 1000000000L, period % 1000000000L } };
+			if ( m_timerFd < 0 || timerfd_settime( m_timerFd, 0, &delay, 0 ) != 0 )
+			{
+				LOG4CPP_ERROR( logger, "VideoSync: cannot create frame timer for " << mode << " fps" );
+				if ( m_timerFd >= 0 )
+					close( m_timerFd );
+				m_timerFd = -1;
+			}
+		}
+#endif
 	}
 
-	int VideoSync::getRetrace()
+	VideoSync::~VideoSync()
+	{
+#if defined( __linux__ )
+		if ( m_timerFd >= 0 )
+			close( m_timerFd );
+#endif
+	}
+
+	bool VideoSync::setSwapInterval( int flag )
+	{
+		if ( !m_bSwapControlChecked )
+		{
+			// the extension string can only be queried with a current context
+			Display* display = glXGetCurrentDisplay();
+			if ( !display )
+				return false;
+
+			const char* extensions = glXQueryExtensionsString( display, DefaultScreen( display ) );
+			std::string ext( extensions ? extensions : "" );
+			if ( ext.find( "GLX_EXT_swap_control" ) != std::string::npos )
+				glXSwapIntervalEXT = (pglXSwapIntervalEXT) glXGetProcAddress( (const GLubyte*)"glXSwapIntervalEXT" );
+			else if ( ext.find( "GLX_MESA_swap_control" ) != std::string::npos )
+				glXSwapIntervalMESA = (pglXSwapIntervalMESA) glXGetProcAddress( (const GLubyte*)"glXSwapIntervalMESA" );
+			else if ( ext.find( "GLX_SGI_swap_control" ) != std::string::npos )
+				glXSwapIntervalSGI = (pglXSwapIntervalSGI) glXGetProcAddress( (const GLubyte*)"glXSwapIntervalSGI" );
+			m_bSwapControlTear = glXSwapIntervalEXT && ext.find( "GLX_EXT_swap_control_tear" ) != std::string::npos;
+			m_bSwapControlChecked = true;
+
+			LOG4CPP_INFO( logger, "VideoSync: swap control " << ( glXSwapIntervalEXT ? "GLX_EXT_swap_control" :
+				glXSwapIntervalMESA ? "GLX_MESA_swap_control" : glXSwapIntervalSGI ? "GLX_SGI_swap_control" : "not available" )
+				<< ( m_bSwapControlTear ? " with adaptive vsync" : "" ) );
+		}
+
+		// adaptive vsync needs GLX_EXT_swap_control_tear, otherwise use normal vsync
+		int interval = flag ? 1 : 0;
+		if ( flag == syncAdaptive && m_bSwapControlTear )
+			interval = -1;
+
+		if ( glXSwapIntervalEXT )
+		{
+			if ( interval != state )
+				glXSwapIntervalEXT( glXGetCurrentDisplay(), glXGetCurrentDrawable(), interval );
+		}
+		else if ( glXSwapIntervalMESA )
+		{
+			if ( interval != state )
+				glXSwapIntervalMESA( interval );
+		}
+		else if ( glXSwapIntervalSGI )
+		{
+			// cannot disable vsync, fall back to not waiting
+			if ( interval != state && interval > 0 )
+				glXSwapIntervalSGI( interval );
+			if ( interval == 0 )
+				return false;
+		}
+		else
+			return false;
+
+		state = interval;
+		return true;
+	}
+
+	int VideoSync::getRetraceCount()
 	{
 		//if (mode) return frame;
 		unsigned int retraceCount = 0;
@@ -109,11 +344,23 @@ int VideoSync::getFrame() { return frame; }
 	void VideoSync::wait( int flag )
 	{
 		frame++;
-		if (!flag) return;
-		//if (mode) { while (!cont) usleep(100); cont = 0; return; }
-		unsigned int retraceCount = getRetrace();
+
+#if defined( __linux__ )
+		// sleep until the next tick of the frame timer
+		if ( m_timerFd >= 0 )
+		{
+			boost::uint64_t expirations = 0;
+			if ( read( m_timerFd, &expirations, sizeof( expirations ) ) == sizeof( expirations ) && expirations > 1 )
+				LOG4CPP_DEBUG( logger, "VideoSync: missed " << ( expirations - 1 ) << " timer ticks" );
+		}
+#endif
+
+		// with swap control, the driver blocks in the buffer swap instead of the render thread spinning here
+		if ( setSwapInterval( flag ) || !flag )
+			return;
+
+		unsigned int retraceCount = getRetraceCount();
 		if (glXWaitVideoSyncSGI) glXWaitVideoSyncSGI(2, (retraceCount+1)%2, &retraceCount);
 	}
 
 #endif
-
@@ -29,6 +29,8 @@
  * @author Florian Echtler <echtler@in.tum.de>
  */
 
+#ifndef __VideoSync_h_INCLUDED__
+#define __VideoSync_h_INCLUDED__
 
 // This opencv include is needed as a workaround to avoid "Status" macro/enum issue in glew.h and stirching.hpp on linux systems
 #ifndef _WIN32
@@ -48,30 +50,84 @@
 	#include <GL/glx.h>
 #endif
 
+#include "SwapScheduler.h"
+
 class VideoSync {
 
 	public:
 
+		/** vsync flags */
+		enum { syncOff = 0, syncOn = 1, syncAdaptive = 2 };
+
+		/**
+		 * @param fps paces the frames with a timer if > 0, e.g. for offscreen rendering (Linux only)
+		 */
 		VideoSync( int fps = 0 );
 
+		~VideoSync();
+
+		/**
+		 * prepares the next buffer swap
+		 * @param flag syncOff, syncOn or syncAdaptive (late frames are swapped immediately, may tear)
+		 */
 		void wait( int flag );
 
+		/**
+		 * waits for the screen refresh if flag is set and swaps the buffers of the current window.
+		 * @param bScheduled schedule the swap for the retrace returned by getRetrace() and wait for it,
+		 *   if vsync is on and a sync source is available (for frame-sequential stereo)
+		 */
+		void swap( int flag, bool bScheduled = false );
+
 		int getFrame();
+
+		/** number of the retrace the next frame will be shown at (only an estimate without sync source) */
 		int getRetrace();
 
+		/** number of retraces the scheduled swaps were late */
+		unsigned long getDroppedFrames() { return m_scheduler.getDroppedFrames(); }
+
+		/** time the last frame was shown */
+		Ubitrack::Measurement::Timestamp getLastPresentTime() { return m_scheduler.getLastPresentTime(); }
+
+		/** true if the last present time was reported by the display, false if it is the return time of the swap */
+		bool isPresentTimeMeasured() { return m_scheduler.isPresentTimeMeasured(); }
+
+		/** replaces the timing source, e.g. by a mock */
+		void setSyncSource( boost::shared_ptr< SyncSource > pSource ) { m_scheduler.setSyncSource( pSource ); }
+
 		static void alarm(int);
 
 	private:
 
+		/** swaps immediately, the present time is estimated by the return of the swap */
+		void swapNow();
+
+		/** retrace counter of the platform, without sync source */
+		int getRetraceCount();
+
+		/** sets the swap interval of the current drawable, returns false if swap control is not supported */
+		bool setSwapInterval( int flag );
+
 		int state, frame, mode;
 		static int cont;
 
+		/** scheduled swaps and present times */
+		SwapScheduler m_scheduler;
+
+		/** timer for software pacing, -1 if not used */
+		int m_timerFd;
+
 #ifdef _WIN32
 
 		typedef BOOL (APIENTRY *PFNWGLSWAPINTERVALFARPROC)( int );
 
 		PFNWGLSWAPINTERVALFARPROC wglSwapIntervalEXT;
 
+		/** WGL_EXT_swap_control_tear, determined with the first current context */
+		bool m_bSwapControlChecked;
+		bool m_bSwapControlTear;
+
 #elif __APPLE__
 
 
@@ -83,7 +139,20 @@ class VideoSync {
 		pglXGetVideoSyncSGI  glXGetVideoSyncSGI;
 		pglXWaitVideoSyncSGI glXWaitVideoSyncSGI;
 
+		typedef void (*pglXSwapIntervalEXT)( Display* display, GLXDrawable drawable, int interval );
+		typedef int (*pglXSwapIntervalMESA)( unsigned int interval );
+		typedef int (*pglXSwapIntervalSGI)( int interval );
+
+		pglXSwapIntervalEXT  glXSwapIntervalEXT;
+		pglXSwapIntervalMESA glXSwapIntervalMESA;
+		pglXSwapIntervalSGI  glXSwapIntervalSGI;
+
+		/** swap control extensions, determined with the first current context */
+		bool m_bSwapControlChecked;
+		bool m_bSwapControlTear;
+
 #endif
 
 };
 
+#endif
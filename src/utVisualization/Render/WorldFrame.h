@@ -64,6 +64,10 @@ public:
 		
 	/** render the object */
 	virtual void draw3DContent( Measurement::Timestamp&, int );
+
+	/** may be replayed for the second eye with single-pass stereo */
+	virtual bool isEyeIndependent()
+	{ return true; }
 	
 	GLuint LoadTextureRAW( const char * filename, int wrap );
 	
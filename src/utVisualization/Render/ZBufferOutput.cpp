@@ -21,45 +21,301 @@
  * 02110-1301 USA, or see the FSF site: http://www.fsf.org.
  */
 
+#ifdef HAVE_GLEW
+	#include "GL/glew.h"
+#endif
+
+#include <cstring>
+#include <algorithm>
+#include <utUtil/Exception.h>
 #include "ZBufferOutput.h"
+#include "Shader.h"
 
 namespace Ubitrack { namespace Drivers {
 
+namespace {
+
+/** converts window depth to the distance to the image plane, 0 for the far plane */
+const char* g_linearDepthShader =
+	"uniform sampler2D depth;\n"
+	"uniform vec2 size;\n"
+	"uniform vec4 projection;\n"
+	"void main()\n"
+	"{\n"
+	"	float d = texture2D( depth, gl_FragCoord.xy / size ).r;\n"
+	"	float z = 2.0 * d - 1.0;\n"
+	"	float eyeZ = ( projection.y - z * projection.w ) / ( z * projection.z - projection.x );\n"
+	"	gl_FragColor = vec4( d < 1.0 ? -eyeZ : 0.0 );\n"
+	"}\n";
+
+} // anonymous namespace
+
+
 ZBufferOutput::ZBufferOutput( const std::string& name, boost::shared_ptr< Graph::UTQLSubgraph > subgraph, 
 	const VirtualObjectKey& componentKey, VirtualCamera* pModule )
 	: VirtualObject( name, subgraph, componentKey, pModule )
 	, m_port( "Output", *this )
-	, m_width(0)
-	, m_height(0)
+	, m_depthFormat( depthByte )
+	, m_readback( 2 )
+	, m_bAsync( false )
+	, m_bLinearizeOnGPU( false )
+	, m_bInitialized( false )
+	, m_depthTexture( 0 )
+	, m_depthTextureWidth( 0 )
+	, m_depthTextureHeight( 0 )
+	, m_linearProgram( 0 )
 {
+	if ( subgraph->m_DataflowAttributes.hasAttribute( "depthFormat" ) )
+	{
+		std::string format = subgraph->m_DataflowAttributes.getAttributeString( "depthFormat" );
+		if ( format == "float" )
+			m_depthFormat = depthFloat;
+		else if ( format == "linear" )
+			m_depthFormat = depthLinear;
+		else if ( format != "byte" )
+			UBITRACK_THROW( "Unknown depthFormat " + format );
+	}
+
+	int readbackBuffers = 2;
+	subgraph->m_DataflowAttributes.getAttributeData( "readbackBuffers", readbackBuffers );
+	m_readback = PixelReadback( std::max( readbackBuffers, 1 ) );
 }
 
-/** render the object */
-void ZBufferOutput::draw( Measurement::Timestamp&, int parity )
+/** reads the depth of the finished frame, after the stereo passes and with the whole-window viewport */
+void ZBufferOutput::drawFinished( Measurement::Timestamp&, int parity )
 {
-	unsigned char* data;
-	if ((m_width != m_pModule->m_width) || (m_height != m_pModule->m_height))
+	// like ImageOutput, only one eye of frame sequential stereo is read
+	if ( parity )
+		return;
+
+	int width = m_pModule->m_width;
+	int height = m_pModule->m_height;
+	if ( !m_bInitialized )
+	{
+		m_bInitialized = true;
+		m_bAsync = PixelReadback::supported();
+		if ( !m_bAsync )
+			LOG4CPP_WARN( logger, getName() << ": pixel buffer objects are not supported, the depth is read synchronously" );
+
+		if ( m_depthFormat == depthLinear )
+		{
+		#ifdef HAVE_GLEW
+			if ( RenderTarget::supported() && ( GLEW_VERSION_3_0 || GLEW_ARB_texture_rg ) )
+				m_linearProgram = compileShaderProgram( 0, g_linearDepthShader );
+		#endif
+			m_bLinearizeOnGPU = m_linearProgram != 0;
+			if ( !m_bLinearizeOnGPU )
+				LOG4CPP_WARN( logger, getName() << ": linear depth requires framebuffer objects, float textures and GLSL, computing it on the CPU" );
+		}
+	}
+
+	// send the finished reads, the oldest one has to be taken if no buffer is free for this frame
+	while ( m_readback.pending() && m_readback.finished( m_readback.pending() == m_readback.size() ) )
+		collect();
+
+	PendingRead read = { { 0, 0, 0, 0 }, false };
+	if ( m_depthFormat == depthLinear )
+		read.projection = depthProjection();
+
+	GLenum format = GL_DEPTH_COMPONENT;
+	GLenum type = m_depthFormat == depthByte ? GL_UNSIGNED_BYTE : GL_FLOAT;
+	std::size_t rowBytes = static_cast< std::size_t >( width ) * ( m_depthFormat == depthByte ? 1 : 4 );
+
+#ifdef HAVE_GLEW
+	GLint oldFramebuffer = 0;
+	GLint viewport[ 4 ];
+	if ( m_bLinearizeOnGPU )
+	{
+		glGetIntegerv( GL_FRAMEBUFFER_BINDING, &oldFramebuffer );
+		glGetIntegerv( GL_VIEWPORT, viewport );
+		if ( linearize( width, height, read.projection ) )
+		{
+			// read the linear depth from the target, which is still bound
+			format = GL_RED;
+			read.bLinearized = true;
+		}
+		else
+		{
+			LOG4CPP_ERROR( logger, getName() << ": linearizing the depth failed, computing it on the CPU" );
+			m_bLinearizeOnGPU = false;
+			glBindFramebuffer( GL_FRAMEBUFFER, oldFramebuffer );
+		}
+	}
+#endif
+
+	if ( m_bAsync )
 	{
-		m_width  = m_pModule->m_width;
-		m_height = m_pModule->m_height;
-		if ((m_zBuffer) && (m_zBuffer->Mat().data)) delete (unsigned char*)(m_zBuffer->Mat().data);
-		data = new unsigned char[m_width*m_height];
-		m_zBuffer = boost::shared_ptr< Vision::Image >( new Vision::Image( m_width, m_height, 1, data, IPL_DEPTH_8U ) );
+		if ( m_readback.start( 0, 0, width, height, format, type, rowBytes, Measurement::now() ) )
+			m_pendingReads.push_back( read );
 	}
+	else
+	{
+		m_buffer.resize( rowBytes * height );
+		GLint alignment;
+		glGetIntegerv( GL_PACK_ALIGNMENT, &alignment );
+		glPixelStorei( GL_PACK_ALIGNMENT, 1 );
+		glReadPixels( 0, 0, width, height, format, type, &m_buffer[ 0 ] );
+		glPixelStorei( GL_PACK_ALIGNMENT, alignment );
 
-	m_zBuffer->set_origin(1);
-	data = (unsigned char*)m_zBuffer->Mat().data;
-	glReadPixels(0, 0, m_width, m_height, GL_DEPTH_COMPONENT, GL_UNSIGNED_BYTE, data ); 
+		m_pendingReads.push_back( read );
+		send( &m_buffer[ 0 ], width, height, Measurement::now() );
+	}
 
-	/*for(int a = 0; a < m_width*m_height; a++)
+#ifdef HAVE_GLEW
+	if ( read.bLinearized )
 	{
-		if (data[a] != 255) std::cout << (int)data[a] << " ";
-		//if(data[a] == 1.0) data[a] = 0.0;
-		//if(data[a]  > 0.9) data[a] = 0.5;
-	}*/
+		glBindFramebuffer( GL_FRAMEBUFFER, oldFramebuffer );
+		glViewport( viewport[ 0 ], viewport[ 1 ], viewport[ 2 ], viewport[ 3 ] );
+	}
+#endif
+}
+
 
-	m_port.send( Measurement::ImageMeasurement( Measurement::now(), m_zBuffer ) );
+DepthProjection ZBufferOutput::depthProjection() const
+{
+	GLdouble m[ 16 ];
+	glGetDoublev( GL_PROJECTION_MATRIX, m );
+	return DepthProjection::fromMatrix( m, m_pModule->m_near, m_pModule->m_far );
 }
 
-} } // namespace Ubitrack::Drivers
 
+#ifdef HAVE_GLEW
+
+bool ZBufferOutput::linearize( int width, int height, const DepthProjection& projection )
+{
+	// copy the depth buffer of the current framebuffer, it cannot be sampled directly
+	glActiveTexture( GL_TEXTURE0 );
+	if ( !m_depthTexture )
+		glGenTextures( 1, &m_depthTexture );
+	glBindTexture( GL_TEXTURE_2D, m_depthTexture );
+	if ( width != m_depthTextureWidth || height != m_depthTextureHeight )
+	{
+		glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST );
+		glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST );
+		glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE );
+		glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE );
+		glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_COMPARE_MODE, GL_NONE );
+		glTexImage2D( GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT24, width, height, 0, GL_DEPTH_COMPONENT, GL_UNSIGNED_INT, 0 );
+		m_depthTextureWidth = width;
+		m_depthTextureHeight = height;
+	}
+	glCopyTexSubImage2D( GL_TEXTURE_2D, 0, 0, 0, 0, 0, width, height );
+
+	if ( !m_linearTarget.resize( width, height, GL_R32F ) )
+	{
+		glBindTexture( GL_TEXTURE_2D, 0 );
+		return false;
+	}
+	m_linearTarget.bind();
+
+	glPushAttrib( GL_ENABLE_BIT | GL_COLOR_BUFFER_BIT );
+	glDisable( GL_DEPTH_TEST );
+	glDisable( GL_SCISSOR_TEST );
+	glDisable( GL_LIGHTING );
+	glDisable( GL_BLEND );
+	glColorMask( GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE );
+
+	glMatrixMode( GL_PROJECTION );
+	glPushMatrix();
+	glLoadIdentity();
+	gluOrtho2D( 0.0, 1.0, 0.0, 1.0 );
+	glMatrixMode( GL_MODELVIEW );
+	glPushMatrix();
+	glLoadIdentity();
+
+	glUseProgram( m_linearProgram );
+	glUniform1i( glGetUniformLocation( m_linearProgram, "depth" ), 0 );
+	glUniform2f( glGetUniformLocation( m_linearProgram, "size" ), float( width ), float( height ) );
+	glUniform4f( glGetUniformLocation( m_linearProgram, "projection" ), 
+		projection.p22, projection.p23, projection.p32, projection.p33 );
+
+	glBegin( GL_TRIANGLE_STRIP );
+	glVertex2d( 0, 0 );
+	glVertex2d( 1, 0 );
+	glVertex2d( 0, 1 );
+	glVertex2d( 1, 1 );
+	glEnd();
+
+	glUseProgram( 0 );
+	glBindTexture( GL_TEXTURE_2D, 0 );
+
+	glPopMatrix();
+	glMatrixMode( GL_PROJECTION );
+	glPopMatrix();
+	glMatrixMode( GL_MODELVIEW );
+	glPopAttrib();
+	return true;
+}
+
+#else // HAVE_GLEW
+
+bool ZBufferOutput::linearize( int, int, const DepthProjection& )
+{
+	return false;
+}
+
+#endif // HAVE_GLEW
+
+
+void ZBufferOutput::collect()
+{
+	int width, height;
+	Measurement::Timestamp time;
+	const unsigned char* pData = m_readback.map( width, height, time );
+	if ( !pData )
+	{
+		m_readback.discard();
+		m_pendingReads.pop_front();
+		return;
+	}
+
+	send( pData, width, height, time );
+	m_readback.unmap();
+}
+
+
+void ZBufferOutput::send( const unsigned char* pData, int width, int height, Measurement::Timestamp time )
+{
+	PendingRead read = m_pendingReads.front();
+	m_pendingReads.pop_front();
+	const DepthProjection& p = read.projection;
+
+	// a new image each time, receivers may keep the previous ones
+	boost::shared_ptr< Vision::Image > pImage( new Vision::Image( width, height, 1, 
+		m_depthFormat == depthByte ? IPL_DEPTH_8U : IPL_DEPTH_32F ) );
+	pImage->set_origin( 1 );
+
+	std::size_t rowBytes = static_cast< std::size_t >( width ) * ( m_depthFormat == depthByte ? 1 : 4 );
+	for ( int y = 0; y < height; y++ )
+	{
+		const unsigned char* pSource = pData + y * rowBytes;
+		if ( m_depthFormat != depthLinear || read.bLinearized )
+			std::memcpy( pImage->Mat().ptr( y ), pSource, rowBytes );
+		else
+		{
+			const float* pDepth = reinterpret_cast< const float* >( pSource );
+			float* pDistance = pImage->Mat().ptr< float >( y );
+			for ( int x = 0; x < width; x++ )
+				pDistance[ x ] = p.distance( pDepth[ x ] );
+		}
+	}
+
+	m_port.send( Measurement::ImageMeasurement( time, pImage ) );
+}
+
+
+void ZBufferOutput::glCleanup()
+{
+	m_readback.release();
+	m_pendingReads.clear();
+	m_linearTarget.release();
+	deleteShaderProgram( m_linearProgram );
+#ifdef HAVE_GLEW
+	if ( m_depthTexture )
+		glDeleteTextures( 1, &m_depthTexture );
+#endif
+	m_depthTexture = 0;
+	m_depthTextureWidth = m_depthTextureHeight = 0;
+}
+
+} } // namespace Ubitrack::Drivers
@@ -24,7 +24,11 @@
 #ifndef _ZBUFFEROUTPUT_H_
 #define _ZBUFFEROUTPUT_H_
 
+#include <deque>
 #include "RenderModule.h"
+#include "RenderTarget.h"
+#include "PixelReadback.h"
+#include "DepthProjection.h"
 #include <utVision/Image.h>
 
 namespace Ubitrack { namespace Drivers {
@@ -33,7 +37,17 @@ namespace Ubitrack { namespace Drivers {
 /**
  * @ingroup driver_components
  * Component for Z-Buffer output.
- * Provides a push-out port for the grey-level image.
+ * Provides a push-out port for the depth image, bottom row first. Depending on the
+ * depthFormat attribute the image contains
+ * - byte: window depth quantized to 8 bits (the default),
+ * - float: window depth as 32 bit float in [0, 1],
+ * - linear: distance to the image plane of the camera as 32 bit float, in scene units,
+ *   0 where nothing was rendered.
+ *
+ * Linear depth is computed from the active projection matrix in a shader pass before the
+ * readback, or on the CPU if shaders or framebuffer objects are not available. The depth
+ * is read back through pixel buffer objects, so an image is sent one or two frames after
+ * it was rendered.
  */
 class ZBufferOutput
 	: public VirtualObject
@@ -50,19 +64,63 @@ public:
 	ZBufferOutput( const std::string& name, boost::shared_ptr< Graph::UTQLSubgraph > subgraph, 
 		const VirtualObjectKey& componentKey, VirtualCamera* pModule );
 
-	/** render the object */
-	virtual void draw( Measurement::Timestamp&, int parity );
+	/** reads the depth of the finished frame */
+	virtual void drawFinished( Measurement::Timestamp&, int parity );
+
+	virtual void glCleanup();
 
 protected:
 
+	enum DepthFormat { depthByte, depthFloat, depthLinear };
+
+	struct PendingRead
+	{
+		DepthProjection projection;
+
+		/** whether the read contains linear depth already */
+		bool bLinearized;
+	};
+
+	/** coefficients of the active projection, falls back to the near and far planes of the module */
+	DepthProjection depthProjection() const;
+
+	/** linearizes the depth of the current framebuffer into m_linearTarget, returns false on errors */
+	bool linearize( int width, int height, const DepthProjection& projection );
+
+	/** sends the oldest read */
+	void collect();
+
+	/**
+	 * sends an image read back from GL
+	 * @param pData bottom row first, rows packed
+	 */
+	void send( const unsigned char* pData, int width, int height, Measurement::Timestamp time );
+
 	PushSupplier< Ubitrack::Measurement::ImageMeasurement > m_port;
-	boost::shared_ptr< Vision::Image > m_zBuffer;
 
-	int m_width, m_height;
+	DepthFormat m_depthFormat;
+
+	PixelReadback m_readback;
+
+	/** whether pixel buffer objects, and for linear depth shaders, are available, checked with the first frame */
+	bool m_bAsync;
+	bool m_bLinearizeOnGPU;
+	bool m_bInitialized;
+
+	/** reads not sent yet, in the order they were started */
+	std::deque< PendingRead > m_pendingReads;
+
+	/** copy of the depth buffer and target of the linearization pass */
+	GLuint m_depthTexture;
+	int m_depthTextureWidth, m_depthTextureHeight;
+	RenderTarget m_linearTarget;
+	GLuint m_linearProgram;
+
+	/** frames are read here without pixel buffer objects */
+	std::vector< unsigned char > m_buffer;
 };
 
 
 } } // namespace Ubitrack::Drivers
 
 #endif
-
@@ -0,0 +1,154 @@
+/*
+ * Ubitrack - Library for Ubiquitous Tracking
+ * Copyright 2006, Technische Universitaet Muenchen, and individual
+ * contributors as indicated by the @authors tag. See the
+ * copyright.txt in the distribution for a full listing of individual
+ * contributors.
+ *
+ * This is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this software; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA, or see the FSF site: http://www.fsf.org.
+ */
+
+/**
+ * @file
+ * Tests the linear depth of the ZBufferOutput component
+ *
+ * Projects points at known distances with the matrices of gluPerspective, glFrustum and
+ * glOrtho, converts their window depth back with DepthProjection and compares the result
+ * with the distance. The window depth is rounded to float like a 32 bit depth buffer.
+ * Returns 1 if a check fails.
+ */
+
+#include <cmath>
+#include <cstdio>
+#include <algorithm>
+#include "DepthProjection.h"
+
+using namespace Ubitrack::Drivers;
+
+namespace {
+
+int g_failures = 0;
+
+/** column major matrix of glFrustum */
+void frustum( double* m, double left, double right, double bottom, double top, double zNear, double zFar )
+{
+	for ( int i = 0; i < 16; i++ )
+		m[ i ] = 0.0;
+	m[ 0 ] = 2.0 * zNear / ( right - left );
+	m[ 5 ] = 2.0 * zNear / ( top - bottom );
+	m[ 8 ] = ( right + left ) / ( right - left );
+	m[ 9 ] = ( top + bottom ) / ( top - bottom );
+	m[ 10 ] = -( zFar + zNear ) / ( zFar - zNear );
+	m[ 11 ] = -1.0;
+	m[ 14 ] = -2.0 * zFar * zNear / ( zFar - zNear );
+}
+
+/** column major matrix of gluPerspective */
+void perspective( double* m, double fovy, double aspect, double zNear, double zFar )
+{
+	double top = zNear * std::tan( fovy * 3.14159265358979323846 / 360.0 );
+	frustum( m, -top * aspect, top * aspect, -top, top, zNear, zFar );
+}
+
+/** column major matrix of glOrtho */
+void ortho( double* m, double left, double right, double bottom, double top, double zNear, double zFar )
+{
+	for ( int i = 0; i < 16; i++ )
+		m[ i ] = 0.0;
+	m[ 0 ] = 2.0 / ( right - left );
+	m[ 5 ] = 2.0 / ( top - bottom );
+	m[ 10 ] = -2.0 / ( zFar - zNear );
+	m[ 12 ] = -( right + left ) / ( right - left );
+	m[ 13 ] = -( top + bottom ) / ( top - bottom );
+	m[ 14 ] = -( zFar + zNear ) / ( zFar - zNear );
+	m[ 15 ] = 1.0;
+}
+
+/** window depth of a point at the given distance in front of the camera, as the depth buffer stores it */
+float windowDepth( const double* m, double distance )
+{
+	double eyeZ = -distance;
+	double clipZ = m[ 10 ] * eyeZ + m[ 14 ];
+	double clipW = m[ 11 ] * eyeZ + m[ 15 ];
+	return static_cast< float >( 0.5 * clipZ / clipW + 0.5 );
+}
+
+/** checks the distance of points between the near and the far plane */
+void checkRange( const char* name, const double* m, const DepthProjection& p, double zNear, double zFar, double tolerance )
+{
+	double worst = 0.0;
+	for ( int i = 0; i <= 100; i++ )
+	{
+		double distance = zNear + ( zFar - zNear ) * i / 100.0;
+		float depth = windowDepth( m, distance );
+		if ( depth >= 1.0f )
+			continue;
+		worst = std::max( worst, std::fabs( p.distance( depth ) - distance ) / distance );
+	}
+
+	bool bOk = worst <= tolerance;
+	std::printf( "%-44s max relative error %.2g%s\n", name, worst, bOk ? "" : " FAILED" );
+	if ( !bOk )
+		g_failures++;
+}
+
+void check( const char* name, bool bOk )
+{
+	std::printf( "%-44s %s\n", name, bOk ? "ok" : "FAILED" );
+	if ( !bOk )
+		g_failures++;
+}
+
+} // anonymous namespace
+
+
+int main( int, char** )
+{
+	double m[ 16 ];
+
+	// the default planes of the render module, far away a float depth buffer resolves about 3e-4
+	perspective( m, 45.0, 4.0 / 3.0, 0.01, 100.0 );
+	checkRange( "gluPerspective( 45, 4/3, 0.01, 100 )", m, DepthProjection::fromMatrix( m, 1.0, 2.0 ), 0.01, 100.0, 1e-3 );
+
+	perspective( m, 60.0, 16.0 / 9.0, 0.1, 10.0 );
+	checkRange( "gluPerspective( 60, 16/9, 0.1, 10 )", m, DepthProjection::fromMatrix( m, 1.0, 2.0 ), 0.1, 10.0, 1e-4 );
+
+	// off-axis projections like the ones from camera intrinsics only differ in the first two columns
+	frustum( m, -0.02, 0.05, -0.01, 0.03, 0.05, 20.0 );
+	checkRange( "glFrustum( -0.02, 0.05, -0.01, 0.03, 0.05, 20 )", m, DepthProjection::fromMatrix( m, 1.0, 2.0 ), 0.05, 20.0, 1e-4 );
+
+	// orthographic depth is linear already
+	ortho( m, -1.0, 1.0, -1.0, 1.0, 0.5, 50.0 );
+	checkRange( "glOrtho( -1, 1, -1, 1, 0.5, 50 )", m, DepthProjection::fromMatrix( m, 1.0, 2.0 ), 0.5, 50.0, 1e-5 );
+
+	// nothing rendered
+	perspective( m, 45.0, 1.0, 0.1, 100.0 );
+	check( "far plane gives 0", DepthProjection::fromMatrix( m, 1.0, 2.0 ).distance( 1.0f ) == 0.0f );
+
+	// a projection without depth rows falls back to the near and far planes
+	double flat[ 16 ] = { 1, 0, 0, 0,  0, 1, 0, 0,  0, 0, 0, 0,  0, 0, 0, 1 };
+	DepthProjection fallback = DepthProjection::fromMatrix( flat, 0.1, 100.0 );
+	perspective( m, 45.0, 1.0, 0.1, 100.0 );
+	checkRange( "fallback to near 0.1 and far 100", m, fallback, 0.1, 100.0, 1e-4 );
+
+	if ( g_failures )
+	{
+		std::fprintf( stderr, "%d checks failed\n", g_failures );
+		return 1;
+	}
+	std::printf( "all checks passed\n" );
+	return 0;
+}
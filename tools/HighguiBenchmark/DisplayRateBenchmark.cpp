@@ -0,0 +1,123 @@
+/*
+ * Ubitrack - Library for Ubiquitous Tracking
+ * Copyright 2006, Technische Universitaet Muenchen, and individual
+ * contributors as indicated by the @authors tag. See the
+ * copyright.txt in the distribution for a full listing of individual
+ * contributors.
+ *
+ * This is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this software; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA, or see the FSF site: http://www.fsf.org.
+ */
+
+/**
+ * @file
+ * Images displayed per second by HighguiWindowModule in null display mode
+ *
+ * A thread per window pushes images at a fixed rate, or as fast as it can, while the window
+ * thread of NullWindowModule.h takes them like the module does with displayMode="null".
+ * Reports the images displayed per second over all windows, the dropped images and the time
+ * from showImage() until the window thread took the image.
+ *
+ * usage: utDisplayRateBenchmark [seconds [windows]]
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <boost/bind.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/barrier.hpp>
+#include "NullWindowModule.h"
+
+using namespace Ubitrack::Drivers;
+
+namespace {
+
+/** pushes images until the end time, at the given rate or as fast as possible if it is 0 */
+void producer( NullWindowModule* pModule, int window, double rate, unsigned long long duration, boost::barrier* pStart )
+{
+	boost::shared_ptr< BenchmarkImage > pImage( new BenchmarkImage );
+
+	pStart->wait();
+	unsigned long long start = now();
+	unsigned long long end = start + duration;
+	for ( unsigned long i = 0; ; i++ )
+	{
+		unsigned long long t = now();
+		if ( t >= end )
+			break;
+
+		if ( rate > 0 )
+		{
+			unsigned long long due = start + static_cast< unsigned long long >( i * 1e9 / rate );
+			if ( due > t )
+			{
+				boost::this_thread::sleep( boost::posix_time::microseconds( ( due - t ) / 1000 ) );
+				t = now();
+			}
+		}
+
+		pModule->showImage( window, pImage, t );
+	}
+}
+
+/** runs one configuration and prints a line of results */
+void run( int nWindows, double rate, double seconds )
+{
+	NullWindowModule module( nWindows );
+	boost::thread consumer( boost::bind( &NullWindowModule::threadProc, &module ) );
+
+	unsigned long long duration = static_cast< unsigned long long >( seconds * 1e9 );
+	boost::barrier start( nWindows );
+	boost::thread_group producers;
+	for ( int i = 0; i < nWindows; i++ )
+		producers.create_thread( boost::bind( &producer, &module, i, rate, duration, &start ) );
+	producers.join_all();
+
+	module.stop();
+	consumer.join();
+
+	unsigned long nReceived, nDropped;
+	module.counts( nReceived, nDropped );
+	double latencyAvg = module.nShown ? module.latencySum / 1e3 / module.nShown : 0.0;
+
+	if ( rate > 0 )
+		std::printf( "%7d %10.0f", nWindows, rate );
+	else
+		std::printf( "%7d %10s", nWindows, "max" );
+	std::printf( " %12.0f %12.0f %12.0f %12.1f %12.1f\n", nReceived / seconds, module.nShown / seconds, 
+		nDropped / seconds, latencyAvg, module.latencyMax / 1e3 );
+}
+
+} // anonymous namespace
+
+
+int main( int argc, char** argv )
+{
+	double seconds = argc > 1 ? std::atof( argv[ 1 ] ) : 2.0;
+	int nWindows = argc > 2 ? std::atoi( argv[ 2 ] ) : 8;
+	if ( seconds <= 0 || nWindows < 1 )
+	{
+		std::fprintf( stderr, "usage: %s [seconds [windows]]\n", argv[ 0 ] );
+		return 1;
+	}
+
+	std::printf( "%d windows, %.1f s per rate, %u hardware threads\n", nWindows, seconds, boost::thread::hardware_concurrency() );
+	std::printf( "windows fps/window     pushed/s  displayed/s    dropped/s   latency us  max lat. us\n" );
+	const double rates[] = { 30, 60, 120, 1000, 0 };
+	for ( std::size_t i = 0; i < sizeof( rates ) / sizeof( rates[ 0 ] ); i++ )
+		run( nWindows, rates[ i ], seconds );
+
+	return 0;
+}
@@ -0,0 +1,156 @@
+/*
+ * Ubitrack - Library for Ubiquitous Tracking
+ * Copyright 2006, Technische Universitaet Muenchen, and individual
+ * contributors as indicated by the @authors tag. See the
+ * copyright.txt in the distribution for a full listing of individual
+ * contributors.
+ *
+ * This is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this software; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA, or see the FSF site: http://www.fsf.org.
+ */
+
+/**
+ * @file
+ * The hand-off of HighguiWindowModule in null display mode, shared by the benchmarks
+ *
+ * showImage() and threadProc() make the same calls to WindowCommandQueue.h as the module,
+ * the window thread discards the images instead of showing them, like displayMode="null".
+ */
+
+#ifndef __NullWindowModule_h_INCLUDED__
+#define __NullWindowModule_h_INCLUDED__
+
+#include <algorithm>
+#include <vector>
+#include <boost/scoped_array.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include "WindowCommandQueue.h"
+
+namespace Ubitrack { namespace Drivers {
+
+/** current time in ns since the epoch, like Measurement::now() */
+inline unsigned long long now()
+{
+	boost::posix_time::time_duration t( boost::posix_time::microsec_clock::universal_time() - 
+		boost::posix_time::ptime( boost::gregorian::date( 1970, 1, 1 ) ) );
+	return static_cast< unsigned long long >( t.total_microseconds() ) * 1000;
+}
+
+/** stands in for the image, only the shared pointer is handed over */
+struct BenchmarkImage
+{
+	char data[ 64 ];
+};
+
+/** the parts of HighguiWindowModule the benchmarks use */
+class NullWindowModule
+{
+public:
+	/**
+	 * @param nWindows number of windows
+	 * @param uiInterval maximum time between two wake-ups of the thread in ms, like the uiInterval attribute
+	 */
+	NullWindowModule( int nWindows, int uiInterval = 20 )
+		: slots( new LatestSlot< BenchmarkImage >[ nWindows ] )
+		, nShown( 0 )
+		, latencySum( 0 )
+		, latencyMax( 0 )
+		, m_nWindows( nWindows )
+		, m_uiInterval( uiInterval )
+		, m_ready( nWindows, false )
+		, m_bStop( false )
+	{}
+
+	/** the body of HighguiWindowModule::showImage(), the time is the push time for the latency */
+	void showImage( int window, const boost::shared_ptr< BenchmarkImage >& pImage, unsigned long long time )
+	{
+		if ( slots[ window ].put( pImage, time ) )
+			m_queue.push( WindowCommand( WindowCommand::imageReady, window ) );
+	}
+
+	/** the window thread of HighguiWindowModule in null display mode */
+	void threadProc()
+	{
+		std::vector< int > readyWindows;
+		unsigned long long nextDispatch = now();
+		while ( !m_bStop )
+		{
+			unsigned long long t = now();
+			m_queue.wait( m_bStop, t < nextDispatch ? ( nextDispatch - t ) / 1000 + 1 : 0 );
+
+			readyWindows.clear();
+			WindowCommand command;
+			while ( m_queue.pop( command ) )
+				if ( !m_ready[ command.window ] )
+				{
+					m_ready[ command.window ] = true;
+					readyWindows.push_back( command.window );
+				}
+
+			for ( std::size_t i = 0; i < readyWindows.size(); i++ )
+			{
+				boost::shared_ptr< BenchmarkImage > pImage;
+				unsigned long long time;
+				if ( slots[ readyWindows[ i ] ].take( pImage, time ) )
+				{
+					unsigned long long latency = now() - time;
+					latencySum += latency;
+					latencyMax = std::max( latencyMax, latency );
+					nShown++;
+				}
+				m_ready[ readyWindows[ i ] ] = false;
+			}
+
+			t = now();
+			if ( t >= nextDispatch )
+				nextDispatch = t + m_uiInterval * 1000000ULL;
+		}
+	}
+
+	/** stops threadProc() */
+	void stop()
+	{ m_queue.signal( m_bStop ); }
+
+	/** sums the counters of all slots */
+	void counts( unsigned long& nReceived, unsigned long& nDropped )
+	{
+		nReceived = nDropped = 0;
+		for ( int i = 0; i < m_nWindows; i++ )
+		{
+			unsigned long r, d;
+			slots[ i ].counts( r, d );
+			nReceived += r;
+			nDropped += d;
+		}
+	}
+
+	boost::scoped_array< LatestSlot< BenchmarkImage > > slots;
+
+	/** written by the window thread, read after stop() */
+	unsigned long nShown;
+	unsigned long long latencySum;
+	unsigned long long latencyMax;
+
+protected:
+	int m_nWindows;
+	int m_uiInterval;
+	std::vector< bool > m_ready;
+	CommandQueue m_queue;
+	bool m_bStop;
+};
+
+} } // namespace Ubitrack::Drivers
+
+#endif
@@ -0,0 +1,120 @@
+/*
+ * Ubitrack - Library for Ubiquitous Tracking
+ * Copyright 2006, Technische Universitaet Muenchen, and individual
+ * contributors as indicated by the @authors tag. See the
+ * copyright.txt in the distribution for a full listing of individual
+ * contributors.
+ *
+ * This is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this software; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA, or see the FSF site: http://www.fsf.org.
+ */
+
+/**
+ * @file
+ * Cost of HighguiWindowModule::showImage() for the pushing threads
+ *
+ * N threads push into the latest-image slots and the command queue of WindowCommandQueue.h
+ * exactly like showImage() does, while a window thread drains the queue like the module
+ * does in null display mode. Reports the ns per showImage() call, once with a window per
+ * thread and once with all threads pushing into the same window.
+ *
+ * usage: utShowImageBenchmark [calls per thread [max threads]]
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+#include <algorithm>
+#include <boost/bind.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/barrier.hpp>
+#include "NullWindowModule.h"
+
+using namespace Ubitrack::Drivers;
+
+namespace {
+
+/** pushes a number of images and stores when it started and finished */
+void producer( NullWindowModule* pModule, int window, unsigned long nCalls, boost::barrier* pStart, 
+	unsigned long long* pStartTime, unsigned long long* pEndTime )
+{
+	// an image per thread, so that the threads do not share its reference count
+	boost::shared_ptr< BenchmarkImage > pImage( new BenchmarkImage );
+
+	pStart->wait();
+	*pStartTime = now();
+	for ( unsigned long i = 0; i < nCalls; i++ )
+		pModule->showImage( window, pImage, i );
+	*pEndTime = now();
+}
+
+/** runs one configuration and prints a line of results */
+void run( int nThreads, bool bSharedWindow, unsigned long nCalls )
+{
+	int nWindows = bSharedWindow ? 1 : nThreads;
+	NullWindowModule module( nWindows );
+	boost::thread consumer( boost::bind( &NullWindowModule::threadProc, &module ) );
+
+	boost::barrier start( nThreads );
+	std::vector< unsigned long long > startTimes( nThreads ), endTimes( nThreads );
+	boost::thread_group producers;
+	for ( int i = 0; i < nThreads; i++ )
+		producers.create_thread( boost::bind( &producer, &module, bSharedWindow ? 0 : i, nCalls, &start, 
+			&startTimes[ i ], &endTimes[ i ] ) );
+	producers.join_all();
+
+	module.stop();
+	consumer.join();
+
+	// per thread: wall time of the thread / its calls, all threads: wall time of the run / all calls.
+	// With fewer cores than threads the per thread time includes the time slices of the others.
+	double perThread = 0.0;
+	unsigned long long first = startTimes[ 0 ], last = endTimes[ 0 ];
+	for ( int i = 0; i < nThreads; i++ )
+	{
+		perThread += double( endTimes[ i ] - startTimes[ i ] ) / nCalls / nThreads;
+		first = std::min( first, startTimes[ i ] );
+		last = std::max( last, endTimes[ i ] );
+	}
+	double overall = double( last - first ) / nCalls / nThreads;
+
+	unsigned long nReceived, nDropped;
+	module.counts( nReceived, nDropped );
+
+	std::printf( "%7d %7d %12.1f %12.1f %10lu %10lu %10lu\n", nThreads, nWindows, perThread, overall, 
+		nReceived, module.nShown, nDropped );
+}
+
+} // anonymous namespace
+
+
+int main( int argc, char** argv )
+{
+	unsigned long nCalls = argc > 1 ? std::strtoul( argv[ 1 ], 0, 10 ) : 1000000;
+	int maxThreads = argc > 2 ? std::atoi( argv[ 2 ] ) : 8;
+	if ( nCalls == 0 || maxThreads < 1 )
+	{
+		std::fprintf( stderr, "usage: %s [calls per thread [max threads]]\n", argv[ 0 ] );
+		return 1;
+	}
+
+	std::printf( "%lu showImage() calls per thread, %u hardware threads\n", nCalls, boost::thread::hardware_concurrency() );
+	std::printf( "threads windows  ns/call thr  ns/call all   received      shown    dropped\n" );
+	for ( int bShared = 0; bShared < 2; bShared++ )
+		for ( int nThreads = 1; nThreads <= maxThreads; nThreads *= 2 )
+			run( nThreads, bShared != 0, nCalls );
+
+	return 0;
+}
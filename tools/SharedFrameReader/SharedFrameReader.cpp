@@ -0,0 +1,225 @@
+/*
+ * Ubitrack - Library for Ubiquitous Tracking
+ * Copyright 2006, Technische Universitaet Muenchen, and individual
+ * contributors as indicated by the @authors tag. See the
+ * copyright.txt in the distribution for a full listing of individual
+ * contributors.
+ *
+ * This is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this software; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA, or see the FSF site: http://www.fsf.org.
+ */
+
+/**
+ * @file
+ * Reader for the frames exported by the SharedMemoryOutput component
+ *
+ * Follows the reader protocol described in SharedFrame.h, counts complete, torn and skipped
+ * frames and their latency, and optionally writes the last frame to a PPM file.
+ *
+ * usage: utSharedFrameReader [name [frames [output.ppm]]]
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <boost/interprocess/shared_memory_object.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include "SharedFrame.h"
+
+#ifdef __linux__
+	#include <unistd.h>
+	#include <time.h>
+	#include <sys/syscall.h>
+	#include <linux/futex.h>
+#else
+	#include <boost/thread/thread.hpp>
+#endif
+
+using namespace Ubitrack::Drivers;
+
+namespace {
+
+/** current time in ns since the epoch, like Measurement::now() */
+boost::uint64_t now()
+{
+	boost::posix_time::time_duration t( boost::posix_time::microsec_clock::universal_time() - 
+		boost::posix_time::ptime( boost::gregorian::date( 1970, 1, 1 ) ) );
+	return boost::uint64_t( t.total_microseconds() ) * 1000;
+}
+
+/** waits up to 100 ms for the doorbell to change from the given value */
+void waitForFrame( SharedFrame::Header* pHeader, boost::uint32_t doorbell )
+{
+#ifdef __linux__
+	struct timespec timeout = { 0, 100000000L };
+	syscall( SYS_futex, reinterpret_cast< boost::uint32_t* >( &pHeader->doorbell ), FUTEX_WAIT, doorbell, &timeout, 0, 0 );
+#else
+	for ( int i = 0; i < 100 && pHeader->doorbell.load( boost::memory_order_acquire ) == doorbell; i++ )
+		boost::this_thread::sleep( boost::posix_time::milliseconds( 1 ) );
+#endif
+}
+
+/** writes a frame as binary PPM */
+bool writePPM( const std::string& path, const std::vector< unsigned char >& data, 
+	boost::uint32_t width, boost::uint32_t height, boost::uint32_t stride, boost::uint32_t format )
+{
+	FILE* pFile = std::fopen( path.c_str(), "wb" );
+	if ( !pFile )
+		return false;
+
+	std::fprintf( pFile, "P6\n%u %u\n255\n", width, height );
+	unsigned bytesPerPixel = format == SharedFrame::formatRGBA8 ? 4 : 3;
+	std::vector< unsigned char > row( width * 3 );
+	for ( boost::uint32_t y = 0; y < height; y++ )
+	{
+		const unsigned char* pSource = &data[ y * stride ];
+		for ( boost::uint32_t x = 0; x < width; x++, pSource += bytesPerPixel )
+		{
+			// PPM is RGB
+			bool bBGR = format == SharedFrame::formatBGR8;
+			row[ 3 * x ] = pSource[ bBGR ? 2 : 0 ];
+			row[ 3 * x + 1 ] = pSource[ 1 ];
+			row[ 3 * x + 2 ] = pSource[ bBGR ? 0 : 2 ];
+		}
+		std::fwrite( &row[ 0 ], 1, row.size(), pFile );
+	}
+	return std::fclose( pFile ) == 0;
+}
+
+} // anonymous namespace
+
+
+int main( int argc, char** argv )
+{
+	using namespace boost::interprocess;
+
+	std::string name( argc > 1 ? argv[ 1 ] : "ubitrack_frames" );
+	unsigned long maxFrames = argc > 2 ? std::strtoul( argv[ 2 ], 0, 10 ) : 0;
+	std::string output( argc > 3 ? argv[ 3 ] : "" );
+
+	mapped_region region;
+	try
+	{
+		shared_memory_object shm( open_only, name.c_str(), read_only );
+		mapped_region( shm, read_only ).swap( region );
+	}
+	catch ( const interprocess_exception& e )
+	{
+		std::fprintf( stderr, "Cannot open shared memory %s: %s\n", name.c_str(), e.what() );
+		return 1;
+	}
+
+	const unsigned char* pBase = static_cast< const unsigned char* >( region.get_address() );
+	SharedFrame::Header* pHeader = const_cast< SharedFrame::Header* >( reinterpret_cast< const SharedFrame::Header* >( pBase ) );
+	if ( region.get_size() < SharedFrame::headerSize || pHeader->magic != SharedFrame::magic || pHeader->version != SharedFrame::version )
+	{
+		std::fprintf( stderr, "%s is not a frame export of version %u\n", name.c_str(), SharedFrame::version );
+		return 1;
+	}
+	boost::atomic_thread_fence( boost::memory_order_acquire );
+	if ( region.get_size() < pHeader->headerSize + pHeader->slotCount * pHeader->slotSize )
+	{
+		std::fprintf( stderr, "%s is truncated\n", name.c_str() );
+		return 1;
+	}
+	std::printf( "%s: %u slots of %llu bytes\n", name.c_str(), pHeader->slotCount, (unsigned long long)pHeader->slotSize );
+
+	std::vector< unsigned char > frame;
+	boost::uint32_t width = 0, height = 0, stride = 0, format = 0;
+	boost::uint64_t last = pHeader->published.load( boost::memory_order_acquire );
+	unsigned long nFrames = 0, nTorn = 0, nSkipped = 0, nTotal = 0;
+	double latencySum = 0.0, latencyMax = 0.0;
+	boost::uint64_t reportTime = now();
+
+	while ( pHeader->active.load( boost::memory_order_acquire ) && ( !maxFrames || nTotal < maxFrames ) )
+	{
+		boost::uint32_t doorbell = pHeader->doorbell.load( boost::memory_order_acquire );
+		boost::uint64_t published = pHeader->published.load( boost::memory_order_acquire );
+		if ( published == last )
+		{
+			waitForFrame( pHeader, doorbell );
+			continue;
+		}
+
+		if ( last && published > last + 1 )
+			nSkipped += static_cast< unsigned long >( published - last - 1 );
+		last = published;
+
+		const unsigned char* pSlotData = pBase + pHeader->headerSize + ( ( published - 1 ) % pHeader->slotCount ) * pHeader->slotSize;
+		const SharedFrame::Slot* pSlot = reinterpret_cast< const SharedFrame::Slot* >( pSlotData );
+		if ( pSlot->sequence.load( boost::memory_order_acquire ) != published )
+		{
+			nTorn++;
+			continue;
+		}
+
+		boost::uint64_t timestamp = pSlot->timestamp;
+		width = pSlot->width;
+		height = pSlot->height;
+		stride = pSlot->stride;
+		format = pSlot->format;
+		std::size_t size = std::size_t( stride ) * height;
+		if ( size > pHeader->slotSize - pHeader->slotHeaderSize )
+		{
+			nTorn++;
+			continue;
+		}
+		frame.resize( size );
+		std::memcpy( &frame[ 0 ], pSlotData + pHeader->slotHeaderSize, size );
+
+		// the copy must be complete before the sequence number is checked again
+		boost::atomic_thread_fence( boost::memory_order_acquire );
+		if ( pSlot->sequence.load( boost::memory_order_relaxed ) != published )
+		{
+			nTorn++;
+			continue;
+		}
+
+		double latency = ( double( now() ) - double( timestamp ) ) * 1e-6;
+		latencySum += latency;
+		latencyMax = std::max( latencyMax, latency );
+		nFrames++;
+		nTotal++;
+
+		boost::uint64_t t = now();
+		if ( t >= reportTime + 1000000000ULL )
+		{
+			std::printf( "%lu frames %ux%u, %lu torn, %lu skipped, latency %.2f ms (max %.2f ms)\n", 
+				nFrames, width, height, nTorn, nSkipped, latencySum / nFrames, latencyMax );
+			nFrames = nTorn = nSkipped = 0;
+			latencySum = latencyMax = 0.0;
+			reportTime = t;
+		}
+	}
+
+	if ( !pHeader->active.load( boost::memory_order_acquire ) )
+		std::printf( "writer stopped\n" );
+	std::printf( "%lu frames read\n", nTotal );
+
+	if ( !output.empty() && !frame.empty() )
+	{
+		if ( !writePPM( output, frame, width, height, stride, format ) )
+		{
+			std::fprintf( stderr, "Cannot write %s\n", output.c_str() );
+			return 1;
+		}
+		std::printf( "last frame written to %s\n", output.c_str() );
+	}
+	return 0;
+}
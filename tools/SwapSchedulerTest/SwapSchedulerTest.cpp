@@ -0,0 +1,298 @@
+/*
+ * Ubitrack - Library for Ubiquitous Tracking
+ * Copyright 2006, Technische Universitaet Muenchen, and individual
+ * contributors as indicated by the @authors tag. See the
+ * copyright.txt in the distribution for a full listing of individual
+ * contributors.
+ *
+ * This is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this software; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA, or see the FSF site: http://www.fsf.org.
+ */
+
+/**
+ * @file
+ * Tests the swap scheduling of VideoSync with a mock sync source
+ *
+ * Checks that getRetrace() targets max( last target + 1, current retrace + 1 ), that the
+ * swap is scheduled for exactly that retrace, so the stereo parity the render module derives
+ * from it is the parity of the retrace the frame is shown at, and that late swaps are counted
+ * as dropped frames. Returns 1 if a check fails.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+#include <algorithm>
+#include <boost/shared_ptr.hpp>
+#include <log4cpp/Category.hh>
+#include "SwapScheduler.h"
+
+#if defined( __linux__ )
+	#include <time.h>
+#endif
+
+log4cpp::Category& logger( log4cpp::Category::getInstance( "Drivers.Render" ) );
+
+namespace {
+
+int g_failures = 0;
+
+#define CHECK( condition ) \
+	if ( !( condition ) ) \
+	{ \
+		std::fprintf( stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition ); \
+		g_failures++; \
+	}
+
+/** retrace period of the mock display in microseconds, 60 Hz */
+const boost::int64_t g_period = 16667;
+
+/** current CLOCK_MONOTONIC time in microseconds, the clock of OML system times */
+boost::int64_t monotonicUst()
+{
+#if defined( __linux__ )
+	timespec monotonic;
+	clock_gettime( CLOCK_MONOTONIC, &monotonic );
+	return boost::int64_t( monotonic.tv_sec ) * 1000000 + monotonic.tv_nsec / 1000;
+#else
+	return 0;
+#endif
+}
+
+/**
+ * Display that shows a scheduled swap at its target retrace, or at the next one if the
+ * target has already passed. Time only advances when the test says so or a swap is waited for.
+ */
+class MockSyncSource
+	: public SyncSource
+{
+public:
+
+	MockSyncSource()
+		: bAvailable( true )
+		, bFailSchedule( false )
+		, bFailWait( false )
+		, msc( 100 )
+		, m_sbc( 0 )
+		, m_shownMsc( 0 )
+		, m_ustBase( monotonicUst() - 200 * g_period )
+	{}
+
+	virtual bool available()
+	{ return bAvailable; }
+
+	virtual bool getSyncValues( boost::int64_t& ust, boost::int64_t& msc, boost::int64_t& sbc )
+	{
+		ust = this->ust( this->msc );
+		msc = this->msc;
+		sbc = m_sbc;
+		return true;
+	}
+
+	virtual boost::int64_t swapBuffersMsc( boost::int64_t targetMsc )
+	{
+		if ( bFailSchedule )
+			return -1;
+
+		targets.push_back( targetMsc );
+		m_shownMsc = std::max( targetMsc, msc + 1 );
+		return ++m_sbc;
+	}
+
+	virtual bool waitForSbc( boost::int64_t sbc, boost::int64_t& ust, boost::int64_t& msc )
+	{
+		if ( bFailWait || sbc != m_sbc )
+			return false;
+
+		this->msc = m_shownMsc;
+		shown.push_back( m_shownMsc );
+		ust = this->ust( m_shownMsc );
+		msc = m_shownMsc;
+		return true;
+	}
+
+	/** system time of a retrace */
+	boost::int64_t ust( boost::int64_t msc )
+	{ return m_ustBase + msc * g_period; }
+
+	bool bAvailable;
+	bool bFailSchedule;
+	bool bFailWait;
+
+	/** current retrace */
+	boost::int64_t msc;
+
+	/** retraces the swaps were scheduled for and shown at */
+	std::vector< boost::int64_t > targets;
+	std::vector< boost::int64_t > shown;
+
+protected:
+	boost::int64_t m_sbc;
+	boost::int64_t m_shownMsc;
+	boost::int64_t m_ustBase;
+};
+
+/**
+ * one frame of the render module: asks for the retrace, renders the eye of its parity
+ * for the given number of retraces and swaps
+ * @return the retrace the frame was rendered for
+ */
+boost::int64_t renderFrame( SwapScheduler& scheduler, MockSyncSource& source, int renderRetraces )
+{
+	boost::int64_t retrace = -1;
+	CHECK( scheduler.getRetrace( retrace ) );
+	source.msc += renderRetraces;
+	CHECK( scheduler.swap() );
+
+	// the swap has to be scheduled for the retrace the eye was chosen for
+	CHECK( !source.targets.empty() && source.targets.back() == retrace );
+	return retrace;
+}
+
+void testOnTime()
+{
+	boost::shared_ptr< MockSyncSource > pSource( new MockSyncSource );
+	SwapScheduler scheduler( pSource );
+	CHECK( scheduler.available() );
+
+	Ubitrack::Measurement::Timestamp lastPresent = 0;
+	for ( int i = 0; i < 8; i++ )
+	{
+		boost::int64_t retrace = renderFrame( scheduler, *pSource, 0 );
+		CHECK( retrace == 101 + i );
+		CHECK( pSource->shown.back() == retrace );
+		CHECK( scheduler.isPresentTimeMeasured() );
+
+		// the present time is the time of the retrace the frame was shown at
+		if ( i > 0 )
+		{
+			long long interval = static_cast< long long >( scheduler.getLastPresentTime() - lastPresent );
+			CHECK( interval > ( g_period - 1000 ) * 1000 && interval < ( g_period + 1000 ) * 1000 );
+		}
+		lastPresent = scheduler.getLastPresentTime();
+	}
+
+	// on time, the parity of the frames alternates
+	for ( std::size_t i = 1; i < pSource->shown.size(); i++ )
+		CHECK( pSource->shown[ i ] % 2 != pSource->shown[ i - 1 ] % 2 );
+	CHECK( scheduler.getDroppedFrames() == 0 );
+}
+
+void testLate()
+{
+	boost::shared_ptr< MockSyncSource > pSource( new MockSyncSource );
+	SwapScheduler scheduler( pSource );
+
+	CHECK( renderFrame( scheduler, *pSource, 0 ) == 101 );
+
+	// rendering takes two retraces: scheduled for 102, the display is at 103, shown at 104
+	CHECK( renderFrame( scheduler, *pSource, 2 ) == 102 );
+	CHECK( pSource->shown.back() == 104 );
+	CHECK( scheduler.getDroppedFrames() == 2 );
+
+	// the next frame targets the retrace after the late one
+	CHECK( renderFrame( scheduler, *pSource, 0 ) == 105 );
+	CHECK( pSource->shown.back() == 105 );
+
+	// one retrace too slow: scheduled for 106, the display is at 106, shown at 107
+	CHECK( renderFrame( scheduler, *pSource, 1 ) == 106 );
+	CHECK( pSource->shown.back() == 107 );
+	CHECK( scheduler.getDroppedFrames() == 3 );
+	CHECK( renderFrame( scheduler, *pSource, 0 ) == 108 );
+	CHECK( scheduler.getDroppedFrames() == 3 );
+}
+
+void testNeverSameRetrace()
+{
+	boost::shared_ptr< MockSyncSource > pSource( new MockSyncSource );
+	SwapScheduler scheduler( pSource );
+
+	CHECK( renderFrame( scheduler, *pSource, 0 ) == 101 );
+
+	// a counter that lags behind the last swap must not make two frames target the same retrace
+	pSource->msc = 99;
+	boost::int64_t retrace = -1;
+	CHECK( scheduler.getRetrace( retrace ) );
+	CHECK( retrace == 102 );
+
+	// the display is ahead of the last target
+	pSource->msc = 110;
+	CHECK( scheduler.getRetrace( retrace ) );
+	CHECK( retrace == 111 );
+	CHECK( scheduler.swap() );
+	CHECK( pSource->targets.back() == 111 );
+}
+
+void testWithoutGetRetrace()
+{
+	boost::shared_ptr< MockSyncSource > pSource( new MockSyncSource );
+	SwapScheduler scheduler( pSource );
+
+	// swap() determines the target itself
+	CHECK( scheduler.swap() );
+	CHECK( pSource->targets.back() == 101 );
+
+	// a target is only used once, and an immediate swap discards it
+	boost::int64_t retrace = -1;
+	CHECK( scheduler.getRetrace( retrace ) );
+	CHECK( retrace == 102 );
+	scheduler.swappedNow();
+	CHECK( !scheduler.isPresentTimeMeasured() );
+	pSource->msc = 120;
+	CHECK( scheduler.swap() );
+	CHECK( pSource->targets.back() == 121 );
+}
+
+void testFailures()
+{
+	boost::shared_ptr< MockSyncSource > pSource( new MockSyncSource );
+	SwapScheduler scheduler( pSource );
+
+	// VideoSync swaps immediately if the swap cannot be scheduled
+	pSource->bFailSchedule = true;
+	CHECK( !scheduler.swap() );
+	CHECK( pSource->targets.empty() );
+	pSource->bFailSchedule = false;
+
+	// a scheduled swap whose completion cannot be waited for has no measured present time
+	pSource->bFailWait = true;
+	CHECK( scheduler.swap() );
+	CHECK( !scheduler.isPresentTimeMeasured() );
+	CHECK( scheduler.getDroppedFrames() == 0 );
+
+	pSource->bAvailable = false;
+	CHECK( !scheduler.available() );
+	CHECK( !SwapScheduler().available() );
+}
+
+} // anonymous namespace
+
+
+int main( int, char** )
+{
+	testOnTime();
+	testLate();
+	testNeverSameRetrace();
+	testWithoutGetRetrace();
+	testFailures();
+
+	if ( g_failures )
+	{
+		std::fprintf( stderr, "%d checks failed\n", g_failures );
+		return 1;
+	}
+	std::printf( "all checks passed\n" );
+	return 0;
+}
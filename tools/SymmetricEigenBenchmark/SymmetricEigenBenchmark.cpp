@@ -0,0 +1,232 @@
+/*
+ * Ubitrack - Library for Ubiquitous Tracking
+ * Copyright 2006, Technische Universitaet Muenchen, and individual
+ * contributors as indicated by the @authors tag. See the
+ * copyright.txt in the distribution for a full listing of individual
+ * contributors.
+ *
+ * This is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this software; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA, or see the FSF site: http://www.fsf.org.
+ */
+
+/**
+ * @file
+ * Compares symmetricEigen3() of the ErrorEllipsoid component with LAPACK dsyev
+ *
+ * Decomposes random symmetric positive definite 3x3 matrices with both solvers and reports
+ * the time per matrix, the largest residual |A v - l v| / |A| of each, the largest eigenvalue
+ * difference and the largest angle between corresponding eigenvectors. Eigenvectors of
+ * repeated eigenvalues are only defined up to a rotation, so matrices with two equal
+ * eigenvalues are checked by their residual only. Returns 1 if a check fails.
+ *
+ * usage: utSymmetricEigenBenchmark [matrices [seed]]
+ */
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+#include <algorithm>
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include "SymmetricEigen.h"
+
+using namespace Ubitrack;
+using namespace Ubitrack::Drivers;
+
+extern "C" void dsyev_( const char* jobz, const char* uplo, const int* n, double* a, const int* lda, 
+	double* w, double* work, const int* lwork, int* info );
+
+namespace {
+
+typedef Math::Matrix< double, 3, 3 > Matrix3;
+typedef Math::Vector< double, 3 > Vector3;
+
+/** current time in ns, only differences are used */
+double now()
+{
+	boost::posix_time::time_duration t( boost::posix_time::microsec_clock::universal_time() - 
+		boost::posix_time::ptime( boost::gregorian::date( 1970, 1, 1 ) ) );
+	return double( t.total_microseconds() ) * 1000.0;
+}
+
+double uniform( double from, double to )
+{ return from + ( to - from ) * std::rand() / RAND_MAX; }
+
+/** 
+ * R diag( l ) R^T with a random rotation R and eigenvalues spanning six orders of magnitude,
+ * every fourth matrix has two equal eigenvalues like an isotropic position error
+ */
+Matrix3 randomSpd( unsigned i, bool& bRepeated )
+{
+	// rotation from a random unit quaternion
+	double q[ 4 ], norm = 0.0;
+	for ( int k = 0; k < 4; k++ )
+	{
+		q[ k ] = uniform( -1.0, 1.0 );
+		norm += q[ k ] * q[ k ];
+	}
+	norm = std::sqrt( norm );
+	double w = q[ 0 ] / norm, x = q[ 1 ] / norm, y = q[ 2 ] / norm, z = q[ 3 ] / norm;
+	double r[ 3 ][ 3 ] = {
+		{ 1 - 2 * ( y * y + z * z ), 2 * ( x * y - w * z ), 2 * ( x * z + w * y ) },
+		{ 2 * ( x * y + w * z ), 1 - 2 * ( x * x + z * z ), 2 * ( y * z - w * x ) },
+		{ 2 * ( x * z - w * y ), 2 * ( y * z + w * x ), 1 - 2 * ( x * x + y * y ) } };
+
+	double l[ 3 ];
+	for ( int k = 0; k < 3; k++ )
+		l[ k ] = std::pow( 10.0, uniform( -6.0, 0.0 ) );
+	bRepeated = i % 4 == 3;
+	if ( bRepeated )
+		l[ 1 ] = l[ 0 ];
+
+	Matrix3 a;
+	for ( int j = 0; j < 3; j++ )
+		for ( int k = 0; k < 3; k++ )
+			a( j, k ) = r[ j ][ 0 ] * l[ 0 ] * r[ k ][ 0 ] + r[ j ][ 1 ] * l[ 1 ] * r[ k ][ 1 ] + r[ j ][ 2 ] * l[ 2 ] * r[ k ][ 2 ];
+	return a;
+}
+
+/** largest |A v_j - l_j v_j| / |A| over the columns, vectors given column major */
+double residual( const Matrix3& a, const double* values, const double* vectors )
+{
+	double normA = 0.0;
+	for ( int j = 0; j < 3; j++ )
+		for ( int k = 0; k < 3; k++ )
+			normA += a( j, k ) * a( j, k );
+	normA = std::sqrt( normA );
+
+	double worst = 0.0;
+	for ( int c = 0; c < 3; c++ )
+	{
+		double sum = 0.0;
+		for ( int j = 0; j < 3; j++ )
+		{
+			double d = -values[ c ] * vectors[ 3 * c + j ];
+			for ( int k = 0; k < 3; k++ )
+				d += a( j, k ) * vectors[ 3 * c + k ];
+			sum += d * d;
+		}
+		worst = std::max( worst, std::sqrt( sum ) / normA );
+	}
+	return worst;
+}
+
+} // anonymous namespace
+
+
+int main( int argc, char** argv )
+{
+	int count = argc > 1 ? std::atoi( argv[ 1 ] ) : 100000;
+	std::srand( argc > 2 ? std::atoi( argv[ 2 ] ) : 1 );
+	if ( count < 1 )
+	{
+		std::fprintf( stderr, "usage: %s [matrices [seed]]\n", argv[ 0 ] );
+		return 1;
+	}
+
+	std::vector< Matrix3 > matrices( count );
+	std::vector< bool > repeated( count );
+	for ( int i = 0; i < count; i++ )
+	{
+		bool bRepeated;
+		matrices[ i ] = randomSpd( i, bRepeated );
+		repeated[ i ] = bRepeated;
+	}
+
+	// Jacobi, all matrices in one batch like ErrorEllipsoid::setCovariances()
+	std::vector< Vector3 > jacobiValues( count );
+	std::vector< Matrix3 > jacobiVectors( count );
+	double start = now();
+	symmetricEigen3( &matrices[ 0 ], count, &jacobiValues[ 0 ], &jacobiVectors[ 0 ] );
+	double jacobiTime = ( now() - start ) / count;
+
+	// dsyev, one call per matrix like ErrorEllipsoid did before, with the workspace from a query
+	const int n = 3;
+	int lwork = -1, info;
+	double workSize, dummy[ 9 ], dummyValues[ 3 ];
+	dsyev_( "V", "U", &n, dummy, &n, dummyValues, &workSize, &lwork, &info );
+	lwork = int( workSize );
+	std::vector< double > work( lwork );
+
+	std::vector< double > lapackValues( 3 * count );
+	std::vector< double > lapackVectors( 9 * count );
+	start = now();
+	for ( int i = 0; i < count; i++ )
+	{
+		double* a = &lapackVectors[ 9 * i ];
+		for ( int j = 0; j < 3; j++ )
+			for ( int k = 0; k < 3; k++ )
+				a[ 3 * k + j ] = matrices[ i ]( j, k );
+		dsyev_( "V", "U", &n, a, &n, &lapackValues[ 3 * i ], &work[ 0 ], &lwork, &info );
+		if ( info != 0 )
+		{
+			std::fprintf( stderr, "dsyev failed with info %d on matrix %d\n", info, i );
+			return 1;
+		}
+	}
+	double lapackTime = ( now() - start ) / count;
+
+	double jacobiResidual = 0.0, lapackResidual = 0.0, valueError = 0.0, vectorError = 0.0, minDet = 1.0, maxDet = 1.0;
+	for ( int i = 0; i < count; i++ )
+	{
+		double values[ 3 ], vectors[ 9 ];
+		for ( int c = 0; c < 3; c++ )
+		{
+			values[ c ] = jacobiValues[ i ]( c );
+			for ( int j = 0; j < 3; j++ )
+				vectors[ 3 * c + j ] = jacobiVectors[ i ]( j, c );
+		}
+		jacobiResidual = std::max( jacobiResidual, residual( matrices[ i ], values, vectors ) );
+		lapackResidual = std::max( lapackResidual, residual( matrices[ i ], &lapackValues[ 3 * i ], &lapackVectors[ 9 * i ] ) );
+
+		const double* v = vectors;
+		double det = v[ 0 ] * ( v[ 4 ] * v[ 8 ] - v[ 5 ] * v[ 7 ] ) - v[ 3 ] * ( v[ 1 ] * v[ 8 ] - v[ 2 ] * v[ 7 ] ) + 
+			v[ 6 ] * ( v[ 1 ] * v[ 5 ] - v[ 2 ] * v[ 4 ] );
+		minDet = std::min( minDet, det );
+		maxDet = std::max( maxDet, det );
+
+		for ( int c = 0; c < 3; c++ )
+		{
+			double l = lapackValues[ 3 * i + c ];
+			valueError = std::max( valueError, std::fabs( values[ c ] - l ) / lapackValues[ 3 * i + 2 ] );
+
+			// only eigenvalues separated from the others have a unique eigenvector, up to its sign
+			double gap = 1.0;
+			for ( int d = 0; d < 3; d++ )
+				if ( d != c )
+					gap = std::min( gap, std::fabs( lapackValues[ 3 * i + d ] - l ) / lapackValues[ 3 * i + 2 ] );
+			if ( repeated[ i ] || gap < 1e-6 )
+				continue;
+
+			double dot = 0.0;
+			for ( int j = 0; j < 3; j++ )
+				dot += vectors[ 3 * c + j ] * lapackVectors[ 9 * i + 3 * c + j ];
+			vectorError = std::max( vectorError, std::acos( std::min( 1.0, std::fabs( dot ) ) ) );
+		}
+	}
+
+	std::printf( "%d random SPD 3x3 matrices, eigenvalues in [1e-6, 1], every fourth with a repeated eigenvalue\n", count );
+	std::printf( "                   ns/matrix  max residual\n" );
+	std::printf( "symmetricEigen3 %12.1f %13.3g\n", jacobiTime, jacobiResidual );
+	std::printf( "dsyev           %12.1f %13.3g\n", lapackTime, lapackResidual );
+	std::printf( "max eigenvalue difference / largest eigenvalue: %.3g\n", valueError );
+	std::printf( "max angle between eigenvectors of distinct eigenvalues: %.3g rad\n", vectorError );
+	std::printf( "determinant of the Jacobi eigenvectors in [%.15f, %.15f]\n", minDet, maxDet );
+
+	bool bOk = jacobiResidual < 1e-12 && valueError < 1e-12 && vectorError < 1e-6 && 
+		std::fabs( minDet - 1.0 ) < 1e-12 && std::fabs( maxDet - 1.0 ) < 1e-12;
+	std::printf( bOk ? "OK\n" : "FAILED\n" );
+	return bOk ? 0 : 1;
+}